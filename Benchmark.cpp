@@ -0,0 +1,704 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <malloc.h>
+
+#include "CompactTree.hpp"
+#include "Differentiator.hpp"
+#include "Polynomial.hpp"
+#include "Syntax_analyzer.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int    STD_CORPUS_SIZE    = 32;
+static const int    STD_REPEAT         = 3;
+static const int    MAX_DIFF_ORDER     = 3;
+static const int    TAYLOR_ORDER       = 5;
+static const double TAYLOR_POINT       = 0.5;
+static const int    SAMPLE_POINTS      = 2000;
+static const double REGRESSION_PERCENT = 10;
+
+static const int MAX_EXPR_LEN     = 1 << 14;
+static const int MAX_BENCH_NAME   = 64;
+static const int MAX_BENCHMARKS   = 64;
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Corpus of random expressions of one depth. The grammar
+//! only produces functions defined on the whole real line,
+//! so Taylor and sampling never hit domain errors.
+//-----------------------------------------------------------
+struct Corpus
+{
+    const char *name   = nullptr;
+    int         depth  = 0;
+    char      **texts  = nullptr;
+    Node      **parsed = nullptr;
+    int         size   = 0;
+};
+
+struct BenchResult
+{
+    char   name[MAX_BENCH_NAME] = "";
+    double ns_per_op = 0;
+    double nodes     = 0;
+    double bytes     = 0;
+    long   ops       = 0;
+};
+
+struct BenchReport
+{
+    BenchResult results[MAX_BENCHMARKS] = {};
+    int         size = 0;
+};
+
+struct BenchOptions
+{
+    int          corpus_size = STD_CORPUS_SIZE;
+    int          repeat      = STD_REPEAT;
+    unsigned int seed        = 1;
+    const char  *json        = nullptr;
+    const char  *baseline    = nullptr;
+    bool         rules       = false;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool   GetOptions       (int argc, const char *argv[], BenchOptions *options);
+static void   CorpusCtor       (Corpus *corpus, const char *name, int depth, int size, unsigned int *seed);
+static void   CorpusDtor       (Corpus *corpus);
+static void   GenerateExpr     (char *out, int *pos, int depth, unsigned int *seed);
+static Node  *ParseExpr        (const char *text);
+
+static void   BenchParse       (BenchReport *report, const Corpus *corpus, int repeat);
+static void   BenchOptimize    (BenchReport *report, const Corpus *corpus, int repeat);
+static void   BenchDiff        (BenchReport *report, const Corpus *corpus, int repeat);
+static void   BenchTaylor      (BenchReport *report, const Corpus *corpus, int repeat);
+static void   BenchSampling    (BenchReport *report, const Corpus *corpus, int repeat);
+
+static BenchResult *AddResult  (BenchReport *report, const Corpus *corpus, const char *bench);
+static void   SetTime          (BenchResult *result, double ns, long ops);
+static double NowNs            ();
+static size_t HeapInUse        ();
+static size_t CountNodes       (const Node *node);
+
+static void   PrintReport      (FILE *stream, const BenchReport *report);
+static bool   WriteJson        (const char *filename, const BenchReport *report);
+static bool   ReadJson         (const char *filename, BenchReport *report);
+static int    CompareReports   (const BenchReport *report, const BenchReport *baseline);
+
+static unsigned int NextRandom (unsigned int *seed);
+
+//----------------------------------------------------------------------------------------------------------------
+
+int main(const int argc, const char *argv[])
+{
+    BenchOptions options = {};
+    if (!GetOptions(argc, argv, &options))
+    {
+        printf("Usage: %s [--count N] [--repeat N] [--seed N] [--json FILE] [--baseline FILE] [--rules]\n", argv[0]);
+        return 1;
+    }
+
+    const int   NUMBER_OF_CORPORA = 3;
+    const char *names [NUMBER_OF_CORPORA] = {"small", "medium", "large"};
+    const int   depths[NUMBER_OF_CORPORA] = {3, 5, 7};
+
+    BenchReport *report = (BenchReport *)calloc(1, sizeof(BenchReport));
+    unsigned int seed   = (options.seed == 0) ? 1 : options.seed;
+
+    SimplifierStatsTiming(options.rules);
+
+    for (int i = 0; i < NUMBER_OF_CORPORA; i++)
+    {
+        Corpus corpus = {};
+        CorpusCtor(&corpus, names[i], depths[i], options.corpus_size, &seed);
+
+        BenchParse    (report, &corpus, options.repeat);
+        BenchOptimize (report, &corpus, options.repeat);
+        BenchDiff     (report, &corpus, options.repeat);
+        BenchTaylor   (report, &corpus, options.repeat);
+        BenchSampling (report, &corpus, options.repeat);
+
+        CorpusDtor(&corpus);
+    }
+
+    PrintReport(stdout, report);
+
+    if (options.rules)
+    {
+        printf("\n");
+        SimplifierPrintStats(stdout);
+    }
+
+    int regressions = 0;
+
+    if (options.json != nullptr)
+    {
+        WriteJson(options.json, report);
+    }
+    if (options.baseline != nullptr)
+    {
+        BenchReport *baseline = (BenchReport *)calloc(1, sizeof(BenchReport));
+
+        if (ReadJson(options.baseline, baseline))
+        {
+            regressions = CompareReports(report, baseline);
+        }
+        else
+        {
+            printf("\nNo baseline in %s, nothing to compare with.\n", options.baseline);
+        }
+
+        free(baseline);
+    }
+
+    free(report);
+    return (regressions == 0) ? 0 : 2;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool GetOptions(int argc, const char *argv[], BenchOptions *options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if      (hasValue && strcmp(argv[i], "--count"   ) == 0) {options->corpus_size = atoi(argv[++i]);}
+        else if (hasValue && strcmp(argv[i], "--repeat"  ) == 0) {options->repeat      = atoi(argv[++i]);}
+        else if (hasValue && strcmp(argv[i], "--seed"    ) == 0) {options->seed        = (unsigned int)atoi(argv[++i]);}
+        else if (hasValue && strcmp(argv[i], "--json"    ) == 0) {options->json        = argv[++i];}
+        else if (hasValue && strcmp(argv[i], "--baseline") == 0) {options->baseline    = argv[++i];}
+        else if (            strcmp(argv[i], "--rules"   ) == 0) {options->rules       = true;}
+        else
+        {
+            return false;
+        }
+    }
+
+    return options->corpus_size > 0 && options->repeat > 0;
+}
+
+static void CorpusCtor(Corpus *corpus, const char *name, int depth, int size, unsigned int *seed)
+{
+    *corpus = {};
+
+    corpus->name   = name;
+    corpus->depth  = depth;
+    corpus->size   = size;
+    corpus->texts  = (char **)calloc(size, sizeof(char *));
+    corpus->parsed = (Node **)calloc(size, sizeof(Node *));
+
+    char *buffer = (char *)calloc(MAX_EXPR_LEN, sizeof(char));
+
+    for (int i = 0; i < size; i++)
+    {
+        int pos = 0;
+        GenerateExpr(buffer, &pos, depth, seed);
+        buffer[pos] = '\0';
+
+        corpus->texts [i] = strdup(buffer);
+        corpus->parsed[i] = ParseExpr(buffer);
+    }
+
+    free(buffer);
+}
+
+static void CorpusDtor(Corpus *corpus)
+{
+    for (int i = 0; i < corpus->size; i++)
+    {
+        free(corpus->texts[i]);
+        treeDtor(corpus->parsed[i]);
+    }
+
+    free(corpus->texts);
+    free(corpus->parsed);
+
+    *corpus = {};
+}
+
+static void GenerateExpr(char *out, int *pos, int depth, unsigned int *seed)
+{
+    const int reserve = 64;
+    if (*pos > MAX_EXPR_LEN - reserve) {depth = 0;}
+
+    unsigned int kind = NextRandom(seed) % ((depth <= 0) ? 3 : 12);
+
+    switch (kind)
+    {
+    case 0:
+    case 1:
+        *pos += sprintf(out + *pos, "x");
+        return;
+    case 2:
+        *pos += sprintf(out + *pos, "%u", NextRandom(seed) % 9 + 1);
+        return;
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+        {
+        const char ops[] = "+-**";
+        *pos += sprintf(out + *pos, "(");
+        GenerateExpr(out, pos, depth - 1, seed);
+        *pos += sprintf(out + *pos, "%c", ops[kind - 3]);
+        GenerateExpr(out, pos, depth - 1, seed);
+        *pos += sprintf(out + *pos, ")");
+        return;
+        }
+    case 7:
+        *pos += sprintf(out + *pos, "(");
+        GenerateExpr(out, pos, depth - 1, seed);
+        *pos += sprintf(out + *pos, ")/(2+x*x)");
+        return;
+    case 8:
+        *pos += sprintf(out + *pos, "(");
+        GenerateExpr(out, pos, depth - 1, seed);
+        *pos += sprintf(out + *pos, ")^%u", NextRandom(seed) % 3 + 2);
+        return;
+    default:
+        {
+        const char *funcs[] = {"sin(", "cos(", "arctan("};
+        *pos += sprintf(out + *pos, "%s", funcs[kind - 9]);
+        GenerateExpr(out, pos, depth - 1, seed);
+        *pos += sprintf(out + *pos, ")");
+        return;
+        }
+    }
+}
+
+static Node *ParseExpr(const char *text)
+{
+    stack_id stk = {};
+    StackCtor(&stk);
+
+    GetTokens(text, stk);
+    Node *node = GetStarted(stk);
+
+    StackDtor(&stk);
+    return node;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void BenchParse(BenchReport *report, const Corpus *corpus, int repeat)
+{
+    BenchResult *result = AddResult(report, corpus, "parse");
+    Node       **trees  = (Node **)calloc(corpus->size, sizeof(Node *));
+
+    for (int r = 0; r < repeat; r++)
+    {
+        size_t heap  = HeapInUse();
+        double start = NowNs();
+
+        for (int i = 0; i < corpus->size; i++)
+        {
+            trees[i] = ParseExpr(corpus->texts[i]);
+        }
+
+        SetTime(result, NowNs() - start, corpus->size);
+        result->bytes = ((double)HeapInUse() - (double)heap) / corpus->size;
+
+        result->nodes = 0;
+        for (int i = 0; i < corpus->size; i++)
+        {
+            result->nodes += (double)CountNodes(trees[i]) / corpus->size;
+            treeDtor(trees[i]);
+        }
+    }
+
+    free(trees);
+}
+
+static void BenchOptimize(BenchReport *report, const Corpus *corpus, int repeat)
+{
+    BenchResult *result = AddResult(report, corpus, "optimize");
+    Node       **trees  = (Node **)calloc(corpus->size, sizeof(Node *));
+
+    for (int r = 0; r < repeat; r++)
+    {
+        for (int i = 0; i < corpus->size; i++)
+        {
+            trees[i] = copyNode(corpus->parsed[i]);
+        }
+
+        size_t heap  = HeapInUse();
+        double start = NowNs();
+
+        for (int i = 0; i < corpus->size; i++)
+        {
+            trees[i] = OptimizeExpression(trees[i]);
+        }
+
+        SetTime(result, NowNs() - start, corpus->size);
+        result->bytes = ((double)HeapInUse() - (double)heap) / corpus->size;
+
+        result->nodes = 0;
+        for (int i = 0; i < corpus->size; i++)
+        {
+            result->nodes += (double)CountNodes(trees[i]) / corpus->size;
+            treeDtor(trees[i]);
+        }
+    }
+
+    free(trees);
+}
+
+//-----------------------------------------------------------
+//! diff/k: simplified derivative of order k from the
+//! simplified derivative of order k - 1
+//-----------------------------------------------------------
+static void BenchDiff(BenchReport *report, const Corpus *corpus, int repeat)
+{
+    Node **trees = (Node **)calloc(corpus->size, sizeof(Node *));
+    Node **prevs = (Node **)calloc(corpus->size, sizeof(Node *));
+
+    for (int i = 0; i < corpus->size; i++)
+    {
+        prevs[i] = OptimizeExpression(copyNode(corpus->parsed[i]));
+    }
+
+    for (int order = 1; order <= MAX_DIFF_ORDER; order++)
+    {
+        char bench[MAX_BENCH_NAME] = "";
+        sprintf(bench, "diff/%d", order);
+
+        BenchResult *result = AddResult(report, corpus, bench);
+
+        for (int r = 0; r < repeat; r++)
+        {
+            size_t heap  = HeapInUse();
+            double start = NowNs();
+
+            for (int i = 0; i < corpus->size; i++)
+            {
+                trees[i] = OptimizeExpression(Diff(prevs[i], "x"));
+            }
+
+            SetTime(result, NowNs() - start, corpus->size);
+            result->bytes = ((double)HeapInUse() - (double)heap) / corpus->size;
+
+            result->nodes = 0;
+            for (int i = 0; i < corpus->size; i++)
+            {
+                result->nodes += (double)CountNodes(trees[i]) / corpus->size;
+
+                if (r + 1 < repeat) {treeDtor(trees[i]);}
+            }
+        }
+
+        for (int i = 0; i < corpus->size; i++)
+        {
+            treeDtor(prevs[i]);
+            prevs[i] = trees[i];
+        }
+    }
+
+    for (int i = 0; i < corpus->size; i++)
+    {
+        treeDtor(prevs[i]);
+    }
+
+    free(trees);
+    free(prevs);
+}
+
+static void BenchTaylor(BenchReport *report, const Corpus *corpus, int repeat)
+{
+    char bench[MAX_BENCH_NAME] = "";
+    sprintf(bench, "taylor/%d", TAYLOR_ORDER);
+
+    BenchResult *result = AddResult(report, corpus, bench);
+
+    FILE  *texfile = fopen("/dev/null", "w");
+    Node **trees   = (Node **)calloc(corpus->size, sizeof(Node *));
+
+    for (int i = 0; i < corpus->size; i++)
+    {
+        trees[i] = OptimizeExpression(copyNode(corpus->parsed[i]));
+    }
+
+    for (int r = 0; r < repeat; r++)
+    {
+        double start = NowNs();
+        size_t heap  = 0;
+
+        for (int i = 0; i < corpus->size; i++)
+        {
+            DiffCache  cache  = {};
+            Polynomial taylor = {};
+            DiffCacheCtor(&cache);
+
+            Taylor(trees[i], "x", TAYLOR_POINT, TAYLOR_ORDER, texfile, &taylor, &cache);
+
+            DiffCacheStats stats = {};
+            DiffCacheGetStats(&cache, &stats);
+            heap += stats.nodes * sizeof(Node);
+
+            PolynomialDtor(&taylor);
+            DiffCacheDtor(&cache);
+        }
+
+        SetTime(result, NowNs() - start, corpus->size);
+        result->bytes = (double)heap / corpus->size;
+        result->nodes = (double)heap / sizeof(Node) / corpus->size;
+    }
+
+    for (int i = 0; i < corpus->size; i++)
+    {
+        treeDtor(trees[i]);
+    }
+
+    free(trees);
+    fclose(texfile);
+}
+
+//-----------------------------------------------------------
+//! Plot sampling, one op is one point. sample/tree walks the
+//! Node tree, sample/compact evaluates the compact tree point
+//! by point, sample/batch and sample/fast are what
+//! AddToGnuplotFile does with MATH_EXACT and MATH_FAST.
+//-----------------------------------------------------------
+static void BenchSampling(BenchReport *report, const Corpus *corpus, int repeat)
+{
+    BenchResult *tree_result    = AddResult(report, corpus, "sample/tree");
+    BenchResult *compact_result = AddResult(report, corpus, "sample/compact");
+    BenchResult *batch_result   = AddResult(report, corpus, "sample/batch");
+    BenchResult *fast_result    = AddResult(report, corpus, "sample/fast");
+
+    const double step = 2.0 / SAMPLE_POINTS;
+    volatile double sink = 0;
+
+    double points[SAMPLE_POINTS] = {};
+    double values[SAMPLE_POINTS] = {};
+    for (int point = 0; point < SAMPLE_POINTS; point++)
+    {
+        points[point] = -1 + point*step;
+    }
+
+    CompactTree compact = {};
+    CompactTreeCtor(&compact);
+
+    for (int r = 0; r < repeat; r++)
+    {
+        double tree_ns    = 0;
+        double compact_ns = 0;
+        double batch_ns   = 0;
+        double fast_ns    = 0;
+        double nodes      = 0;
+        double bytes      = 0;
+
+        for (int i = 0; i < corpus->size; i++)
+        {
+            const Node *node = corpus->parsed[i];
+
+            double start = NowNs();
+            for (int point = 0; point < SAMPLE_POINTS; point++)
+            {
+                sink = sink + Evaluate(node, "x", -1 + point*step);
+            }
+            tree_ns += NowNs() - start;
+
+            start = NowNs();
+            compactFromNode(&compact, node);
+            for (int point = 0; point < SAMPLE_POINTS; point++)
+            {
+                sink = sink + compactEvaluate(&compact, "x", -1 + point*step);
+            }
+            compact_ns += NowNs() - start;
+
+            start = NowNs();
+            compactEvaluateBatch(&compact, "x", points, values, SAMPLE_POINTS, MATH_EXACT);
+            batch_ns += NowNs() - start;
+            sink = sink + values[SAMPLE_POINTS - 1];
+
+            start = NowNs();
+            compactEvaluateBatch(&compact, "x", points, values, SAMPLE_POINTS, MATH_FAST);
+            fast_ns += NowNs() - start;
+            sink = sink + values[SAMPLE_POINTS - 1];
+
+            nodes += (double)compact.size / corpus->size;
+            bytes += (double)compact.size * (2*sizeof(uint8_t) + sizeof(Data) + sizeof(uint32_t) + sizeof(double)) / corpus->size;
+        }
+
+        long ops = (long)corpus->size * SAMPLE_POINTS;
+
+        SetTime(tree_result,    tree_ns,    ops);
+        SetTime(compact_result, compact_ns, ops);
+        SetTime(batch_result,   batch_ns,   ops);
+        SetTime(fast_result,    fast_ns,    ops);
+
+        tree_result->nodes    = compact_result->nodes = batch_result->nodes = fast_result->nodes = nodes;
+        tree_result->bytes    = nodes * sizeof(Node);
+        compact_result->bytes = batch_result->bytes = fast_result->bytes = bytes;
+    }
+
+    CompactTreeDtor(&compact);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static BenchResult *AddResult(BenchReport *report, const Corpus *corpus, const char *bench)
+{
+    if (report->size == MAX_BENCHMARKS)
+    {
+        printf("Error: too many benchmarks.\n");
+        abort();
+    }
+
+    BenchResult *result = &report->results[report->size++];
+    snprintf(result->name, MAX_BENCH_NAME, "%s/%s", bench, corpus->name);
+
+    return result;
+}
+
+//-----------------------------------------------------------
+//! Keep the best of the repeats, it is the least noisy one
+//-----------------------------------------------------------
+static void SetTime(BenchResult *result, double ns, long ops)
+{
+    double ns_per_op = ns / ops;
+
+    if (result->ops == 0 || ns_per_op < result->ns_per_op)
+    {
+        result->ns_per_op = ns_per_op;
+    }
+    result->ops += ops;
+}
+
+static double NowNs()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+static size_t HeapInUse()
+{
+    return mallinfo2().uordblks;
+}
+
+static size_t CountNodes(const Node *node)
+{
+    if (node == nullptr) {return 0;}
+
+    return 1 + CountNodes(node->left) + CountNodes(node->right);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void PrintReport(FILE *stream, const BenchReport *report)
+{
+    fprintf(stream, "%-28s %14s %12s %14s %12s\n", "benchmark", "ns/op", "nodes/op", "bytes/op", "ops");
+
+    for (int i = 0; i < report->size; i++)
+    {
+        const BenchResult *result = &report->results[i];
+
+        fprintf(stream, "%-28s %14.1lf %12.1lf %14.1lf %12ld\n",
+                result->name, result->ns_per_op, result->nodes, result->bytes, result->ops);
+    }
+}
+
+static bool WriteJson(const char *filename, const BenchReport *report)
+{
+    FILE *json = fopen(filename, "w");
+    if (json == nullptr)
+    {
+        printf("Error opening file %s for benchmark results.\n", filename);
+        return false;
+    }
+
+    fprintf(json, "[\n");
+    for (int i = 0; i < report->size; i++)
+    {
+        const BenchResult *result = &report->results[i];
+
+        fprintf(json, "  {\"name\": \"%s\", \"ns_per_op\": %.3lf, \"nodes\": %.3lf, \"bytes\": %.3lf, \"ops\": %ld}%s\n",
+                result->name, result->ns_per_op, result->nodes, result->bytes, result->ops,
+                (i + 1 < report->size) ? "," : "");
+    }
+    fprintf(json, "]\n");
+
+    return fclose(json) == 0;
+}
+
+//-----------------------------------------------------------
+//! Reads files written by WriteJson (one result per line)
+//-----------------------------------------------------------
+static bool ReadJson(const char *filename, BenchReport *report)
+{
+    FILE *json = fopen(filename, "r");
+    if (json == nullptr) {return false;}
+
+    const int max_line_len = 512;
+    char line[max_line_len] = "";
+
+    report->size = 0;
+
+    while (report->size < MAX_BENCHMARKS && fgets(line, max_line_len, json) != nullptr)
+    {
+        BenchResult *result = &report->results[report->size];
+
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf, \"nodes\": %lf, \"bytes\": %lf, \"ops\": %ld",
+                   result->name, &result->ns_per_op, &result->nodes, &result->bytes, &result->ops) == 5)
+        {
+            report->size++;
+        }
+    }
+
+    fclose(json);
+    return report->size > 0;
+}
+
+static int CompareReports(const BenchReport *report, const BenchReport *baseline)
+{
+    int regressions = 0;
+
+    printf("\n%-28s %14s %14s %10s\n", "benchmark", "baseline", "current", "change");
+
+    for (int i = 0; i < report->size; i++)
+    {
+        const BenchResult *result = &report->results[i];
+        const BenchResult *base   = nullptr;
+
+        for (int j = 0; j < baseline->size && base == nullptr; j++)
+        {
+            if (strcmp(baseline->results[j].name, result->name) == 0) {base = &baseline->results[j];}
+        }
+
+        if (base == nullptr || base->ns_per_op <= 0)
+        {
+            printf("%-28s %14s %14.1lf %10s\n", result->name, "-", result->ns_per_op, "new");
+            continue;
+        }
+
+        double change = 100 * (result->ns_per_op - base->ns_per_op) / base->ns_per_op;
+        bool   isSlow = change > REGRESSION_PERCENT;
+
+        printf("%-28s %14.1lf %14.1lf %+9.1lf%%%s\n", result->name, base->ns_per_op, result->ns_per_op, change,
+               isSlow ? "  <- regression" : "");
+
+        if (isSlow) {regressions++;}
+    }
+
+    printf("\n%d regression(s) over %.0lf%%.\n", regressions, REGRESSION_PERCENT);
+    return regressions;
+}
+
+static unsigned int NextRandom(unsigned int *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+
+    return *seed;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,743 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "CompactTree.hpp"
+#include "MyGeneralFunctions.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool     CompactReserve      (CompactTree *tree, uint32_t capacity);
+static uint32_t CompactAppend       (CompactTree *tree, const Node *node);
+static void     CompactPrintNode    (FILE *stream, const CompactTree *tree, uint32_t index, bool needBrackets);
+static bool     CompactOptimizePass (CompactTree *tree);
+static uint32_t CompactKeepBlock    (CompactTree *out, uint32_t from, uint32_t to);
+static bool     isCompactNum        (const CompactTree *tree, uint32_t index, double value);
+static bool     isCompactValid      (const CompactTree *tree);
+static double   CompactVarValue     (const char *name, const char *var, double value);
+static double   ApplyOperation      (Operations op, double left, double right);
+static void     ApplyOperationBatch (Operations op, const double *left, const double *right, double *result, size_t count,
+                                     MathAccuracy accuracy);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool CompactTreeCtor(CompactTree *tree, uint32_t capacity)
+{
+    assert(tree);
+
+    *tree = {};
+
+    return CompactReserve(tree, (capacity == 0) ? 1 : capacity);
+}
+
+void CompactTreeDtor(CompactTree *tree)
+{
+    if (tree == nullptr) {return;}
+
+    free(tree->types  );
+    free(tree->ops    );
+    free(tree->payload);
+    free(tree->left   );
+    free(tree->values );
+
+    *tree = {};
+}
+
+uint32_t CompactAddNode(CompactTree *tree, Type type, Data data, uint32_t left)
+{
+    assert(tree);
+
+    if (tree->size == tree->capacity && !CompactReserve(tree, 2*tree->capacity + 1))
+    {
+        return NO_CHILD;
+    }
+
+    uint32_t index = tree->size;
+
+    tree->types  [index] = (uint8_t)type;
+    tree->ops    [index] = (type == OP) ? (uint8_t)data.op : 0;
+    tree->payload[index] = data;
+    tree->left   [index] = left;
+
+    tree->size++;
+
+    return index;
+}
+
+bool compactFromNode(CompactTree *tree, const Node *node)
+{
+    assert(tree);
+
+    tree->size = 0;
+    if (node == nullptr) {return true;}
+
+    return CompactAppend(tree, node) != NO_CHILD;
+}
+
+Node *nodeFromCompact(const CompactTree *tree)
+{
+    assert(tree);
+
+    if (tree->size == 0) {return nullptr;}
+
+    Node **built = (Node **)calloc(tree->size, sizeof(Node *));
+    if (built == nullptr)
+    {
+        printf("Error allocating memory for compact tree conversion.\n");
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < tree->size; i++)
+    {
+        Node *node = treeCtor((Type)tree->types[i], tree->payload[i]);
+
+        if (node->type == OP)
+        {
+            node->right         = built[i - 1];
+            node->right->parent = node;
+
+            if (tree->left[i] != NO_CHILD)
+            {
+                node->left         = built[tree->left[i]];
+                node->left->parent = node;
+            }
+
+            nodeRehash(node);
+        }
+
+        built[i] = node;
+    }
+
+    Node *root = built[tree->size - 1];
+    free(built);
+
+    return root;
+}
+
+//-----------------------------------------------------------
+//! Binary form: node count, then the kind, operation, payload
+//! and left child arrays one after another
+//-----------------------------------------------------------
+bool compactWrite(FILE *stream, const CompactTree *tree)
+{
+    assert(stream && tree);
+
+    uint32_t size = tree->size;
+
+    return fwrite(&size,         sizeof(uint32_t), 1,    stream) == 1    &&
+           fwrite(tree->types,   sizeof(uint8_t ), size, stream) == size &&
+           fwrite(tree->ops,     sizeof(uint8_t ), size, stream) == size &&
+           fwrite(tree->payload, sizeof(Data    ), size, stream) == size &&
+           fwrite(tree->left,    sizeof(uint32_t), size, stream) == size;
+}
+
+bool compactRead(FILE *stream, CompactTree *tree)
+{
+    assert(stream && tree);
+
+    uint32_t size = 0;
+    if (fread(&size, sizeof(uint32_t), 1, stream) != 1 || !CompactReserve(tree, size))
+    {
+        return false;
+    }
+
+    tree->size = 0;
+
+    if (fread(tree->types,   sizeof(uint8_t ), size, stream) != size ||
+        fread(tree->ops,     sizeof(uint8_t ), size, stream) != size ||
+        fread(tree->payload, sizeof(Data    ), size, stream) != size ||
+        fread(tree->left,    sizeof(uint32_t), size, stream) != size)
+    {
+        return false;
+    }
+
+    tree->size = size;
+    if (!isCompactValid(tree))
+    {
+        tree->size = 0;
+        return false;
+    }
+
+    return true;
+}
+
+double compactEvaluate(CompactTree *tree, const char *var, double value)
+{
+    assert(tree && var);
+
+    if (tree->size == 0) {return 0;}
+
+    double *values = tree->values;
+
+    for (uint32_t i = 0; i < tree->size; i++)
+    {
+        switch (tree->types[i])
+        {
+        case NUM:
+            values[i] = tree->payload[i].value;
+            break;
+        case VAR:
+            values[i] = CompactVarValue(tree->payload[i].var, var, value);
+            break;
+        case OP:
+            {
+            double left = (tree->left[i] != NO_CHILD) ? values[tree->left[i]] : 0;
+            values[i] = ApplyOperation((Operations)tree->ops[i], left, values[i - 1]);
+            break;
+            }
+        default:
+            values[i] = 0;
+            break;
+        }
+    }
+
+    return values[tree->size - 1];
+}
+
+bool compactEvaluateBatch(const CompactTree *tree, const char *var, const double *points, double *values, size_t count,
+                          MathAccuracy accuracy)
+{
+    assert(tree && var && ((points && values) || count == 0));
+
+    if (tree->size == 0)
+    {
+        for (size_t i = 0; i < count; i++) {values[i] = 0;}
+        return true;
+    }
+
+    //One row of points per node and a row of zeros for operations without a left child
+    double *rows = (double *)calloc(((size_t)tree->size + 1) * COMPACT_BATCH_LEN, sizeof(double));
+    if (rows == nullptr)
+    {
+        printf("Error allocating memory for batch evaluation.\n");
+        return false;
+    }
+
+    const double *zeros = rows + (size_t)tree->size * COMPACT_BATCH_LEN;
+
+    for (size_t start = 0; start < count; start += COMPACT_BATCH_LEN)
+    {
+        size_t size = (count - start < COMPACT_BATCH_LEN) ? count - start : COMPACT_BATCH_LEN;
+
+        for (uint32_t i = 0; i < tree->size; i++)
+        {
+            double *row = rows + (size_t)i * COMPACT_BATCH_LEN;
+
+            switch (tree->types[i])
+            {
+            case NUM:
+                for (size_t j = 0; j < size; j++) {row[j] = tree->payload[i].value;}
+                break;
+            case VAR:
+                if (strncmp(tree->payload[i].var, var, MAX_VAR_NAME_LEN) == 0)
+                {
+                    memcpy(row, points + start, size * sizeof(double));
+                }
+                else
+                {
+                    double value = CompactVarValue(tree->payload[i].var, var, 0);
+                    for (size_t j = 0; j < size; j++) {row[j] = value;}
+                }
+                break;
+            case OP:
+                {
+                const double *left = (tree->left[i] != NO_CHILD) ? rows + (size_t)tree->left[i] * COMPACT_BATCH_LEN : zeros;
+                ApplyOperationBatch((Operations)tree->ops[i], left, row - COMPACT_BATCH_LEN, row, size, accuracy);
+                break;
+                }
+            default:
+                for (size_t j = 0; j < size; j++) {row[j] = 0;}
+                break;
+            }
+        }
+
+        memcpy(values + start, rows + (size_t)(tree->size - 1) * COMPACT_BATCH_LEN, size * sizeof(double));
+    }
+
+    free(rows);
+    return true;
+}
+
+bool compactIsExact(const Node *node, const char *var)
+{
+    if (node == nullptr) {return false;}
+
+    switch (node->type)
+    {
+    case NUM:
+        return true;
+    case VAR:
+        return strncmp(node->data.var, var, MAX_VAR_NAME_LEN) == 0 || strcmp(node->data.var, "e") == 0;
+    case OP:
+        if (node->data.op >= OPEN_BRACKET || node->data.op == DIV) {return false;}
+        return (node->left == nullptr || compactIsExact(node->left, var)) && compactIsExact(node->right, var);
+    default:
+        return false;
+    }
+}
+
+void compactPrint(FILE *stream, const CompactTree *tree)
+{
+    assert(stream && tree);
+
+    if (tree->size == 0) {return;}
+
+    CompactPrintNode(stream, tree, tree->size - 1, false);
+}
+
+void compactOptimize(CompactTree *tree)
+{
+    assert(tree);
+
+    while (CompactOptimizePass(tree)) {}
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool CompactReserve(CompactTree *tree, uint32_t capacity)
+{
+    if (capacity <= tree->capacity) {return true;}
+
+    uint8_t  *types   = (uint8_t  *)realloc(tree->types,   capacity * sizeof(uint8_t ));
+    if (types   != nullptr) {tree->types   = types;  }
+    uint8_t  *ops     = (uint8_t  *)realloc(tree->ops,     capacity * sizeof(uint8_t ));
+    if (ops     != nullptr) {tree->ops     = ops;    }
+    Data     *payload = (Data     *)realloc(tree->payload, capacity * sizeof(Data    ));
+    if (payload != nullptr) {tree->payload = payload;}
+    uint32_t *left    = (uint32_t *)realloc(tree->left,    capacity * sizeof(uint32_t));
+    if (left    != nullptr) {tree->left    = left;   }
+    double   *values  = (double   *)realloc(tree->values,  capacity * sizeof(double  ));
+    if (values  != nullptr) {tree->values  = values; }
+
+    if (!types || !ops || !payload || !left || !values)
+    {
+        printf("Error allocating memory for compact tree.\n");
+        return false;
+    }
+
+    tree->capacity = capacity;
+    return true;
+}
+
+static uint32_t CompactAppend(CompactTree *tree, const Node *node)
+{
+    assert(node->type != OP || node->right != nullptr);
+
+    uint32_t left = NO_CHILD;
+    if (node->left != nullptr)
+    {
+        left = CompactAppend(tree, node->left);
+        if (left == NO_CHILD) {return NO_CHILD;}
+    }
+    if (node->right != nullptr && CompactAppend(tree, node->right) == NO_CHILD)
+    {
+        return NO_CHILD;
+    }
+
+    return CompactAddNode(tree, node->type, node->data, left);
+}
+
+static void CompactPrintNode(FILE *stream, const CompactTree *tree, uint32_t index, bool needBrackets)
+{
+    fprintf(stream, "%c", OPEN_NODE_SYM);
+
+    if (needBrackets)
+    {
+        fprintf(stream, "%s", OPS[OPEN_BRACKET].latex_label);
+    }
+
+    Type       type  = (Type)tree->types[index];
+    Operations op    = (Operations)tree->ops[index];
+    uint32_t   left  = tree->left[index];
+    uint32_t   right = (type == OP) ? index - 1 : NO_CHILD;
+
+    if (type == OP && op == DIV)
+    {
+        fprintf(stream, "%s", OPS[DIV].latex_label);
+        CompactPrintNode(stream, tree, left,  false);
+        CompactPrintNode(stream, tree, right, false);
+    }
+    else
+    {
+        bool  needLeftBrackets = (left  != NO_CHILD && tree->types[left ] == OP && OPS[tree->ops[left ]].priority < OPS[op].priority);
+        bool needRightBrackets = (right != NO_CHILD && tree->types[right] == OP && OPS[tree->ops[right]].priority < OPS[op].priority);
+
+        needLeftBrackets  = needLeftBrackets  || (type == OP && op == MUL && tree->types[left ] == NUM && tree->payload[left ].value < 0);
+        needRightBrackets = needRightBrackets || (type == OP && op == MUL && tree->types[right] == NUM && tree->payload[right].value < 0);
+
+        if (left != NO_CHILD)
+        {
+            CompactPrintNode(stream, tree, left, needLeftBrackets);
+        }
+
+        if (type == NUM)
+        {
+            fprintf(stream, "%lg", tree->payload[index].value);
+        }
+        else if (type == VAR)
+        {
+            fprintf(stream, "%s", tree->payload[index].var);
+        }
+        else
+        {
+            fprintf(stream, "%s", OPS[op].latex_label);
+        }
+
+        if (right != NO_CHILD)
+        {
+            CompactPrintNode(stream, tree, right, needRightBrackets);
+        }
+    }
+
+    if (needBrackets)
+    {
+        fprintf(stream, "%s", OPS[CLOSE_BRACKET].latex_label);
+    }
+
+    fprintf(stream, "%c", CLOSE_NODE_SYM);
+}
+
+//-----------------------------------------------------------
+//! One bottom-up sweep of the simplifier. The result is
+//! written to a new post-order array: every subtree occupies
+//! a contiguous block, so dropping a child is a truncation
+//! and keeping a child is a block move.
+//-----------------------------------------------------------
+static bool CompactOptimizePass(CompactTree *tree)
+{
+    if (tree->size == 0) {return false;}
+
+    CompactTree out = {};
+    uint32_t *start = (uint32_t *)calloc(tree->size, sizeof(uint32_t));
+
+    if (start == nullptr || !CompactTreeCtor(&out, tree->capacity))
+    {
+        free(start);
+        CompactTreeDtor(&out);
+        return false;
+    }
+
+    bool was_changed = false;
+
+    for (uint32_t i = 0; i < tree->size; i++)
+    {
+        Type type = (Type)tree->types[i];
+
+        if (type != OP)
+        {
+            start[i] = out.size;
+            CompactAddNode(&out, type, tree->payload[i], NO_CHILD);
+            continue;
+        }
+
+        Operations op     = (Operations)tree->ops[i];
+        uint32_t   lInput = tree->left[i];
+        uint32_t   rStart = start[i - 1];
+        uint32_t   lStart = (lInput != NO_CHILD) ? start[lInput] : rStart;
+        uint32_t   r      = out.size - 1;
+        uint32_t   l      = (lInput != NO_CHILD) ? rStart - 1 : NO_CHILD;
+
+        start[i] = lStart;
+
+        bool   isBinary   = (l != NO_CHILD);
+        bool   bothNums   = isBinary && out.types[l] == NUM && out.types[r] == NUM;
+        double lValue     = isBinary ? out.payload[l].value : 0;
+        double rValue     = out.payload[r].value;
+        bool   foldResult = false;
+        double result     = 0;
+
+        if (bothNums && (op == ADD || op == SUB || op == MUL || op == POW))
+        {
+            foldResult = true;
+            result     = ApplyOperation(op, lValue, rValue);
+        }
+        else if (bothNums && op == DIV && !isEqualDoubleNumbers(rValue, 0))
+        {
+            result     = lValue / rValue;
+            foldResult = isEqualDoubleNumbers(result, (int)result);
+        }
+        else if ((op == ADD || op == SUB) && isCompactNum(&out, r, 0))
+        {
+            out.size    = rStart;
+            was_changed = true;
+        }
+        else if (op == ADD && isCompactNum(&out, l, 0))
+        {
+            CompactKeepBlock(&out, rStart, lStart);
+            was_changed = true;
+        }
+        else if ((op == MUL || op == DIV) && (isCompactNum(&out, l, 0) || (op == MUL && isCompactNum(&out, r, 0))))
+        {
+            foldResult = true;
+            result     = 0;
+        }
+        else if ((op == MUL || op == DIV || op == POW) && isCompactNum(&out, r, 1))
+        {
+            out.size    = rStart;
+            was_changed = true;
+        }
+        else if (op == MUL && isCompactNum(&out, l, 1))
+        {
+            CompactKeepBlock(&out, rStart, lStart);
+            was_changed = true;
+        }
+        else if (op == POW && (isCompactNum(&out, l, 0) || isCompactNum(&out, l, 1)))
+        {
+            foldResult = true;
+            result     = lValue;
+        }
+        else if (op == POW && isCompactNum(&out, r, 0))
+        {
+            foldResult = true;
+            result     = 1;
+        }
+        else if ((op == SIN || op == TAN || op == ARCTAN) && isCompactNum(&out, r, 0))
+        {
+            foldResult = true;
+            result     = 0;
+        }
+        else if (op == COS && isCompactNum(&out, r, 0))
+        {
+            foldResult = true;
+            result     = 1;
+        }
+        else if (op == LN && (isCompactNum(&out, r, 1) ||
+                             (out.types[r] == VAR && strcmp(out.payload[r].var, "e") == 0)))
+        {
+            foldResult = true;
+            result     = (out.types[r] == VAR) ? 1 : 0;
+        }
+        else if (op == SQRT && out.types[r] == NUM && rValue >= 0 && isEqualDoubleNumbers((int)sqrt(rValue), sqrt(rValue)))
+        {
+            foldResult = true;
+            result     = sqrt(rValue);
+        }
+        else
+        {
+            CompactAddNode(&out, OP, tree->payload[i], l);
+        }
+
+        if (foldResult)
+        {
+            out.size = lStart;
+            CompactAddNode(&out, NUM, {.value = result}, NO_CHILD);
+            was_changed = true;
+        }
+    }
+
+    free(start);
+
+    CompactTreeDtor(tree);
+    *tree = out;
+
+    return was_changed;
+}
+
+//-----------------------------------------------------------
+//! Move block [from, out->size) to position 'to' and make it
+//! the end of the array. Returns the index of the block root.
+//-----------------------------------------------------------
+static uint32_t CompactKeepBlock(CompactTree *out, uint32_t from, uint32_t to)
+{
+    uint32_t count = out->size - from;
+    uint32_t shift = from - to;
+
+    memmove(out->types   + to, out->types   + from, count * sizeof(uint8_t ));
+    memmove(out->ops     + to, out->ops     + from, count * sizeof(uint8_t ));
+    memmove(out->payload + to, out->payload + from, count * sizeof(Data    ));
+    memmove(out->left    + to, out->left    + from, count * sizeof(uint32_t));
+
+    for (uint32_t i = to; i < to + count; i++)
+    {
+        if (out->left[i] != NO_CHILD)
+        {
+            out->left[i] -= shift;
+        }
+    }
+
+    out->size = to + count;
+    return out->size - 1;
+}
+
+static bool isCompactNum(const CompactTree *tree, uint32_t index, double value)
+{
+    return index != NO_CHILD && tree->types[index] == NUM && isEqualDoubleNumbers(tree->payload[index].value, value);
+}
+
+//-----------------------------------------------------------
+//! Checks a tree read from a file before it is used: binary
+//! operations have a left child and unary ones have none,
+//! children come before their parents and every node but the
+//! root is the child of exactly one operation
+//-----------------------------------------------------------
+static bool isCompactValid(const CompactTree *tree)
+{
+    uint8_t *parents = (uint8_t *)calloc(tree->size, sizeof(uint8_t));
+    if (parents == nullptr)
+    {
+        printf("Error allocating memory for compact tree check.\n");
+        return false;
+    }
+
+    bool isCorrect = true;
+
+    for (uint32_t i = 0; i < tree->size && isCorrect; i++)
+    {
+        Type     type = (Type)tree->types[i];
+        uint32_t left = tree->left[i];
+
+        if (type != OP)
+        {
+            isCorrect = (type == NUM || (type == VAR && memchr(tree->payload[i].var, '\0', MAX_VAR_NAME_LEN))) &&
+                        left == NO_CHILD;
+            continue;
+        }
+
+        Operations op       = (Operations)tree->ops[i];
+        bool       isBinary = (op == ADD || op == SUB || op == MUL || op == DIV || op == POW);
+
+        if (i == 0 || op >= OPEN_BRACKET || isBinary != (left != NO_CHILD) || (isBinary && left >= i - 1))
+        {
+            isCorrect = false;
+            continue;
+        }
+
+        if (parents[i - 1] != 0 || (isBinary && parents[left] != 0))
+        {
+            isCorrect = false;
+            continue;
+        }
+
+        parents[i - 1] = 1;
+        if (isBinary) {parents[left] = 1;}
+    }
+
+    for (uint32_t i = 0; i + 1 < tree->size && isCorrect; i++)
+    {
+        isCorrect = (parents[i] == 1);
+    }
+    isCorrect = isCorrect && (tree->size == 0 || parents[tree->size - 1] == 0);
+
+    free(parents);
+
+    return isCorrect;
+}
+
+//-----------------------------------------------------------
+//! var is bound to value and e is the constant, as in
+//! Evaluate. Other variables are 0.
+//-----------------------------------------------------------
+static double CompactVarValue(const char *name, const char *var, double value)
+{
+    if (strncmp(name, var, MAX_VAR_NAME_LEN) == 0) {return value;}
+    if (strcmp(name, "e") == 0)                    {return M_E;  }
+
+    return 0;
+}
+
+static double ApplyOperation(Operations op, double left, double right)
+{
+    switch (op)
+    {
+    case ADD:
+        return left + right;
+    case SUB:
+        return left - right;
+    case MUL:
+        return left * right;
+    case DIV:
+        if (right == 0) {return 0;}
+        return left / right;
+    case SIN:
+        return sin(right);
+    case COS:
+        return cos(right);
+    case TAN:
+        return tan(right);
+    case COT:
+        return 1/tan(right);
+    case ARCSIN:
+        return asin(right);
+    case ARCCOS:
+        return acos(right);
+    case ARCTAN:
+        return atan(right);
+    case ARCCOT:
+        return M_PI_2 - atan(right);
+    case LN:
+        return log(right);
+    case SQRT:
+        return sqrt(right);
+    case POW:
+        return pow(left, right);
+    default:
+        return 0;
+    }
+}
+
+//-----------------------------------------------------------
+//! ApplyOperation for 'count' points, division by zero gives
+//! 0 as there
+//-----------------------------------------------------------
+static void ApplyOperationBatch(Operations op, const double *left, const double *right, double *result, size_t count,
+                                MathAccuracy accuracy)
+{
+    switch (op)
+    {
+    case ADD:
+        for (size_t i = 0; i < count; i++) {result[i] = left[i] + right[i];}
+        break;
+    case SUB:
+        for (size_t i = 0; i < count; i++) {result[i] = left[i] - right[i];}
+        break;
+    case MUL:
+        for (size_t i = 0; i < count; i++) {result[i] = left[i] * right[i];}
+        break;
+    case DIV:
+        for (size_t i = 0; i < count; i++)
+        {
+            double quotient = left[i] / right[i];
+            result[i] = (right[i] == 0) ? 0 : quotient;
+        }
+        break;
+    case SIN:
+        FastSin(right, result, count, accuracy);
+        break;
+    case COS:
+        FastCos(right, result, count, accuracy);
+        break;
+    case TAN:
+        FastTan(right, result, count, accuracy);
+        break;
+    case COT:
+        FastCot(right, result, count, accuracy);
+        break;
+    case ARCSIN:
+        FastArcsin(right, result, count, accuracy);
+        break;
+    case ARCCOS:
+        FastArccos(right, result, count, accuracy);
+        break;
+    case ARCTAN:
+        FastArctan(right, result, count, accuracy);
+        break;
+    case ARCCOT:
+        FastArccot(right, result, count, accuracy);
+        break;
+    case LN:
+        FastLn(right, result, count, accuracy);
+        break;
+    case SQRT:
+        FastSqrt(right, result, count);
+        break;
+    case POW:
+        FastPow(left, right, result, count, accuracy);
+        break;
+    default:
+        for (size_t i = 0; i < count; i++) {result[i] = 0;}
+        break;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,78 @@
+#ifndef COMPACT_TREE_HPP
+#define COMPACT_TREE_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+
+#include "FastMath.hpp"
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const uint32_t NO_CHILD = UINT32_MAX;
+
+//Points evaluated together by compactEvaluateBatch
+static const size_t COMPACT_BATCH_LEN = 64;
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Expression tree stored as a struct of arrays in post-order.
+//!
+//! Every node is an index. Operations always have a right
+//! child and in post-order it is the previous node (index - 1),
+//! so only the left child has to be stored (NO_CHILD for
+//! unary operations and leaves).
+//-----------------------------------------------------------
+struct CompactTree
+{
+    uint8_t  *types   = nullptr;
+    uint8_t  *ops     = nullptr;
+    Data     *payload = nullptr;
+    uint32_t *left    = nullptr;
+
+    double   *values  = nullptr;
+
+    uint32_t size     = 0;
+    uint32_t capacity = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool     CompactTreeCtor (CompactTree *tree, uint32_t capacity = 16);
+void     CompactTreeDtor (CompactTree *tree);
+uint32_t CompactAddNode  (CompactTree *tree, Type type, Data data, uint32_t left);
+
+bool  compactFromNode (CompactTree *tree, const Node *node);
+Node *nodeFromCompact (const CompactTree *tree);
+
+bool compactWrite (FILE *stream, const CompactTree *tree);
+bool compactRead  (FILE *stream, CompactTree *tree);
+
+double compactEvaluate (CompactTree *tree, const char *var, double value);
+
+//-----------------------------------------------------------
+//! values[i] = compactEvaluate(tree, var, points[i]). Every
+//! node is done for COMPACT_BATCH_LEN points at once with the
+//! FastMath kernels. MATH_EXACT gives the same values as
+//! compactEvaluate. Returns false if memory runs out.
+//-----------------------------------------------------------
+bool   compactEvaluateBatch (const CompactTree *tree, const char *var, const double *points, double *values, size_t count,
+                             MathAccuracy accuracy = MATH_EXACT);
+
+//-----------------------------------------------------------
+//! True if the compiled tree gives the values of Evaluate
+//! wherever they are finite. The compact evaluator gives 0
+//! for division by zero and for other variables, Evaluate
+//! gives an error. e is M_E in both.
+//-----------------------------------------------------------
+bool   compactIsExact  (const Node *node, const char *var);
+
+void   compactPrint    (FILE *stream, const CompactTree *tree);
+void   compactOptimize (CompactTree *tree);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //COMPACT_TREE_HPP
@@ -0,0 +1,238 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "DiffCache.hpp"
+#include "Differentiator.hpp"
+#include "Metrics.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static DiffCacheEntry *FindEntry   (DiffCache *cache, const Node *node, const char *var, int max_order);
+static Node           *StoreEntry  (DiffCache *cache, const Node *node, const char *var, int order, Node *derivative);
+static void            EvictOldest (DiffCache *cache);
+static size_t          CountNodes  (const Node *node);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool DiffCacheCtor(DiffCache *cache, size_t max_entries, size_t max_nodes)
+{
+    assert(cache);
+
+    *cache = {};
+
+    if (max_entries == 0) {max_entries = 1;}
+
+    cache->entries = (DiffCacheEntry *)calloc(max_entries, sizeof(DiffCacheEntry));
+    if (cache->entries == nullptr)
+    {
+        printf("Error allocating memory for derivative cache.\n");
+        return false;
+    }
+
+    cache->max_entries = max_entries;
+    cache->max_nodes   = max_nodes;
+
+    return true;
+}
+
+void DiffCacheDtor(DiffCache *cache)
+{
+    if (cache == nullptr) {return;}
+
+    DiffCacheClear(cache);
+    free(cache->entries);
+
+    *cache = {};
+}
+
+void DiffCacheClear(DiffCache *cache)
+{
+    assert(cache);
+
+    while (cache->count > 0)
+    {
+        EvictOldest(cache);
+    }
+
+    treeDtor(cache->scratch);
+    cache->scratch = nullptr;
+}
+
+const Node *DiffCached(DiffCache *cache, Node *node, const char *var, int order)
+{
+    assert(cache && node && var);
+
+    if (order <= 0) {return node;}
+
+    DiffCacheEntry *entry = FindEntry(cache, node, var, order);
+    if (entry != nullptr && entry->order == order)
+    {
+        cache->stats.hits++;
+        return entry->derivative;
+    }
+
+    cache->stats.misses++;
+
+    int   known    = (entry != nullptr) ? entry->order      : 0;
+    Node *current  = (entry != nullptr) ? entry->derivative : node;
+    bool  isClosed = hasClosedDiff(node, var);
+
+    for (int i = known + 1; i <= order; i++)
+    {
+        METRICS_SCOPE_ARG("diff", i);
+        METRICS_ADD(METRICS_DERIVATIVES_COMPUTED, 1);
+
+        //Closed forms are built from the node, so they do not grow with the order
+        Node *next = isClosed ? DiffN(node, var, i) : OptimizeExpression(Diff(current, var));
+        cache->stats.computed++;
+
+        current = StoreEntry(cache, node, var, i, next);
+    }
+
+    return current;
+}
+
+//-----------------------------------------------------------
+//! Derivative of exactly this order if it is cached, nullptr
+//! otherwise. Nothing is computed.
+//-----------------------------------------------------------
+const Node *DiffCacheFind(DiffCache *cache, const Node *node, const char *var, int order)
+{
+    assert(cache && node && var && order > 0);
+
+    DiffCacheEntry *entry = FindEntry(cache, node, var, order);
+    if (entry != nullptr && entry->order == order)
+    {
+        cache->stats.hits++;
+        return entry->derivative;
+    }
+
+    cache->stats.misses++;
+    return nullptr;
+}
+
+//-----------------------------------------------------------
+//! Put an already known derivative into the cache. The cache
+//! takes ownership of the derivative tree, a duplicate of an
+//! existing entry is freed.
+//-----------------------------------------------------------
+void DiffCacheInsert(DiffCache *cache, const Node *node, const char *var, int order, Node *derivative)
+{
+    assert(cache && node && var && derivative && order > 0);
+
+    DiffCacheEntry *entry = FindEntry(cache, node, var, order);
+    if (entry != nullptr && entry->order == order)
+    {
+        treeDtor(derivative);
+        return;
+    }
+
+    StoreEntry(cache, node, var, order, derivative);
+}
+
+void DiffCacheGetStats(const DiffCache *cache, DiffCacheStats *stats)
+{
+    assert(cache && stats);
+
+    *stats = cache->stats;
+}
+
+void DiffCachePrintStats(FILE *stream, const DiffCache *cache)
+{
+    assert(stream && cache);
+
+    const DiffCacheStats *stats = &cache->stats;
+
+    fprintf(stream, "Derivative cache: %zu hits, %zu misses, %zu derivatives computed, %zu evictions, "
+                    "%zu/%zu entries, %zu/%zu nodes\n",
+                    stats->hits, stats->misses, stats->computed, stats->evictions,
+                    stats->entries, cache->max_entries, stats->nodes, cache->max_nodes);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Returns the entry with the highest order not greater than
+//! max_order for this tree and variable. Trees are compared by
+//! structural hash and then by isEqualTrees, so equal copies
+//! share their derivatives and a hash collision is not a hit
+//-----------------------------------------------------------
+static DiffCacheEntry *FindEntry(DiffCache *cache, const Node *node, const char *var, int max_order)
+{
+    DiffCacheEntry *best = nullptr;
+
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        DiffCacheEntry *entry = &cache->entries[(cache->oldest + i) % cache->max_entries];
+
+        if (entry->source_hash == node->hash && entry->order <= max_order &&
+            strncmp(entry->var, var, MAX_VAR_NAME_LEN) == 0    &&
+            (best == nullptr || entry->order > best->order)   &&
+            isEqualTrees(entry->source, node))
+        {
+            best = entry;
+        }
+    }
+
+    return best;
+}
+
+static Node *StoreEntry(DiffCache *cache, const Node *node, const char *var, int order, Node *derivative)
+{
+    size_t nodes = CountNodes(derivative) + CountNodes(node);
+
+    if (nodes > cache->max_nodes)
+    {
+        treeDtor(cache->scratch);
+        cache->scratch = derivative;
+        return derivative;
+    }
+
+    while (cache->count == cache->max_entries || (cache->count > 0 && cache->stats.nodes + nodes > cache->max_nodes))
+    {
+        EvictOldest(cache);
+        cache->stats.evictions++;
+    }
+
+    DiffCacheEntry *entry = &cache->entries[(cache->oldest + cache->count) % cache->max_entries];
+
+    entry->source_hash = node->hash;
+    entry->order       = order;
+    entry->source      = copyNode((Node *)node);
+    entry->derivative  = derivative;
+    entry->nodes       = nodes;
+    memset(entry->var, 0,   MAX_VAR_NAME_LEN);
+    memcpy(entry->var, var, strnlen(var, MAX_VAR_NAME_LEN));
+
+    cache->count++;
+    cache->stats.entries = cache->count;
+    cache->stats.nodes  += nodes;
+
+    return derivative;
+}
+
+static void EvictOldest(DiffCache *cache)
+{
+    DiffCacheEntry *entry = &cache->entries[cache->oldest];
+
+    treeDtor(entry->source);
+    treeDtor(entry->derivative);
+    cache->stats.nodes -= entry->nodes;
+
+    *entry = {};
+
+    cache->oldest = (cache->oldest + 1) % cache->max_entries;
+    cache->count--;
+
+    cache->stats.entries = cache->count;
+}
+
+static size_t CountNodes(const Node *node)
+{
+    if (node == nullptr) {return 0;}
+
+    return 1 + CountNodes(node->left) + CountNodes(node->right);
+}
+
+//----------------------------------------------------------------------------------------------------------------
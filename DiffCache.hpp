@@ -0,0 +1,79 @@
+#ifndef DIFF_CACHE_HPP
+#define DIFF_CACHE_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const size_t DIFF_CACHE_STD_ENTRIES = 64;
+static const size_t DIFF_CACHE_STD_NODES   = 1 << 22;
+
+//----------------------------------------------------------------------------------------------------------------
+
+struct DiffCacheStats
+{
+    size_t hits      = 0;
+    size_t misses    = 0;
+    size_t computed  = 0;
+    size_t evictions = 0;
+    size_t entries   = 0;
+    size_t nodes     = 0;
+};
+
+//-----------------------------------------------------------
+//! source is a copy of the differentiated tree, it confirms
+//! a match of source_hash. nodes counts both trees.
+//-----------------------------------------------------------
+struct DiffCacheEntry
+{
+    unsigned long long source_hash = 0;
+    char               var[MAX_VAR_NAME_LEN] = "";
+    int                order       = 0;
+
+    Node              *source      = nullptr;
+    Node              *derivative  = nullptr;
+    size_t             nodes       = 0;
+};
+
+//-----------------------------------------------------------
+//! Derivatives of one analysis keyed by (structural hash of
+//! the source tree, variable, order). A hash match is checked
+//! with isEqualTrees against the stored source. Entries are
+//! evicted in insertion order when the entry or node limit is
+//! reached. Returned trees belong to the cache and stay valid
+//! until the next call that changes it.
+//-----------------------------------------------------------
+struct DiffCache
+{
+    DiffCacheEntry *entries     = nullptr;
+    size_t          max_entries = 0;
+    size_t          max_nodes   = 0;
+    size_t          count       = 0;
+    size_t          oldest      = 0;
+
+    Node           *scratch     = nullptr;
+
+    DiffCacheStats  stats       = {};
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool DiffCacheCtor (DiffCache *cache, size_t max_entries = DIFF_CACHE_STD_ENTRIES, size_t max_nodes = DIFF_CACHE_STD_NODES);
+void DiffCacheDtor (DiffCache *cache);
+void DiffCacheClear(DiffCache *cache);
+
+const Node *DiffCached      (DiffCache *cache, Node *node, const char *var, int order = 1);
+const Node *DiffCacheFind   (DiffCache *cache, const Node *node, const char *var, int order);
+void        DiffCacheInsert (DiffCache *cache, const Node *node, const char *var, int order, Node *derivative);
+
+void DiffCacheGetStats   (const DiffCache *cache, DiffCacheStats *stats);
+void DiffCachePrintStats (FILE *stream, const DiffCache *cache);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //DIFF_CACHE_HPP
@@ -0,0 +1,839 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "advanced_stack.hpp"
+#include "CompactTree.hpp"
+#include "DiffContext.hpp"
+#include "InputFile.hpp"
+#include "Metrics.hpp"
+#include "MyGeneralFunctions.hpp"
+#include "Syntax_analyzer.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void   AnalyseParsed       (DiffContext *context, const AnalysisRequest *request, FILE *texfile, int job);
+static void   AnalyseParsedJson   (DiffContext *context, const AnalysisRequest *request, int samples, FILE *output);
+static void   JsonNumber          (FILE *output, double value);
+static void   JsonString          (FILE *output, const char *text);
+static void   JsonTree            (FILE *output, const Node *node);
+static void   SamplePolynomial    (void *context, const double *x, double *y, size_t count, MathAccuracy accuracy);
+static Node  *ContextDiff         (DiffContext *context, Node *node, const char *var);
+static bool   LocalDerivatives    (DiffContext *context, const Node *node, const char *var, int count, DiffCache *cache);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool DiffContextCtor(DiffContext *context, const DiffSettings *settings)
+{
+    assert(context);
+
+    DiffSettings default_settings = {};
+    if (settings == nullptr) {settings = &default_settings;}
+
+    *context = {};
+
+    context->isCacheOnDisk   = (settings->cache_dir != nullptr);
+    context->isStats         = settings->print_stats;
+    context->isSpecialPoints = settings->special_points;
+    if (context->isCacheOnDisk)
+    {
+        strncpy(context->cache_dir, settings->cache_dir, MAX_OUTPUT_PATH_LEN - 1);
+    }
+
+    strncpy(context->sink.tex_dir,  settings->tex_dir,  MAX_OUTPUT_PATH_LEN - 1);
+    strncpy(context->sink.dump_dir, settings->dump_dir, MAX_OUTPUT_PATH_LEN - 1);
+    context->sink.graph_dumps = settings->graph_dumps;
+    context->sink.pdf         = settings->pdf;
+
+    context->sink.plot_accuracy = settings->plot_accuracy;
+    context->sink.plot_backend  = settings->plot_backend;
+    context->sample_accuracy    = settings->sample_accuracy;
+
+    pthread_mutex_init(&context->cache_lock,  nullptr);
+    pthread_mutex_init(&context->output_lock, nullptr);
+
+    context->max_functions = (settings->function_entries > 0) ? settings->function_entries : 1;
+    context->functions     = (FunctionCacheEntry *)calloc(context->max_functions, sizeof(FunctionCacheEntry));
+    if (context->functions == nullptr)
+    {
+        printf("Error allocating memory for function cache.\n");
+        return false;
+    }
+
+    if (settings->diff_workers != 1)
+    {
+        context->pool = (DiffPool *)calloc(1, sizeof(DiffPool));
+        if (context->pool == nullptr || !DiffPoolCtor(context->pool, settings->diff_workers))
+        {
+            printf("Error creating differentiation pool, derivatives are computed serially.\n");
+            free(context->pool);
+            context->pool = nullptr;
+        }
+    }
+    context->sink.plot_pool = context->pool;
+
+    return DiffCacheCtor(&context->cache, settings->cache_entries, settings->cache_nodes);
+}
+
+void DiffContextDtor(DiffContext *context)
+{
+    if (context == nullptr) {return;}
+
+    DiffCacheDtor(&context->cache);
+
+    for (size_t i = 0; i < context->functions_count; i++)
+    {
+        FunctionCacheEntry *entry = &context->functions[(context->functions_oldest + i) % context->max_functions];
+
+        free(entry->function);
+        treeDtor(entry->tree);
+    }
+    free(context->functions);
+
+    DiffPoolDtor(context->pool);
+    free(context->pool);
+
+    closePlots(&context->sink);
+
+    pthread_mutex_destroy(&context->cache_lock);
+    pthread_mutex_destroy(&context->output_lock);
+}
+
+Node *DiffContextParse(DiffContext *context, const char *function)
+{
+    assert(context && function);
+
+    METRICS_SCOPE("parse");
+
+    stack_id stk = {};
+    StackCtor(&stk);
+
+    Node *node = GetTokens(function, stk) ? GetStarted(stk) : nullptr;
+
+    StackDtor(&stk);
+
+    return node;
+}
+
+Node *DiffContextSimplify(DiffContext *context, Node *node)
+{
+    assert(context);
+
+    if (node == nullptr) {return nullptr;}
+
+    return OptimizeExpression(node, context->pool);
+}
+
+Node *DiffContextFunction(DiffContext *context, const char *function)
+{
+    assert(context && function);
+
+    unsigned long long key  = ExprCacheKey(function, "");
+    Node              *tree = nullptr;
+
+    pthread_mutex_lock(&context->cache_lock);
+    for (size_t i = 0; i < context->functions_count && tree == nullptr; i++)
+    {
+        FunctionCacheEntry *entry = &context->functions[(context->functions_oldest + i) % context->max_functions];
+
+        if (entry->key == key && strcmp(entry->function, function) == 0) {tree = copyNode(entry->tree);}
+    }
+    pthread_mutex_unlock(&context->cache_lock);
+
+    if (tree != nullptr) {return tree;}
+
+    tree = DiffContextSimplify(context, DiffContextParse(context, function));
+    if (tree == nullptr) {return nullptr;}
+
+    FunctionCacheEntry entry = {key, strdup(function), copyNode(tree)};
+
+    pthread_mutex_lock(&context->cache_lock);
+    if (context->functions_count == context->max_functions)
+    {
+        FunctionCacheEntry *oldest = &context->functions[context->functions_oldest];
+
+        free(oldest->function);
+        treeDtor(oldest->tree);
+        *oldest = {};
+
+        context->functions_oldest = (context->functions_oldest + 1) % context->max_functions;
+        context->functions_count--;
+    }
+    context->functions[(context->functions_oldest + context->functions_count) % context->max_functions] = entry;
+    context->functions_count++;
+    pthread_mutex_unlock(&context->cache_lock);
+
+    return tree;
+}
+
+Node *DiffContextDerivative(DiffContext *context, const Node *node, const char *var, int order)
+{
+    assert(context && node && var);
+
+    if (order <= 0) {return copyNode((Node *)node);}
+
+    Node **derivatives = (Node **)calloc(order, sizeof(Node *));
+    if (derivatives == nullptr) {return nullptr;}
+
+    DiffContextDerivatives(context, node, var, order, derivatives);
+
+    Node *derivative = derivatives[order - 1];
+    for (int i = 0; i < order - 1; i++)
+    {
+        treeDtor(derivatives[i]);
+    }
+    free(derivatives);
+
+    return derivative;
+}
+
+//-----------------------------------------------------------
+//! Copies of the derivatives of orders 1..count. Known orders
+//! are copied from the shared cache, the rest is computed
+//! without the lock and put back. If two threads compute one
+//! derivative, the second copy is dropped by DiffCacheInsert.
+//-----------------------------------------------------------
+void DiffContextDerivatives(DiffContext *context, const Node *node, const char *var, int count, Node **derivatives)
+{
+    assert(context && node && var && derivatives);
+
+    int known = 0;
+
+    pthread_mutex_lock(&context->cache_lock);
+    for (int i = 1; i <= count; i++)
+    {
+        const Node *derivative = DiffCacheFind(&context->cache, node, var, i);
+        if (derivative == nullptr) {break;}
+
+        derivatives[i - 1] = copyNode((Node *)derivative);
+        known = i;
+    }
+    pthread_mutex_unlock(&context->cache_lock);
+
+    Node *current  = (known > 0) ? derivatives[known - 1] : (Node *)node;
+    bool  isClosed = hasClosedDiff((Node *)node, var);
+
+    for (int i = known + 1; i <= count; i++)
+    {
+        METRICS_SCOPE_ARG("diff", i);
+        METRICS_ADD(METRICS_DERIVATIVES_COMPUTED, 1);
+
+        current = isClosed ? DiffN((Node *)node, var, i) :
+                             OptimizeExpression(ContextDiff(context, current, var), context->pool);
+        derivatives[i - 1] = current;
+    }
+
+    if (known == count) {return;}
+
+    Node **copies = (Node **)calloc(count, sizeof(Node *));
+    if (copies == nullptr) {return;}
+
+    for (int i = known; i < count; i++)
+    {
+        copies[i] = copyNode(derivatives[i]);
+    }
+
+    pthread_mutex_lock(&context->cache_lock);
+    for (int i = known; i < count; i++)
+    {
+        DiffCacheInsert(&context->cache, node, var, i + 1, copies[i]);
+    }
+    context->cache.stats.computed += count - known;
+    pthread_mutex_unlock(&context->cache_lock);
+
+    free(copies);
+}
+
+double DiffContextEvaluate(DiffContext *context, const Node *node, const Binding *bindings, int number_of_bindings,
+                           EvalStatus *status)
+{
+    assert(context);
+
+    return Evaluate(node, bindings, number_of_bindings, status);
+}
+
+//-----------------------------------------------------------
+//! The derivatives come from the context cache, the
+//! polynomial is computed with a local cache, so the shared
+//! one is locked only to copy trees in and out.
+//-----------------------------------------------------------
+bool DiffContextTaylor(DiffContext *context, const Node *node, const char *var, double point, int count, Polynomial *taylor)
+{
+    assert(context && node && var && taylor);
+
+    DiffCache cache = {};
+    if (!LocalDerivatives(context, node, var, count, &cache)) {return false;}
+
+    bool isCorrect = Taylor((Node *)node, var, point, count, nullptr, taylor, &cache);
+
+    DiffCacheDtor(&cache);
+
+    return isCorrect;
+}
+
+bool DiffContextTaylorPoints(DiffContext *context, const Node *node, const char *var, const double *points, int number_of_points,
+                             int count, Polynomial *taylors)
+{
+    assert(context && node && var && taylors);
+
+    DiffCache cache = {};
+    if (!LocalDerivatives(context, node, var, count, &cache)) {return false;}
+
+    bool isCorrect = TaylorPoints((Node *)node, var, points, number_of_points, count, nullptr, taylors, &cache, context->pool);
+
+    DiffCacheDtor(&cache);
+
+    return isCorrect;
+}
+
+bool DiffContextSpecialPoints(DiffContext *context, const Node *node, const char *var, double from, double to,
+                              SpecialPoints *points)
+{
+    assert(context && node && var && points);
+
+    DiffCache cache = {};
+    if (!LocalDerivatives(context, node, var, SPECIAL_DIFF_ORDERS, &cache)) {return false;}
+
+    bool isCorrect = FindSpecialPoints((Node *)node, var, from, to, points, &cache, context->pool);
+
+    DiffCacheDtor(&cache);
+
+    return isCorrect;
+}
+
+bool DiffContextIntegrate(DiffContext *context, const Node *node, const char *var, double from, double to,
+                          IntegralResult *result)
+{
+    assert(context && node && var && result);
+
+    return Integrate((Node *)node, var, from, to, result, context->sample_accuracy, context->pool);
+}
+
+void DiffContextAnalyse(DiffContext *context, FILE *input)
+{
+    assert(context);
+
+    InputFile file = {};
+    if (!InputFileCtor(&file, input)) {return;}
+
+    //The report is made in memory, so only the sink is shared with other calls
+    char  *report      = nullptr;
+    size_t report_size = 0;
+    FILE  *texfile     = open_memstream(&report, &report_size);
+    if (texfile == nullptr)
+    {
+        printf("Error allocating memory for the report.\n");
+        InputFileDtor(&file);
+        return;
+    }
+
+    int             job     = 0;
+    AnalysisRequest request = {};
+
+    while (InputFileNext(&file, &request))
+    {
+        AnalyseParsed(context, &request, texfile, ++job);
+    }
+    fclose(texfile);
+
+    if (job > 0)
+    {
+        pthread_mutex_lock(&context->output_lock);
+
+        FILE *reportfile = initLatex(&context->sink);
+        if (reportfile != nullptr)
+        {
+            fwrite(report, sizeof(char), report_size, reportfile);
+            closeLatex(reportfile, &context->sink);
+        }
+
+        pthread_mutex_unlock(&context->output_lock);
+    }
+
+    free(report);
+    InputFileDtor(&file);
+}
+
+void DiffContextAnalyseJson(DiffContext *context, FILE *input, FILE *output, int samples)
+{
+    assert(context && output);
+
+    InputFile file = {};
+    if (!InputFileCtor(&file, input))
+    {
+        fprintf(output, "{\"error\": \"wrong input file\"}\n");
+        return;
+    }
+
+    AnalysisRequest request = {};
+    while (InputFileNext(&file, &request))
+    {
+        AnalyseParsedJson(context, &request, samples, output);
+    }
+
+    InputFileDtor(&file);
+}
+
+void DiffContextGetStats(DiffContext *context, DiffCacheStats *stats)
+{
+    assert(context && stats);
+
+    pthread_mutex_lock(&context->cache_lock);
+    DiffCacheGetStats(&context->cache, stats);
+    pthread_mutex_unlock(&context->cache_lock);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! One section of the report: the job number, the function and
+//! its analysis
+//-----------------------------------------------------------
+static void AnalyseParsed(DiffContext *context, const AnalysisRequest *request, FILE *texfile, int job)
+{
+    METRICS_SCOPE("analysis");
+
+    const char *function = request->function;
+    double      point    = request->point;
+    int         count    = request->count;
+    int         width    = request->width;
+    int         height   = request->height;
+
+    OutputSink *sink = &context->sink;
+
+    CachedAnalysis cached   = {};
+    bool           isCached = context->isCacheOnDisk && ExprCacheLoad(context->cache_dir, function, "x", count, &cached);
+    Node          *node     = nullptr;
+
+    DiffCache cache = {};
+    DiffCacheCtor(&cache);
+
+    fprintf(texfile, "\\section*{Функция %d}\n\n", job);
+
+    if (isCached)
+    {
+        printf("Function is found in the expression cache\n\n");
+
+        node = cached.function;
+        cached.function = nullptr;
+
+        treeLatex(cached.parsed, texfile);
+
+        for (int i = 0; i < cached.count; i++)
+        {
+            DiffCacheInsert(&cache, node, "x", i + 1, cached.derivatives[i]);
+            cached.derivatives[i] = nullptr;
+        }
+    }
+    else
+    {
+        printf("Getting input function...\n\n");
+
+        node = DiffContextParse(context, function);
+        if (node == nullptr)
+        {
+            printf("Analysis stopped: the function has a syntax error.\n\n");
+            fprintf(texfile, "В записи функции синтаксическая ошибка, она пропущена.\n\n");
+            DiffCacheDtor(&cache);
+            return;
+        }
+
+        treeLatex(node, texfile);
+
+        pthread_mutex_lock(&context->output_lock);
+        treeGraphDump(node, sink);
+        pthread_mutex_unlock(&context->output_lock);
+
+        cached.parsed = copyNode(node);
+
+        node = DiffContextSimplify(context, node);
+
+        pthread_mutex_lock(&context->output_lock);
+        treeGraphDump(node, sink);
+        pthread_mutex_unlock(&context->output_lock);
+
+        Node **derivatives = (Node **)calloc(count + 1, sizeof(Node *));
+        if (derivatives != nullptr)
+        {
+            DiffContextDerivatives(context, node, "x", count, derivatives);
+
+            for (int i = 0; i < count; i++)
+            {
+                DiffCacheInsert(&cache, node, "x", i + 1, derivatives[i]);
+            }
+            free(derivatives);
+        }
+    }
+
+    printf("Function is ready for analysys\n\n");
+
+    //The derivatives are in the cache already, under the lock Taylor only evaluates and dumps the polynomial
+    Polynomial taylor = {};
+    pthread_mutex_lock(&context->output_lock);
+    Taylor(node, "x", point, count, texfile, &taylor, &cache, sink);
+    pthread_mutex_unlock(&context->output_lock);
+
+    int         other_points = request->number_of_points - 1;
+    Polynomial *others       = (other_points > 0) ? (Polynomial *)calloc(other_points, sizeof(Polynomial)) : nullptr;
+    if (others != nullptr)
+    {
+        TaylorPoints(node, "x", request->points + 1, other_points, count, texfile, others, &cache, context->pool);
+
+        for (int i = 0; i < other_points; i++)
+        {
+            PolynomialDtor(&others[i]);
+        }
+        free(others);
+    }
+
+    SpecialPoints special = {};
+    if (context->isSpecialPoints && FindSpecialPoints(node, "x", -width, width, &special, &cache, context->pool))
+    {
+        SpecialPointsLatex(texfile, &special, -width, width);
+    }
+    SpecialPointsDtor(&special);
+
+    IntegralResult integral = {};
+    if (request->isIntegral && DiffContextIntegrate(context, node, "x", request->integral[0], request->integral[1], &integral))
+    {
+        IntegralLatex(texfile, &integral, request->integral[0], request->integral[1]);
+    }
+
+    double value = Evaluate(node,                          "x", point);
+    double slope = Evaluate(DiffCached(&cache, node, "x"), "x", point);
+
+    Node *tangent = Add(CreateNum(value), Mul(CreateNum(slope), Sub(CreateVar("x"), CreateNum(point))));
+
+    pthread_mutex_lock(&context->output_lock);
+    FILE *gnuplotfile = OpenGnuPlotFile(width, height, sink);
+    if (gnuplotfile != nullptr)
+    {
+        AddToGnuplotFile(gnuplotfile, node, "", width, "f(x)", sink);
+        AddSamplesToGnuplotFile(gnuplotfile, SamplePolynomial, &taylor, "lt 4", width, "P(x)", sink);
+        AddToGnuplotFile(gnuplotfile, tangent, "", width, "tangent", sink);
+        CreatePlot(gnuplotfile, texfile, sink);
+    }
+    pthread_mutex_unlock(&context->output_lock);
+
+    if (context->isCacheOnDisk && (!isCached || cached.count < count))
+    {
+        //Trees of the cache may be evicted by the next DiffCached, so copies are stored
+        Node **derivatives = (Node **)calloc(count + 1, sizeof(Node *));
+        if (derivatives != nullptr)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                derivatives[i] = copyNode((Node *)DiffCached(&cache, node, "x", i + 1));
+            }
+
+            ExprCacheStore(context->cache_dir, function, "x", cached.parsed, node, derivatives, count);
+
+            for (int i = 0; i < count; i++)
+            {
+                treeDtor(derivatives[i]);
+            }
+            free(derivatives);
+        }
+        else
+        {
+            printf("Error allocating memory for the expression cache.\n");
+        }
+    }
+
+    printf("Analysis finished.\n\n");
+
+    treeDtor(node);
+    PolynomialDtor(&taylor);
+    treeDtor(tangent);
+    CachedAnalysisDtor(&cached);
+    DiffCacheDtor(&cache);
+
+    if (context->isStats)
+    {
+        pthread_mutex_lock(&context->cache_lock);
+        DiffCachePrintStats(stdout, &context->cache);
+        pthread_mutex_unlock(&context->cache_lock);
+
+        SimplifierPrintStats(stdout);
+    }
+}
+
+//-----------------------------------------------------------
+//! Same numbers as the LaTeX report without LaTeX, graph dumps
+//! and plots. Derivatives come from the on-disk cache if it
+//! has enough orders, the rest is taken from the context.
+//-----------------------------------------------------------
+static void AnalyseParsedJson(DiffContext *context, const AnalysisRequest *request, int samples, FILE *output)
+{
+    METRICS_SCOPE("json analysis");
+
+    const char *function = request->function;
+    double      point    = request->point;
+    int         count    = (request->count > 0) ? request->count : 0;
+    int         orders   = (count > 0) ? count : 1;
+
+    CachedAnalysis cached   = {};
+    bool           isCached = context->isCacheOnDisk && ExprCacheLoad(context->cache_dir, function, "x", orders, &cached) &&
+                              cached.count >= orders;
+    if (!isCached)
+    {
+        CachedAnalysisDtor(&cached);
+
+        cached.parsed = DiffContextParse(context, function);
+        if (cached.parsed == nullptr)
+        {
+            fprintf(output, "{\"function\": ");
+            JsonString(output, function);
+            fprintf(output, ", \"error\": \"syntax error\"}\n");
+            return;
+        }
+
+        cached.function    = DiffContextSimplify(context, copyNode(cached.parsed));
+        cached.derivatives = (Node **)calloc(orders, sizeof(Node *));
+        cached.count       = orders;
+        DiffContextDerivatives(context, cached.function, "x", orders, cached.derivatives);
+
+        if (context->isCacheOnDisk)
+        {
+            ExprCacheStore(context->cache_dir, function, "x", cached.parsed, cached.function, cached.derivatives, orders);
+        }
+    }
+
+    Binding binding = {"x", point};
+    double *values  = (double *)calloc(orders + 1, sizeof(double));
+
+    values[0] = Evaluate(cached.function, &binding, 1);
+    for (int i = 1; i <= orders; i++)
+    {
+        values[i] = Evaluate(cached.derivatives[i - 1], &binding, 1);
+    }
+
+    fprintf(output, "{\"function\": ");
+    JsonString(output, function);
+    fprintf(output, ", \"parsed\": ");
+    JsonTree(output, cached.parsed);
+    fprintf(output, ", \"simplified\": ");
+    JsonTree(output, cached.function);
+    fprintf(output, ", \"point\": ");
+    JsonNumber(output, point);
+    fprintf(output, ", \"value\": ");
+    JsonNumber(output, values[0]);
+
+    fprintf(output, ", \"derivatives\": [");
+    for (int i = 1; i <= count; i++)
+    {
+        fprintf(output, "%s{\"order\": %d, \"expression\": ", (i > 1) ? ", " : "", i);
+        JsonTree(output, cached.derivatives[i - 1]);
+        fprintf(output, ", \"value\": ");
+        JsonNumber(output, values[i]);
+        fprintf(output, "}");
+    }
+
+    fprintf(output, "], \"taylor\": {\"center\": ");
+    JsonNumber(output, point);
+    fprintf(output, ", \"coefficients\": [");
+
+    Polynomial taylor = {};
+    PolynomialCtor(&taylor, "x", point, count + 1);
+
+    double inv_factorial = 1;
+    for (int i = 0; i <= count; i++)
+    {
+        if (i > 0) {inv_factorial /= i;}
+
+        fprintf(output, "%s", (i > 0) ? ", " : "");
+        JsonNumber(output, values[i] * inv_factorial);
+        PolynomialAppend(&taylor, i, values[i] * inv_factorial);
+    }
+
+    fprintf(output, "]}, \"tangent\": {\"slope\": ");
+    JsonNumber(output, values[1]);
+    fprintf(output, ", \"intercept\": ");
+    JsonNumber(output, values[0] - values[1] * point);
+    fprintf(output, "}");
+
+    int         number_of_points = request->number_of_points;
+    Polynomial *taylors          = (number_of_points > 1) ? (Polynomial *)calloc(number_of_points, sizeof(Polynomial)) : nullptr;
+    if (taylors != nullptr &&
+        DiffContextTaylorPoints(context, cached.function, "x", request->points, number_of_points, count, taylors))
+    {
+        fprintf(output, ", \"taylor_points\": [");
+        for (int i = 0; i < number_of_points; i++)
+        {
+            fprintf(output, "%s{\"center\": ", (i > 0) ? ", " : "");
+            JsonNumber(output, request->points[i]);
+            fprintf(output, ", \"coefficients\": [");
+            for (int power = 0, term = 0; power <= count; power++)
+            {
+                bool isStored = (term < taylors[i].size && taylors[i].powers[term] == power);
+
+                fprintf(output, "%s", (power > 0) ? ", " : "");
+                JsonNumber(output, isStored ? taylors[i].coefs[term++] : 0);
+            }
+            fprintf(output, "]}");
+        }
+        fprintf(output, "]");
+    }
+    for (int i = 0; taylors != nullptr && i < number_of_points; i++)
+    {
+        PolynomialDtor(&taylors[i]);
+    }
+    free(taylors);
+
+    SpecialPoints special = {};
+    if (context->isSpecialPoints &&
+        DiffContextSpecialPoints(context, cached.function, "x", -request->width, request->width, &special))
+    {
+        fprintf(output, ", \"special_points\": [");
+        for (size_t i = 0; i < special.size; i++)
+        {
+            fprintf(output, "%s{\"kind\": \"%s\", \"x\": ", (i > 0) ? ", " : "", SpecialPointName(special.points[i].kind));
+            JsonNumber(output, special.points[i].x);
+            fprintf(output, ", \"value\": ");
+            JsonNumber(output, special.points[i].value);
+            fprintf(output, "}");
+        }
+        fprintf(output, "]");
+    }
+    SpecialPointsDtor(&special);
+
+    IntegralResult integral = {};
+    if (request->isIntegral &&
+        DiffContextIntegrate(context, cached.function, "x", request->integral[0], request->integral[1], &integral))
+    {
+        fprintf(output, ", \"integral\": {\"from\": ");
+        JsonNumber(output, request->integral[0]);
+        fprintf(output, ", \"to\": ");
+        JsonNumber(output, request->integral[1]);
+        fprintf(output, ", \"value\": ");
+        JsonNumber(output, integral.value);
+        fprintf(output, ", \"error\": ");
+        JsonNumber(output, integral.error);
+        fprintf(output, ", \"intervals\": %zu, \"converged\": %s}", integral.intervals,
+                integral.isConverged ? "true" : "false");
+    }
+
+    double *series = (samples > 1) ? (double *)calloc(3 * (size_t)samples, sizeof(double)) : nullptr;
+    if (series != nullptr)
+    {
+        double *points     = series;
+        double *func_value = series + samples;
+        double *poly_value = series + 2 * samples;
+
+        double step = 2.0 * request->width / (samples - 1);
+        for (int i = 0; i < samples; i++)
+        {
+            points[i] = -request->width + i * step;
+        }
+
+        //Trees the compact evaluator gives other values for are evaluated node by node
+        CompactTree compact    = {};
+        bool        isCompiled = compactIsExact(cached.function, "x") && CompactTreeCtor(&compact) &&
+                                 compactFromNode(&compact, cached.function) &&
+                                 compactEvaluateBatch(&compact, "x", points, func_value, samples, context->sample_accuracy);
+        if (!isCompiled)
+        {
+            for (int i = 0; i < samples; i++) {func_value[i] = Evaluate(cached.function, "x", points[i]);}
+        }
+        SamplePolynomial(&taylor, points, poly_value, samples, context->sample_accuracy);
+
+        CompactTreeDtor(&compact);
+
+        const char *names[] = {"x", "f", "taylor"};
+        for (int row = 0; row < 3; row++)
+        {
+            fprintf(output, "%s\"%s\": [", (row == 0) ? ", \"samples\": {" : ", ", names[row]);
+            for (int i = 0; i < samples; i++)
+            {
+                fprintf(output, "%s", (i > 0) ? ", " : "");
+                JsonNumber(output, series[row * samples + i]);
+            }
+            fprintf(output, "]");
+        }
+        fprintf(output, "}");
+
+        free(series);
+    }
+
+    fprintf(output, "}\n");
+
+    PolynomialDtor(&taylor);
+    free(values);
+    CachedAnalysisDtor(&cached);
+}
+
+//-----------------------------------------------------------
+//! JSON has no NaN and infinities, they are written as null
+//-----------------------------------------------------------
+static void JsonNumber(FILE *output, double value)
+{
+    if (std::isfinite(value)) {fprintf(output, "%.17g", value);}
+    else                      {fprintf(output, "null");}
+}
+
+static void JsonString(FILE *output, const char *text)
+{
+    fputc('"', output);
+
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        if      (*c == '"' || *c == '\\')  {fprintf(output, "\\%c", *c);}
+        else if ((unsigned char)*c < 0x20) {fprintf(output, "\\u%04x", *c);}
+        else                               {fputc(*c, output);}
+    }
+
+    fputc('"', output);
+}
+
+//-----------------------------------------------------------
+//! Infix text of a tree has no characters to escape
+//-----------------------------------------------------------
+static void JsonTree(FILE *output, const Node *node)
+{
+    fputc('"', output);
+    treePrintInfix(output, node);
+    fputc('"', output);
+}
+
+//-----------------------------------------------------------
+//! Polynomials are only multiplied and added, so the values
+//! are the same for all tiers
+//-----------------------------------------------------------
+static void SamplePolynomial(void *context, const double *x, double *y, size_t count, MathAccuracy)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        y[i] = PolynomialEvaluate((const Polynomial *)context, x[i]);
+    }
+}
+
+static Node *ContextDiff(DiffContext *context, Node *node, const char *var)
+{
+    return (context->pool != nullptr) ? ParallelDiff(context->pool, node, var) : Diff(node, var);
+}
+
+//-----------------------------------------------------------
+//! Local cache with copies of the derivatives of orders
+//! 1..count from the context
+//-----------------------------------------------------------
+static bool LocalDerivatives(DiffContext *context, const Node *node, const char *var, int count, DiffCache *cache)
+{
+    if (!DiffCacheCtor(cache)) {return false;}
+
+    Node **derivatives = (Node **)calloc(count + 1, sizeof(Node *));
+    if (derivatives != nullptr)
+    {
+        DiffContextDerivatives(context, node, var, count, derivatives);
+
+        for (int i = 0; i < count; i++)
+        {
+            DiffCacheInsert(cache, node, var, i + 1, derivatives[i]);
+        }
+        free(derivatives);
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,174 @@
+#ifndef DIFF_CONTEXT_HPP
+#define DIFF_CONTEXT_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <pthread.h>
+
+#include "DiffCache.hpp"
+#include "Differentiator.hpp"
+#include "ExprCache.hpp"
+#include "FastMath.hpp"
+#include "Integral.hpp"
+#include "ParallelDiff.hpp"
+#include "Polynomial.hpp"
+#include "SpecialPoints.hpp"
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const size_t FUNCTION_CACHE_STD_ENTRIES = 64;
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Settings of a context. Strings are copied by the Ctor.
+//! cache_dir == nullptr turns the on-disk cache off.
+//! diff_workers != 1 differentiates large trees in parallel
+//! (0 means one worker per processor). Plots and JSON samples
+//! are computed with plot_accuracy and sample_accuracy.
+//! special_points adds roots, extrema and inflection points on
+//! the plot range to the analysis. plot_backend chooses who
+//! draws the plots (see PlotBackend), the built-in renderer
+//! uses the differentiation pool.
+//-----------------------------------------------------------
+struct DiffSettings
+{
+    const char *cache_dir        = EXPR_CACHE_DIR;
+    const char *tex_dir          = "./TexFiles";
+    const char *dump_dir         = "./DumpFiles";
+
+    size_t      cache_entries    = DIFF_CACHE_STD_ENTRIES;
+    size_t      cache_nodes      = DIFF_CACHE_STD_NODES;
+    size_t      function_entries = FUNCTION_CACHE_STD_ENTRIES;
+    int         diff_workers     = 1;
+
+    MathAccuracy plot_accuracy   = MATH_EXACT;
+    MathAccuracy sample_accuracy = MATH_EXACT;
+    PlotBackend  plot_backend    = PLOT_GNUPLOT;
+
+    bool        graph_dumps      = true;
+    bool        pdf              = true;
+    bool        print_stats      = true;
+    bool        special_points   = true;
+};
+
+//-----------------------------------------------------------
+//! Simplified tree of a function text. Entries are evicted in
+//! insertion order.
+//-----------------------------------------------------------
+struct FunctionCacheEntry
+{
+    unsigned long long key      = 0;
+    char              *function = nullptr;
+    Node              *tree     = nullptr;
+};
+
+//-----------------------------------------------------------
+//! State of the library: derivative cache, output sink and
+//! settings. All DiffContext* calls may be made from many
+//! threads on one context. Trees passed in are only read,
+//! trees returned belong to the caller (free with treeDtor).
+//-----------------------------------------------------------
+struct DiffContext
+{
+    char            cache_dir[MAX_OUTPUT_PATH_LEN] = "";
+    bool            isCacheOnDisk   = false;
+    bool            isStats         = false;
+    bool            isSpecialPoints = false;
+
+    MathAccuracy    sample_accuracy = MATH_EXACT;
+
+    OutputSink      sink  = {};
+    DiffCache       cache = {};
+
+    FunctionCacheEntry *functions        = nullptr;
+    size_t              max_functions    = 0;
+    size_t              functions_count  = 0;
+    size_t              functions_oldest = 0;
+
+    DiffPool           *pool = nullptr;
+
+    pthread_mutex_t cache_lock  = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool DiffContextCtor (DiffContext *context, const DiffSettings *settings = nullptr);
+void DiffContextDtor (DiffContext *context);
+
+//-----------------------------------------------------------
+//! Returns nullptr if the function has a syntax error
+//-----------------------------------------------------------
+Node  *DiffContextParse      (DiffContext *context, const char *function);
+
+//-----------------------------------------------------------
+//! Takes the tree and returns the simplified one
+//-----------------------------------------------------------
+Node  *DiffContextSimplify   (DiffContext *context, Node *node);
+
+//-----------------------------------------------------------
+//! Parsed and simplified function. Repeated texts are served
+//! from the function cache. Returns nullptr if the function
+//! has a syntax error.
+//-----------------------------------------------------------
+Node  *DiffContextFunction   (DiffContext *context, const char *function);
+
+Node  *DiffContextDerivative (DiffContext *context, const Node *node, const char *var, int order = 1);
+
+//-----------------------------------------------------------
+//! derivatives[i] is the derivative of order i + 1
+//-----------------------------------------------------------
+void   DiffContextDerivatives(DiffContext *context, const Node *node, const char *var, int count, Node **derivatives);
+double DiffContextEvaluate   (DiffContext *context, const Node *node, const Binding *bindings, int number_of_bindings,
+                              EvalStatus *status = nullptr);
+bool   DiffContextTaylor     (DiffContext *context, const Node *node, const char *var, double point, int count,
+                              Polynomial *taylor);
+
+//-----------------------------------------------------------
+//! taylors[i] is the expansion at points[i]. Derivatives are
+//! taken once for all points (see TaylorPoints).
+//-----------------------------------------------------------
+bool   DiffContextTaylorPoints(DiffContext *context, const Node *node, const char *var, const double *points,
+                               int number_of_points, int count, Polynomial *taylors);
+bool   DiffContextSpecialPoints(DiffContext *context, const Node *node, const char *var, double from, double to,
+                                SpecialPoints *points);
+
+//-----------------------------------------------------------
+//! Integral over [from, to] with the sample accuracy and the
+//! pool of the context (see Integrate)
+//-----------------------------------------------------------
+bool   DiffContextIntegrate  (DiffContext *context, const Node *node, const char *var, double from, double to,
+                              IntegralResult *result);
+
+//-----------------------------------------------------------
+//! Full analysis of every job of the input file (see funcfile
+//! and InputFile) into the LaTeX report of the context, one
+//! section per job in one document. Each job is analysed as
+//! soon as it is read. Calls on one context run in parallel,
+//! only the graph dumps, the plots and the report file take
+//! the sink in turn.
+//-----------------------------------------------------------
+void   DiffContextAnalyse    (DiffContext *context, FILE *input);
+
+//-----------------------------------------------------------
+//! The same analysis as one JSON object per job: parsed and
+//! simplified function, derivatives, Taylor coefficients,
+//! tangent and, if samples > 1, values of f and of the Taylor
+//! polynomial at 'samples' points of [-width, width]. With a
+//! list of points the Taylor coefficients at all of them are
+//! added, with special_points the points found on [-width,
+//! width], with integral bounds the integral. No LaTeX, graph
+//! dumps or plots are made. The output is JSON Lines: every
+//! object, including the error of a job, is on a line of its
+//! own.
+//-----------------------------------------------------------
+void   DiffContextAnalyseJson(DiffContext *context, FILE *input, FILE *output, int samples = 0);
+
+void   DiffContextGetStats   (DiffContext *context, DiffCacheStats *stats);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //DIFF_CONTEXT_HPP
@@ -1,12 +1,15 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <ctime>
 
-#include "advanced_stack.hpp"
+#include "CompactTree.hpp"
+#include "DiffContext.hpp"
 #include "Differentiator.hpp"
+#include "InputFile.hpp"
 #include "logs.hpp"
+#include "Metrics.hpp"
 #include "MyGeneralFunctions.hpp"
-#include "Syntax_analyzer.hpp"
 
 //----------------------------------------------------------------------------------------------------------------
 
@@ -16,18 +19,26 @@
 
 static Node *CalculateNumbers(Node *node, bool *was_changed);
 
+static Node *CalculateNode(Node *node, bool *was_changed);
+
 static Node *CalculateBinaryOperations(Node *node, bool *was_changed);
 
 static Node *CalculateDivision(Node *node, bool *was_changed);
 
 static Node *DeleteUselessNodes(Node *node, bool *was_changed);
 
+static Node *DeleteUselessNode(Node *node, bool *was_changed);
+
 static Node *DeleteSumSubUslessNode(Node *node, bool *was_changed);
 
 static Node *DeleteMulDivUslessNode(Node *node, bool *was_changed);
 
 static Node *DeleteFuncUslessNode(Node *node, bool *was_changed);
 
+static Node *CollectTerms(Node *node, bool *was_changed);
+
+static Node *CollectChain(Node *node, bool *was_changed, PoolWorker *worker);
+
 static Node *SetChildNodeToThis(Node *node, bool isLeftChild);
 
 static Node *SetLeftNodeToThis(Node *node);
@@ -36,17 +47,204 @@ static Node *SetRightNodeToThis(Node *node);
 
 static bool  isConstant(Node *node, const char *var);
 
+static bool  ClosedDiff    (Node *node, const char *var, int n, Node **derivative);
+static Node *PowerDiff     (Node *base, double power, double slope, int n);
+static Node *IteratedDiff  (Node *node, const char *var, int n);
+static bool  LinearSlope   (Node *node, const char *var, double *slope);
+static bool  ConstantValue (const Node *node, double *value);
+
 static void  Set_o_add(char *o_add, double point, int power);
 
+static double EvaluateNode(const Node *node, const Binding *bindings, int number_of_bindings, EvalStatus *status);
+
+static double SetEvalError(EvalStatus *status, EvalStatus error);
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Operand of a flattened sum or product. For a sum 'node' is
+//! the term without its numeric coefficient 'coef'. For a
+//! product 'node' is the base and 'coef' is its numeric power.
+//-----------------------------------------------------------
+struct Term
+{
+    Node   *node = nullptr;
+    double  coef = 0;
+};
+
+struct TermList
+{
+    Term   *terms          = nullptr;
+    size_t  size           = 0;
+    size_t  capacity       = 0;
+
+    Node  **trash          = nullptr;
+    size_t  trash_size     = 0;
+    size_t  trash_capacity = 0;
+
+    double  constant       = 0;
+};
+
+static bool  isChainNode     (const Node *node, bool isSum);
+static void  FlattenChain    (Node *node, bool isSum, double sign, TermList *list);
+static void  DecomposeTerm   (Term *term, bool isSum, TermList *list);
+static Node *RebuildSum      (TermList *list);
+static Node *RebuildProduct  (TermList *list);
+static void  MergeEqualTerms (TermList *list);
+static int   CompareTerms    (const void *first, const void *second);
+static int   TermRank        (const Node *node);
+static void  PushTerm        (TermList *list, Node *node, double coef);
+static void  PushTrash       (TermList *list, Node *node);
+static void  TermListDtor    (TermList *list);
+
+static unsigned long long ChainSignature(const Node *node, bool isSum);
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Live nodes and time before one rule application
+//-----------------------------------------------------------
+struct RuleProbe
+{
+    long long live  = 0;
+    double start = 0;
+};
+
+static const char *RULE_NAMES[NUMBER_OF_SIMPLIFIER_RULES] =
+{
+    "CalculateBinaryOperations",
+    "CalculateDivision",
+    "DeleteSumSubUslessNode",
+    "DeleteMulDivUslessNode",
+    "DeleteFuncUslessNode",
+    "CollectTerms",
+};
+
+static thread_local SimplifierStats Stats = {};
+
+static void   RuleBegin (RuleProbe *probe);
+static void   RuleEnd   (SimplifierRule rule, const RuleProbe *probe, bool wasFired);
+static double NowNs     ();
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Operands of a chain simplified by one task of a parallel pass
+static const size_t TERMS_PER_TASK = 32;
+
+enum SimplifierPass
+{
+    PASS_CALCULATE,
+    PASS_DELETE,
+    PASS_COLLECT,
+    PASS_COLLECT_TERMS
+};
+
+//-----------------------------------------------------------
+//! One subtree (or terms [index, end) of a chain) in a pass of
+//! the parallel simplifier. Rule stats and nodes of a task are
+//! moved to the thread that joins it, so the stats are the
+//! same as with the serial simplifier.
+//-----------------------------------------------------------
+struct SimplifyTask
+{
+    SimplifierPass  pass        = PASS_CALCULATE;
+    const size_t   *sizes       = nullptr;
+    Node           *node        = nullptr;
+    Term           *terms       = nullptr;
+    size_t          index       = 0;
+    size_t          end         = 0;
+    bool            was_changed = false;
+    bool            isTimed     = false;
+
+    SimplifierRuleStats rules[NUMBER_OF_SIMPLIFIER_RULES] = {};
+    long long           nodes = 0;
+};
+
+struct SimplifyLoop
+{
+    Node      *node       = nullptr;
+    long long  iterations = 0;
+};
+
+static void  RunSimplifyLoop   (PoolWorker *worker, void *loop);
+static Node *SimplifierRunPass (PoolWorker *worker, SimplifierPass pass, Node *node, bool *was_changed);
+static void  SimplifySubtree   (PoolWorker *worker, SimplifyTask *task);
+static void  SimplifyOperands  (PoolWorker *worker, SimplifyTask *task, bool *wasLeftChanged, bool *wasRightChanged);
+static void  SimplifyTerms     (PoolWorker *worker, SimplifyTask *task);
+static bool  CollectOperands   (PoolWorker *worker, Term *terms, size_t size);
+static void  SpawnSimplify     (PoolWorker *worker, SimplifyTask *task, PoolTask *pool_task);
+static void  JoinSimplify      (PoolWorker *worker, SimplifyTask *task, PoolTask *pool_task);
+static void  RunSimplifyTask   (PoolWorker *worker, void *task);
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Points evaluated by one task of a parallel TaylorPoints
+static const size_t POINTS_PER_TASK = 4 * COMPACT_BATCH_LEN;
+
+//-----------------------------------------------------------
+//! Values of f and of its derivatives at the points.
+//! values[i*number_of_points + j] is the derivative of order i
+//! at points[j]. Trees without a compiled copy are evaluated
+//! with Evaluate.
+//-----------------------------------------------------------
+struct PointsTask
+{
+    const char         *var              = nullptr;
+    const Node        **trees            = nullptr;
+    const CompactTree  *compiled         = nullptr;
+    const bool         *isCompiled       = nullptr;
+    int                 orders           = 0;
+
+    const double       *points           = nullptr;
+    size_t              number_of_points = 0;
+    double             *values           = nullptr;
+};
+
+static void EvaluatePoints (void *task, size_t start, size_t end);
+
 //----------------------------------------------------------------------------------------------------------------
 
+Node *Diff(Node *node, const char *var)
+{
+    assert(node && var);
+
+    bool needLeft  = false;
+    bool needRight = false;
+    DiffOperands(node, var, &needLeft, &needRight);
+
+    Node *left_derivative  = needLeft  ? Diff(node->left,  var) : nullptr;
+    Node *right_derivative = needRight ? Diff(node->right, var) : nullptr;
+
+    return DiffNode(node, var, left_derivative, right_derivative);
+}
+
+void DiffOperands(Node *node, const char *var, bool *needLeft, bool *needRight)
+{
+    assert(node && var && needLeft && needRight);
+
+    *needLeft  = false;
+    *needRight = false;
+
+    if (node->type != OP) {return;}
+
+    if (node->data.op == POW)
+    {
+        *needLeft  = !isConstant(node->left,  var);
+        *needRight = !isConstant(node->right, var);
+        return;
+    }
+
+    *needLeft  = (node->left != nullptr);
+    *needRight = true;
+}
+
 #define cThis   copyNode(node)
 #define cL      copyNode(node->left)
-#define dL      Diff(node->left, var)
+#define dL      left_derivative
 #define cR      copyNode(node->right)
-#define dR      Diff(node->right, var)
+#define dR      right_derivative
 
-Node *Diff(Node *node, const char *var)
+Node *DiffNode(Node *node, const char *var, Node *left_derivative, Node *right_derivative)
 {
     assert(node && var);
 
@@ -95,8 +293,9 @@ Node *Diff(Node *node, const char *var)
         case SQRT:
             return Mul(Div(CreateNum(1), Mul(CreateNum(2), Sqrt(cR))), dR);
         case POW:
-            bool isLeftConstant  = isConstant(node->left , var);
-            bool isRightConstant = isConstant(node->right, var);
+            //A constant operand has no derivative (see DiffOperands)
+            bool isLeftConstant  = (dL == nullptr);
+            bool isRightConstant = (dR == nullptr);
             if (isLeftConstant && isRightConstant)
             {
                 return CreateNum(0);
@@ -111,15 +310,15 @@ Node *Diff(Node *node, const char *var)
             }
             else
             {
-                Node *power = Mul(cR, Ln(cL));
-                Node *ans = Mul(cThis, Diff(power, var)); 
-                treeDtor(power);
-                return ans;    
+                return Mul(cThis, Add(Mul(dR, Ln(cL)), Mul(cR, Mul(Div(CreateNum(1), cL), dL))));
             }
                        
         }
     }
 
+    treeDtor(left_derivative);
+    treeDtor(right_derivative);
+
     return nullptr;
 }
 
@@ -129,6 +328,25 @@ Node *Diff(Node *node, const char *var)
 #undef cR
 #undef dR
 
+Node *DiffN(Node *node, const char *var, int n)
+{
+    assert(node && var);
+
+    if (n <= 0) {return copyNode(node);}
+
+    Node *derivative = nullptr;
+    ClosedDiff(node, var, n, &derivative);
+
+    return OptimizeExpression(derivative);
+}
+
+bool hasClosedDiff(Node *node, const char *var)
+{
+    assert(node && var);
+
+    return ClosedDiff(node, var, 1, nullptr);
+}
+
 Node *FuncValue(Node *node, const char *var, double value)
 {
     if (node->type == VAR && strcmp(var, node->data.var) == 0)
@@ -146,39 +364,156 @@ Node *FuncValue(Node *node, const char *var, double value)
         FuncValue(node->right, var, value);
     }
 
+    nodeRehash(node);
+
     return node;
 }
 
-Node *OptimizeExpression(Node *node)
+double Evaluate(const Node *node, const Binding *bindings, int number_of_bindings, EvalStatus *status)
 {
-    bool was_changed_by_calculating = true;
-    bool was_changed_by_deleting    = true;
+    EvalStatus tmp_status = EVAL_OK;
+    if (status == nullptr)
+    {
+        status = &tmp_status;
+    }
+    *status = EVAL_OK;
+
+    if (node == nullptr)
+    {
+        return SetEvalError(status, EVAL_WRONG_TREE);
+    }
+
+    return EvaluateNode(node, bindings, number_of_bindings, status);
+}
+
+double Evaluate(const Node *node, const char *var, double value, EvalStatus *status)
+{
+    Binding binding = {var, value};
+
+    return Evaluate(node, &binding, 1, status);
+}
+
+const char *EvalStatusMsg(EvalStatus status)
+{
+    switch (status)
+    {
+    case EVAL_OK:
+        return "ok";
+    case EVAL_DIVISION_BY_ZERO:
+        return "division by zero";
+    case EVAL_DOMAIN_ERROR:
+        return "argument is out of the function domain";
+    case EVAL_UNBOUND_VARIABLE:
+        return "variable has no value";
+    case EVAL_WRONG_TREE:
+        return "expression tree is wrong";
+    default:
+        return "unknown error";
+    }
+}
+
+Node *OptimizeExpression(Node *node, DiffPool *pool)
+{
+    METRICS_SCOPE("simplify");
+
+    SimplifyLoop loop = {};
+    loop.node = node;
 
-    while (was_changed_by_calculating || was_changed_by_deleting)
+    if (pool == nullptr || !PoolRun(pool, RunSimplifyLoop, &loop))
     {
-        node =   CalculateNumbers(node, &was_changed_by_calculating);
-        node = DeleteUselessNodes(node, &was_changed_by_deleting   );
+        RunSimplifyLoop(nullptr, &loop);
     }
+
+    Stats.calls++;
+    Stats.iterations += loop.iterations;
+    if (loop.iterations > Stats.max_iterations) {Stats.max_iterations = loop.iterations;}
     
-    return node;
+    return loop.node;
+}
+
+void SimplifierStatsReset()
+{
+    bool isTimed = Stats.isTimed;
+
+    Stats = SimplifierStats();
+    Stats.isTimed = isTimed;
 }
 
-Node *Taylor(Node *node, const char *var, double point, int count, FILE *texfile)
+void SimplifierStatsTiming(bool isTimed)
+{
+    Stats.isTimed = isTimed;
+}
+
+void SimplifierGetStats(SimplifierStats *stats)
+{
+    assert(stats);
+
+    *stats = Stats;
+}
+
+void SimplifierPrintStats(FILE *stream)
+{
+    assert(stream);
+
+    fprintf(stream, "Simplifier: %lld calls, %lld iterations (%.2lf per call, max %lld)\n",
+            Stats.calls, Stats.iterations, (Stats.calls > 0) ? (double)Stats.iterations / Stats.calls : 0.0,
+            Stats.max_iterations);
+
+    fprintf(stream, "%-26s %12s %12s %8s %14s %12s\n", "rule", "calls", "fires", "fires%", "nodes removed", "time, ms");
+
+    for (int i = 0; i < NUMBER_OF_SIMPLIFIER_RULES; i++)
+    {
+        const SimplifierRuleStats *rule = &Stats.rules[i];
+
+        fprintf(stream, "%-26s %12lld %12lld %7.1lf%% %14lld ", RULE_NAMES[i], rule->calls, rule->fires,
+                (rule->calls > 0) ? 100.0 * rule->fires / rule->calls : 0.0, rule->nodes_removed);
+
+        if (Stats.isTimed) {fprintf(stream, "%12.3lf\n", rule->time_ns / 1e6);}
+        else               {fprintf(stream, "%12s\n", "-");}
+    }
+    fprintf(stream, "\n");
+}
+
+//-----------------------------------------------------------
+//! With texfile == nullptr only the polynomial is computed,
+//! nothing is written to the report.
+//-----------------------------------------------------------
+bool Taylor(Node *node, const char *var, double point, int count, FILE *texfile, Polynomial *taylor, DiffCache *cache,
+            OutputSink *sink)
 {   
-    fprintf(texfile, "Разложение функции f(%s) по Тейлору в точке '%lg' до %d-й степени.\n\n"
-                     "Обозначим i-й моном многочлена Тейлора за $P_i$.\n\n", var, point, count);
+    if (texfile != nullptr)
+    {
+        fprintf(texfile, "Разложение функции f(%s) по Тейлору в точке '%lg' до %d-й степени.\n\n"
+                         "Обозначим i-й моном многочлена Тейлора за $P_i$.\n\n", var, point, count);
+    }
+
+    METRICS_SCOPE("taylor");
+
+    if (!PolynomialCtor(taylor, var, point, count + 1)) {return false;}
+
+    DiffCache local_cache = {};
+    if (cache == nullptr)
+    {
+        DiffCacheCtor(&local_cache);
+        cache = &local_cache;
+    }
 
-    Node *Derivative = copyNode(node);
-    Derivative = OptimizeExpression(Derivative);
+    Binding    binding = {var, point};
+    EvalStatus status  = EVAL_OK;
 
-    Node *Taylor = FuncValue(copyNode(Derivative), var, point);
-    Taylor = OptimizeExpression(Taylor);
+    PolynomialAppend(taylor, 0, Evaluate(node, &binding, 1, &status));
+    if (status != EVAL_OK)
+    {
+        printf("Calculate error: f(%lg): %s.\n", point, EvalStatusMsg(status));
+    }
 
-    char o_add[50] = "";
+    char   o_add[50]     = "";
+    double inv_factorial = 1;
 
     for (int i = 1; i <= count; i++)
     {
-        treeGraphDump(Taylor);
+        METRICS_SCOPE_ARG("taylor order", i);
+
         const int max_func_name = 50;
         char der_name[max_func_name] = "";
         char monomial[max_func_name] = "";
@@ -186,132 +521,245 @@ Node *Taylor(Node *node, const char *var, double point, int count, FILE *texfile
         sprintf(der_name, "f^{(%d)}(%s) = ", i, var);
         sprintf(monomial, "P_{%d}(%s) = ", i, var);
 
-        Node *tmp_derivative = Diff(Derivative, var);
-        tmp_derivative = OptimizeExpression(tmp_derivative);
-        treeLatex(tmp_derivative, texfile, der_name, true);
+        const Node *derivative = DiffCached(cache, node, var, i);
+        if (texfile != nullptr) {treeLatex(derivative, texfile, der_name, true);}
         
-        Node *TaylorNext = Mul(Div(FuncValue(copyNode(tmp_derivative), var, point), CreateNum(factorial(i))), Pow(Sub(CreateVar(var), CreateNum(point)), CreateNum(i)));        
-        TaylorNext = OptimizeExpression(TaylorNext);
-        treeLatex(TaylorNext, texfile, monomial, true);
+        double coefficient = Evaluate(derivative, &binding, 1, &status);
+        if (status != EVAL_OK)
+        {
+            printf("Calculate error: f^(%d)(%lg): %s.\n", i, point, EvalStatusMsg(status));
+        }
+
+        inv_factorial /= i;
+        coefficient   *= inv_factorial;
+
+        PolynomialAppend(taylor, i, coefficient);
+
+        if (texfile != nullptr)
+        {
+            Node *TaylorNext = PolynomialTermNode(taylor, i, coefficient);
+            treeLatex(TaylorNext, texfile, monomial, true);
+            treeDtor(TaylorNext);
+        }
+    }
 
-        Taylor = Add(Taylor, TaylorNext);
-        Taylor = OptimizeExpression(Taylor);
+    if (texfile != nullptr)
+    {
+        Node *polynomial = nodeFromPolynomial(taylor);
+        treeGraphDump(polynomial, sink);
 
-        nodeDtor(Derivative);
-        Derivative = tmp_derivative;
+        Set_o_add(o_add, point, count);
+        treeLatex(polynomial, texfile, "f(x) = ", true, o_add);
+        treeDtor(polynomial);
     }
 
-    Set_o_add(o_add, point, count);
-    treeLatex(Taylor, texfile, "f(x) = ", true, o_add);
+    if (cache == &local_cache)
+    {
+        DiffCacheDtor(&local_cache);
+    }
 
-    return Taylor;
+    return true;
 }
 
-bool GetFuncForAnalyze(char *data, char *function, double *point, int *count, int *width, int *height)
+//-----------------------------------------------------------
+//! Only trees with compactIsExact are compiled, so finite
+//! values are the ones of Evaluate.
+//! Non-finite ones are evaluated again to report the error,
+//! so the polynomials and messages are the ones of Taylor.
+//-----------------------------------------------------------
+bool TaylorPoints(Node *node, const char *var, const double *points, int number_of_points, int count, FILE *texfile,
+                  Polynomial *taylors, DiffCache *cache, DiffPool *pool)
 {
-    int position = 0;
-    int second_position = 0;
+    assert(node && var && (points || number_of_points <= 0) && taylors);
+
+    if (number_of_points <= 0) {return true;}
+    if (count < 0)             {count = 0;}
 
-    int errflag = sscanf(data, "func: %[^\n]\n %n", function, &position);
-    if (!errflag)
+    METRICS_SCOPE_ARG("taylor points", number_of_points);
+
+    DiffCache local_cache = {};
+    if (cache == nullptr)
     {
-        printf("Error in input file. Func is not found.\n");
-        return false;
+        if (!DiffCacheCtor(&local_cache)) {return false;}
+        cache = &local_cache;
     }
 
-    errflag = sscanf(data + position, "point: %lg %n", point, &second_position);
-    if (!errflag)
+    int    orders = count + 1;
+    size_t size   = (size_t)number_of_points;
+
+    const Node  **trees      = (const Node  **)calloc(orders, sizeof(Node *));
+    CompactTree  *compiled   = (CompactTree  *)calloc(orders, sizeof(CompactTree));
+    bool         *isCompiled = (bool         *)calloc(orders, sizeof(bool));
+    double       *values     = (double       *)calloc(orders * size, sizeof(double));
+
+    bool isCorrect = (trees != nullptr && compiled != nullptr && isCompiled != nullptr && values != nullptr);
+    if (!isCorrect)
     {
-        printf("Error in input file. Point is not found.\n");
-        return false;
+        printf("Error allocating memory for Taylor expansion at %d points.\n", number_of_points);
     }
-    position += second_position;
 
-    errflag = sscanf(data + position, "count: %d %n", count, &second_position);
-    if (!errflag)
+    //Trees of the cache may be evicted by the next DiffCached, so the orders are copied
+    for (int i = 0; isCorrect && i < orders; i++)
     {
-        printf("Error in input file. Count is not found.\n");
-        return false;
+        trees[i]      = (i == 0) ? node : copyNode((Node *)DiffCached(cache, node, var, i));
+        isCompiled[i] = compactIsExact(trees[i], var) && CompactTreeCtor(&compiled[i]) && compactFromNode(&compiled[i], trees[i]);
     }
-    position += second_position;
 
-    errflag = sscanf(data + position, "width: %d %n", width, &second_position);
-    if (!errflag)
+    if (isCorrect)
     {
-        printf("Error in input file. Width is not found.\n");
-        return false;
+        PointsTask task = {};
+        task.var              = var;
+        task.trees            = trees;
+        task.compiled         = compiled;
+        task.isCompiled       = isCompiled;
+        task.orders           = orders;
+        task.points           = points;
+        task.number_of_points = size;
+        task.values           = values;
+
+        PoolFor(pool, size, POINTS_PER_TASK, EvaluatePoints, &task);
     }
-    position += second_position;
 
-    errflag = sscanf(data + position, "height: %d %n", height, &second_position);
-    if (!errflag)
+    for (size_t j = 0; isCorrect && j < size; j++)
     {
-        printf("Error in input file. Height is not found.\n");
-        return false;
-    }
-    position += second_position;
+        if (!PolynomialCtor(&taylors[j], var, points[j], orders))
+        {
+            isCorrect = false;
+            break;
+        }
 
-    return true;
-}
+        double inv_factorial = 1;
 
-void AnalyseFunction(FILE *input)//TODO: width from file
-{
-    int file_size = getFileSize(input);
-    if (file_size == 0) 
+        for (int i = 0; i < orders; i++)
+        {
+            double value = values[i * size + j];
+            if (!std::isfinite(value))
+            {
+                EvalStatus status = EVAL_OK;
+                value = Evaluate(trees[i], var, points[j], &status);
+
+                if      (status != EVAL_OK && i == 0) {printf("Calculate error: f(%lg): %s.\n", points[j], EvalStatusMsg(status));}
+                else if (status != EVAL_OK)           {printf("Calculate error: f^(%d)(%lg): %s.\n", i, points[j],
+                                                              EvalStatusMsg(status));}
+            }
+
+            if (i > 0)
+            {
+                inv_factorial /= i;
+                value         *= inv_factorial;
+            }
+
+            PolynomialAppend(&taylors[j], i, value);
+        }
+    }
+
+    if (isCorrect && texfile != nullptr)
     {
-        printf("Error opening input file.\n");
-        return;
+        fprintf(texfile, "Разложение функции f(%s) по Тейлору до %d-й степени в точках", var, count);
+        for (size_t j = 0; j < size; j++)
+        {
+            fprintf(texfile, "%s '%lg'", (j > 0) ? "," : "", points[j]);
+        }
+        fprintf(texfile, ".\n\n");
+
+        for (size_t j = 0; j < size; j++)
+        {
+            char o_add[50] = "";
+            Set_o_add(o_add, points[j], count);
+
+            Node *polynomial = nodeFromPolynomial(&taylors[j]);
+            treeLatex(polynomial, texfile, "f(x) = ", true, o_add);
+            treeDtor(polynomial);
+        }
     }
 
-    char *data = (char *)calloc(file_size, sizeof(char));
-    fread(data, sizeof(char), file_size, input);
+    for (int i = 0; compiled != nullptr && i < orders; i++)
+    {
+        CompactTreeDtor(&compiled[i]);
+    }
+    for (int i = 1; trees != nullptr && i < orders; i++)
+    {
+        treeDtor((Node *)trees[i]);
+    }
 
-    const int MAX_FUNC_NAME_LEN      = 100;
-    char function[MAX_FUNC_NAME_LEN] = "";
-    double point   = 0;
-    int count      = 0;
-    int width      = 0;
-    int height     = 0;
-    stack_id stk   = {};
+    free(trees);
+    free(compiled);
+    free(isCompiled);
+    free(values);
 
-    if (GetFuncForAnalyze(data, function, &point, &count, &width, &height))
+    if (cache == &local_cache)
     {
-        FILE *texfile = initLatex();
+        DiffCacheDtor(&local_cache);
+    }
+
+    return isCorrect;
+}
 
-        StackCtor(&stk);
+bool GetFuncForAnalyze(char *data, char *function, double *point, int *count, int *width, int *height, double **points,
+                       int *number_of_points, bool *isIntegral, double *integral)
+{
+    assert(data && function && point && count && width && height);
 
-        printf("Getting input function...\n\n");
+    FILE     *stream = fmemopen(data, strlen(data), "r");
+    InputFile file   = {};
+    if (!InputFileCtor(&file, stream))
+    {
+        if (stream != nullptr) {fclose(stream);}
+        return false;
+    }
 
-        GetTokens(function, stk);
-        Node *node = GetStarted(stk);
-        treeLatex(node, texfile);
+    AnalysisRequest request = {};
+    bool            isFound = InputFileNext(&file, &request);
 
-        treeGraphDump(node);
+    if (!isFound)
+    {
+        fprintf(stderr, "Error in input file. Func is not found.\n");
+    }
+    else
+    {
+        strcpy(function, request.function);
+        *point  = request.point;
+        *count  = request.count;
+        *width  = request.width;
+        *height = request.height;
+
+        if (isIntegral != nullptr) {*isIntegral = request.isIntegral;}
+        if (integral   != nullptr && request.isIntegral)
+        {
+            integral[0] = request.integral[0];
+            integral[1] = request.integral[1];
+        }
 
-        node = OptimizeExpression(node);
-        treeGraphDump(node);
+        if (points != nullptr)
+        {
+            *points = (double *)calloc(request.number_of_points, sizeof(double));
+            if (*points == nullptr)
+            {
+                fprintf(stderr, "Error allocating memory for the points of the input file.\n");
+                isFound = false;
+            }
+            else
+            {
+                memcpy(*points, request.points, request.number_of_points * sizeof(double));
+            }
+        }
+        if (number_of_points != nullptr) {*number_of_points = request.number_of_points;}
+    }
 
-        printf("Function is ready for analysys\n\n");
+    InputFileDtor(&file);
+    fclose(stream);
 
-        Node *taylor = Taylor(node, "x", point, count, texfile);
-        Node *tangent = Add(FuncValue(copyNode(node), "x", point), Mul(FuncValue(Diff(node, "x"), "x", point), Sub(CreateVar("x"), CreateNum(point))));
+    return isFound;
+}
 
-        FILE *gnuplotfile = OpenGnuPlotFile(width, height);
-        AddToGnuplotFile(gnuplotfile, node, "", width, "f(x)");
-        AddToGnuplotFile(gnuplotfile, taylor, "lt 4", width, "P(x)");
-        AddToGnuplotFile(gnuplotfile, tangent, "", width, "tangent");
-        CreatePlot(gnuplotfile, texfile);
-        
-        
-        printf("Analysis finished.\n\n");
+void AnalyseFunction(FILE *input)
+{
+    DiffContext context = {};
+    if (!DiffContextCtor(&context)) {return;}
 
-        treeDtor(node);
-        treeDtor(taylor);
-        StackDtor(&stk);
+    DiffContextAnalyse(&context, input);
 
-        closeLatex(texfile);
-    }
-    free(data);
+    DiffContextDtor(&context);
 }
 
 //----------------------------------------------------------------------------------------------------------------
@@ -331,6 +779,8 @@ Node *CreateNode(Type type, Data data, Node *left, Node *right)
         right->parent = node;
     }
 
+    nodeRehash(node);
+
     return node;
 }
 
@@ -344,6 +794,7 @@ Node *CreateVar(const char *var)
     Node *node = CreateNode(VAR, {.value = 0}, nullptr, nullptr);
 
     strcpy(node->data.var, var);
+    nodeRehash(node);
 
     return node;
 }
@@ -439,14 +890,32 @@ static Node *CalculateNumbers(Node *node, bool *was_changed)
 
     node->left  = CalculateNumbers(node->left,  &wasLeftChanged );
     node->right = CalculateNumbers(node->right, &wasRightChanged);
-    
+
+    node = CalculateNode(node, &wasCurChanged);
+
+    *was_changed = wasCurChanged || wasLeftChanged || wasRightChanged;
+    return node;
+}
+
+//-----------------------------------------------------------
+//! CalculateNumbers at one node, its operands are done
+//-----------------------------------------------------------
+static Node *CalculateNode(Node *node, bool *was_changed)
+{
+    bool wasCurChanged = false;
+
     if (node->type == OP)
     {
         if (node->left != nullptr && node->right != nullptr)
         {
             if (node->left->type == NUM && node->right->type == NUM)
             {
+                SimplifierRule rule  = (node->data.op == DIV) ? RULE_CALCULATE_DIVISION : RULE_CALCULATE_OPERATIONS;
+                RuleProbe      probe = {};
+
+                RuleBegin(&probe);
                 node = CalculateBinaryOperations(node, &wasCurChanged);
+                RuleEnd(rule, &probe, wasCurChanged);
             }
         }
     }
@@ -454,7 +923,9 @@ static Node *CalculateNumbers(Node *node, bool *was_changed)
     {
         printf("Error type: %d\n", node->type);
     }
-    *was_changed = wasCurChanged || wasLeftChanged || wasRightChanged;
+    nodeRehash(node);
+
+    *was_changed = wasCurChanged;
     return node;
 }
 
@@ -589,24 +1060,45 @@ static Node *DeleteUselessNodes(Node *node, bool *was_changed)
     node->left  = DeleteUselessNodes(node->left,  &wasLeftChanged );
     node->right = DeleteUselessNodes(node->right, &wasRightChanged);
 
+    node = DeleteUselessNode(node, &wasCurChanged);
+
+    *was_changed = wasLeftChanged || wasRightChanged || wasCurChanged;
+    return node;
+}
+
+//-----------------------------------------------------------
+//! DeleteUselessNodes at one node, its operands are done
+//-----------------------------------------------------------
+static Node *DeleteUselessNode(Node *node, bool *was_changed)
+{
+    bool wasCurChanged = false;
+
     if (node->type == OP)
     {
-        Operations op = node->data.op;
+        Operations     op    = node->data.op;
+        SimplifierRule rule  = RULE_DELETE_FUNC;
+        RuleProbe      probe = {};
+
+        RuleBegin(&probe);
         if (op == ADD || op == SUB)
         {
+            rule = RULE_DELETE_SUM_SUB;
             node = DeleteSumSubUslessNode(node, &wasCurChanged);
         }
         else if (op == MUL || op == DIV)
         {
+            rule = RULE_DELETE_MUL_DIV;
             node = DeleteMulDivUslessNode(node, &wasCurChanged);
         }
         else
         {
             node = DeleteFuncUslessNode(node, &wasCurChanged);
         }
+        RuleEnd(rule, &probe, wasCurChanged);
     }
+    nodeRehash(node);
 
-    *was_changed = wasLeftChanged || wasRightChanged || wasCurChanged;
+    *was_changed = wasCurChanged;
     return node;
 }
 
@@ -638,8 +1130,8 @@ static Node *DeleteMulDivUslessNode(Node *node, bool *was_changed)//TODO: DSL
         node->type       = NUM;
         node->data.value = 0;
 
-        nodeDtor(node->left);
-        nodeDtor(node->right);
+        treeDtor(node->left);
+        treeDtor(node->right);
         node->left  = nullptr;
         node->right = nullptr;
         *was_changed = true;
@@ -672,7 +1164,7 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
 
     if ((op == TAN || op == ARCTAN || op == SIN) && node->right->type == NUM && node->right->data.value == 0)
     {
-        nodeDtor(node->right);
+        treeDtor(node->right);
 
         node->type       = NUM;
         node->data.value = 0;
@@ -682,7 +1174,7 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
     }
     else if ((op == COT || op == COS) && node->right->type == NUM && node->right->data.value == 0)
     {
-        nodeDtor(node->right);
+        treeDtor(node->right);
 
         node->type       = NUM;
         node->data.value = 1;
@@ -694,7 +1186,7 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
     {
         if (node->right->type == VAR && strcmp(node->right->data.var, "e") == 0)
         {
-            nodeDtor(node->right);
+            treeDtor(node->right);
 
             node->type       = NUM;
             node->data.value = 1;
@@ -704,7 +1196,7 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
         }
         else if (node->right->type == NUM && node->right->data.value == 1)
         {
-            nodeDtor(node->right);
+            treeDtor(node->right);
 
             node->type       = NUM;
             node->data.value = 0;
@@ -717,10 +1209,10 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
     {
         if (node->left->type == NUM && (node->left->data.value == 0 || node->left->data.value == 1))
         {
-            nodeDtor(node->right);
+            treeDtor(node->right);
 
             node->data.value = node->left->data.value;
-            nodeDtor(node->left);
+            treeDtor(node->left);
             
             node->type       = NUM;
             node->left       = nullptr;
@@ -731,8 +1223,8 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
         {
             if (node->right->data.value == 0)
             {
-                nodeDtor(node->right);
-                nodeDtor(node->left );
+                treeDtor(node->right);
+                treeDtor(node->left );
 
                 node->data.value = 1;
                 node->type       = NUM;
@@ -752,7 +1244,7 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
         if (isEqualDoubleNumbers((int)sqrt(node->right->data.value), sqrt(node->right->data.value)))
         {
             node->data.value = sqrt(node->right->data.value);
-            nodeDtor(node->right);
+            treeDtor(node->right);
             
             node->type       = NUM;
             node->left       = nullptr;
@@ -764,35 +1256,395 @@ static Node *DeleteFuncUslessNode(Node *node, bool *was_changed)
     return node;
 }
 
-static Node *SetChildNodeToThis(Node *node, bool isLeftChild)
+//-----------------------------------------------------------
+//! Canonical form of sums and products. Chains of ADD/SUB and
+//! of MUL are flattened, like terms are combined (2*x + x ->
+//! 3*x, x*x -> x^2) and the operands are sorted by kind and
+//! structural hash. Numbers go last in sums and first in
+//! products.
+//-----------------------------------------------------------
+static Node *CollectTerms(Node *node, bool *was_changed)
 {
-    assert(node != nullptr);
-
-    bool isParentExist  = (node->parent != nullptr);
-    bool isThisLeftNode = false;
-
-    Node *target = (isLeftChild) ? node->left  : node->right;
-    Node *trash  = (isLeftChild) ? node->right : node->left;
-    Node *parent = node->parent;
-
-    if (isParentExist)
+    if (node == nullptr || node->type == NUM || node->type == VAR)
     {
-        isThisLeftNode = (node == node->parent->left);
+        *was_changed = false;
+        return node;
     }
 
-    nodeDtor(node);
-    nodeDtor(trash);
-    
-    if (isParentExist)
+    if (isChainNode(node, true) || isChainNode(node, false))
     {
-        target->parent = parent;
-        (isThisLeftNode ? parent->left : parent->right) = target;
+        return CollectChain(node, was_changed, nullptr);
     }
 
-    return target;
+    bool wasLeftChanged  = false;
+    bool wasRightChanged = false;
+
+    node->left  = CollectTerms(node->left,  &wasLeftChanged );
+    node->right = CollectTerms(node->right, &wasRightChanged);
+
+    if (node->left  != nullptr) {node->left->parent  = node;}
+    if (node->right != nullptr) {node->right->parent = node;}
+
+    nodeRehash(node);
+
+    *was_changed = wasLeftChanged || wasRightChanged;
+    return node;
 }
 
-static Node *SetLeftNodeToThis(Node *node)
+//-----------------------------------------------------------
+//! With a worker the operands are simplified in parallel. They
+//! are decomposed afterwards in their order, so the result is
+//! the same.
+//-----------------------------------------------------------
+static Node *CollectChain(Node *node, bool *was_changed, PoolWorker *worker)
+{
+    bool  isSum  = isChainNode(node, true);
+    Node *parent = node->parent;
+
+    unsigned long long old_signature = ChainSignature(node, isSum);
+
+    TermList list = {};
+    list.constant = isSum ? 0 : 1;
+
+    FlattenChain(node, isSum, 1, &list);
+
+    for (size_t i = 0; i < list.trash_size; i++)
+    {
+        list.trash[i]->left   = nullptr;
+        list.trash[i]->right  = nullptr;
+        list.trash[i]->parent = nullptr;
+        nodeDtor(list.trash[i]);
+    }
+    list.trash_size = 0;
+
+    bool wasTermChanged = false;
+
+    size_t number_of_operands = list.size;
+    list.size = 0;
+
+    if (worker != nullptr)
+    {
+        wasTermChanged = CollectOperands(worker, list.terms, number_of_operands);
+    }
+    else
+    {
+        for (size_t i = 0; i < number_of_operands; i++)
+        {
+            bool wasChanged = false;
+
+            list.terms[i].node = CollectTerms(list.terms[i].node, &wasChanged);
+
+            wasTermChanged = wasTermChanged || wasChanged;
+        }
+    }
+
+    for (size_t i = 0; i < number_of_operands; i++)
+    {
+        Term term = list.terms[i];
+        DecomposeTerm(&term, isSum, &list);
+    }
+
+    for (size_t i = 0; i < list.trash_size; i++)
+    {
+        list.trash[i]->left   = nullptr;
+        list.trash[i]->right  = nullptr;
+        list.trash[i]->parent = nullptr;
+        nodeDtor(list.trash[i]);
+    }
+    list.trash_size = 0;
+
+    qsort(list.terms, list.size, sizeof(Term), CompareTerms);
+    MergeEqualTerms(&list);
+
+    Node *result = isSum ? RebuildSum(&list) : RebuildProduct(&list);
+    result->parent = parent;
+
+    TermListDtor(&list);
+
+    *was_changed = wasTermChanged || old_signature != ChainSignature(result, isSum);
+    return result;
+}
+
+static bool isChainNode(const Node *node, bool isSum)
+{
+    if (node == nullptr || node->type != OP) {return false;}
+
+    return isSum ? (node->data.op == ADD || node->data.op == SUB) : (node->data.op == MUL);
+}
+
+//-----------------------------------------------------------
+//! Collect operands of the chain as terms with their signs.
+//! Chain nodes are moved to the trash.
+//-----------------------------------------------------------
+static void FlattenChain(Node *node, bool isSum, double sign, TermList *list)
+{
+    if (!isChainNode(node, isSum))
+    {
+        PushTerm(list, node, sign);
+        return;
+    }
+
+    PushTrash(list, node);
+
+    FlattenChain(node->left,  isSum, sign, list);
+    FlattenChain(node->right, isSum, (node->data.op == SUB) ? -sign : sign, list);
+}
+
+static void DecomposeTerm(Term *term, bool isSum, TermList *list)
+{
+    Node *node = term->node;
+
+    if (node->type == NUM)
+    {
+        if (isSum) {list->constant += term->coef * node->data.value;}
+        else       {list->constant *= node->data.value;}
+
+        PushTrash(list, node);
+    }
+    else if (isSum && node->type == OP && node->data.op == MUL && node->left->type == NUM)
+    {
+        PushTerm(list, node->right, term->coef * node->left->data.value);
+        PushTrash(list, node->left);
+        PushTrash(list, node);
+    }
+    else if (!isSum && node->type == OP && node->data.op == POW && node->right->type == NUM)
+    {
+        PushTerm(list, node->left, node->right->data.value);
+        PushTrash(list, node->right);
+        PushTrash(list, node);
+    }
+    else
+    {
+        PushTerm(list, node, term->coef);
+    }
+}
+
+static Node *RebuildSum(TermList *list)
+{
+    Node *result = nullptr;
+
+    for (size_t i = 0; i < list->size; i++)
+    {
+        Node   *node = list->terms[i].node;
+        double  coef = list->terms[i].coef;
+
+        if (coef == 0)
+        {
+            treeDtor(node);
+            continue;
+        }
+
+        if (result == nullptr)
+        {
+            result = (coef == 1) ? node : Mul(CreateNum(coef), node);
+        }
+        else
+        {
+            double abs_coef = fabs(coef);
+            Node  *term     = (abs_coef == 1) ? node : Mul(CreateNum(abs_coef), node);
+
+            result = (coef < 0) ? Sub(result, term) : Add(result, term);
+        }
+    }
+
+    double constant = list->constant;
+
+    if (result == nullptr)
+    {
+        result = CreateNum(constant);
+    }
+    else if (constant < 0)
+    {
+        result = Sub(result, CreateNum(-constant));
+    }
+    else if (constant > 0)
+    {
+        result = Add(result, CreateNum(constant));
+    }
+
+    return result;
+}
+
+static Node *RebuildProduct(TermList *list)
+{
+    if (list->constant == 0)
+    {
+        for (size_t i = 0; i < list->size; i++)
+        {
+            treeDtor(list->terms[i].node);
+        }
+        return CreateNum(0);
+    }
+
+    Node *result = nullptr;
+
+    for (size_t i = 0; i < list->size; i++)
+    {
+        Node   *node  = list->terms[i].node;
+        double  power = list->terms[i].coef;
+
+        if (power == 0)
+        {
+            treeDtor(node);
+            continue;
+        }
+
+        Node *factor = (power == 1) ? node : Pow(node, CreateNum(power));
+        result = (result == nullptr) ? factor : Mul(result, factor);
+    }
+
+    if (result == nullptr)
+    {
+        return CreateNum(list->constant);
+    }
+    if (list->constant != 1)
+    {
+        result = Mul(CreateNum(list->constant), result);
+    }
+
+    return result;
+}
+
+static void MergeEqualTerms(TermList *list)
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < list->size; i++)
+    {
+        if (size > 0 && isEqualTrees(list->terms[size - 1].node, list->terms[i].node))
+        {
+            list->terms[size - 1].coef += list->terms[i].coef;
+            treeDtor(list->terms[i].node);
+        }
+        else
+        {
+            list->terms[size++] = list->terms[i];
+        }
+    }
+
+    list->size = size;
+}
+
+static int CompareTerms(const void *first, const void *second)
+{
+    const Node *first_node  = ((const Term *)first )->node;
+    const Node *second_node = ((const Term *)second)->node;
+
+    int first_rank  = TermRank(first_node);
+    int second_rank = TermRank(second_node);
+
+    if (first_rank != second_rank)
+    {
+        return (first_rank < second_rank) ? -1 : 1;
+    }
+    if (first_node->hash != second_node->hash)
+    {
+        return (first_node->hash < second_node->hash) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int TermRank(const Node *node)
+{
+    switch (node->type)
+    {
+    case VAR:
+        return 0;
+    case OP:
+        return 1 + node->data.op;
+    default:
+        return 1 + NUMBER_OF_OPERATIONS;
+    }
+}
+
+static void PushTerm(TermList *list, Node *node, double coef)
+{
+    if (list->size == list->capacity)
+    {
+        size_t capacity = 2*list->capacity + 4;
+        Term  *terms    = (Term *)realloc(list->terms, capacity * sizeof(Term));
+        assert(terms && "Error allocating memory for terms!\n");
+
+        list->terms    = terms;
+        list->capacity = capacity;
+    }
+
+    node->parent = nullptr;
+    list->terms[list->size++] = {node, coef};
+}
+
+static void PushTrash(TermList *list, Node *node)
+{
+    if (list->trash_size == list->trash_capacity)
+    {
+        size_t capacity = 2*list->trash_capacity + 4;
+        Node **trash    = (Node **)realloc(list->trash, capacity * sizeof(Node *));
+        assert(trash && "Error allocating memory for terms!\n");
+
+        list->trash          = trash;
+        list->trash_capacity = capacity;
+    }
+
+    list->trash[list->trash_size++] = node;
+}
+
+static void TermListDtor(TermList *list)
+{
+    free(list->terms);
+    free(list->trash);
+
+    *list = {};
+}
+
+//-----------------------------------------------------------
+//! Order-dependent hash of the chain shape, used to find out
+//! whether CollectChain changed anything
+//-----------------------------------------------------------
+static unsigned long long ChainSignature(const Node *node, bool isSum)
+{
+    if (!isChainNode(node, isSum))
+    {
+        return node->hash;
+    }
+
+    unsigned long long signature = (unsigned long long)node->data.op + 1;
+
+    signature = (signature ^ ChainSignature(node->left,  isSum)) * 1099511628211ULL;
+    signature = (signature ^ ChainSignature(node->right, isSum)) * 1099511628211ULL;
+
+    return signature ^ (signature >> 29);
+}
+
+static Node *SetChildNodeToThis(Node *node, bool isLeftChild)
+{
+    assert(node != nullptr);
+
+    bool isParentExist  = (node->parent != nullptr);
+    bool isThisLeftNode = false;
+
+    Node *target = (isLeftChild) ? node->left  : node->right;
+    Node *trash  = (isLeftChild) ? node->right : node->left;
+    Node *parent = node->parent;
+
+    if (isParentExist)
+    {
+        isThisLeftNode = (node == node->parent->left);
+    }
+
+    treeDtor(trash);
+    nodeDtor(node);
+
+    target->parent = parent;
+    if (isParentExist)
+    {
+        (isThisLeftNode ? parent->left : parent->right) = target;
+    }
+
+    return target;
+}
+
+static Node *SetLeftNodeToThis(Node *node)
 {
     return SetChildNodeToThis(node, true);
 }
@@ -811,6 +1663,428 @@ static bool isConstant(Node *node, const char *var)
     return isThisConstant && isConstant(node->left, var) && isConstant(node->right, var);
 }
 
+static double EvaluateNode(const Node *node, const Binding *bindings, int number_of_bindings, EvalStatus *status)
+{
+    switch (node->type)
+    {
+    case NUM:
+        return node->data.value;
+    case VAR:
+        for (int i = 0; i < number_of_bindings; i++)
+        {
+            if (strncmp(bindings[i].var, node->data.var, MAX_VAR_NAME_LEN) == 0)
+            {
+                return bindings[i].value;
+            }
+        }
+        if (strcmp(node->data.var, "e") == 0)
+        {
+            return M_E;
+        }
+        return SetEvalError(status, EVAL_UNBOUND_VARIABLE);
+    case OP:
+        break;
+    default:
+        return SetEvalError(status, EVAL_WRONG_TREE);
+    }
+
+    if (node->right == nullptr)
+    {
+        return SetEvalError(status, EVAL_WRONG_TREE);
+    }
+
+    double left  = (node->left != nullptr) ? EvaluateNode(node->left, bindings, number_of_bindings, status) : 0;
+    double right = EvaluateNode(node->right, bindings, number_of_bindings, status);
+
+    switch (node->data.op)
+    {
+    case ADD:
+        return left + right;
+    case SUB:
+        return left - right;
+    case MUL:
+        return left * right;
+    case DIV:
+        if (right == 0) {return SetEvalError(status, EVAL_DIVISION_BY_ZERO);}
+        return left / right;
+    case SIN:
+        return sin(right);
+    case COS:
+        return cos(right);
+    case TAN:
+        if (cos(right) == 0) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return tan(right);
+    case COT:
+        if (sin(right) == 0) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return 1/tan(right);
+    case ARCSIN:
+        if (fabs(right) > 1) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return asin(right);
+    case ARCCOS:
+        if (fabs(right) > 1) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return acos(right);
+    case ARCTAN:
+        return atan(right);
+    case ARCCOT:
+        return M_PI_2 - atan(right);
+    case LN:
+        if (right <= 0) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return log(right);
+    case SQRT:
+        if (right < 0) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return sqrt(right);
+    case POW:
+        if (left == 0 && right < 0)           {return SetEvalError(status, EVAL_DIVISION_BY_ZERO);}
+        if (left <  0 && right != (int)right) {return SetEvalError(status, EVAL_DOMAIN_ERROR);}
+        return pow(left, right);
+    default:
+        return SetEvalError(status, EVAL_WRONG_TREE);
+    }
+}
+
+static double SetEvalError(EvalStatus *status, EvalStatus error)
+{
+    if (*status == EVAL_OK)
+    {
+        *status = error;
+    }
+
+    return NAN;
+}
+
+static void RunSimplifyLoop(PoolWorker *worker, void *loop_ptr)
+{
+    SimplifyLoop *loop = (SimplifyLoop *)loop_ptr;
+    Node         *node = loop->node;
+
+    bool was_changed_by_calculating = true;
+    bool was_changed_by_deleting    = true;
+    bool was_changed_by_collecting  = true;
+
+    while (was_changed_by_calculating || was_changed_by_deleting || was_changed_by_collecting)
+    {
+        METRICS_ADD(METRICS_SIMPLIFIER_PASSES, 1);
+        loop->iterations++;
+
+        node = SimplifierRunPass(worker, PASS_CALCULATE, node, &was_changed_by_calculating);
+        node = SimplifierRunPass(worker, PASS_DELETE,    node, &was_changed_by_deleting   );
+
+        RuleProbe probe = {};
+        RuleBegin(&probe);
+        node = SimplifierRunPass(worker, PASS_COLLECT,   node, &was_changed_by_collecting );
+        RuleEnd(RULE_COLLECT_TERMS, &probe, was_changed_by_collecting);
+    }
+
+    loop->node = node;
+}
+
+//-----------------------------------------------------------
+//! Without a worker, or for a small tree, the serial pass
+//-----------------------------------------------------------
+static Node *SimplifierRunPass(PoolWorker *worker, SimplifierPass pass, Node *node, bool *was_changed)
+{
+    size_t *sizes = (worker != nullptr) ? PoolSubtreeSizes(node) : nullptr;
+
+    if (sizes == nullptr)
+    {
+        switch (pass)
+        {
+        case PASS_CALCULATE:
+            return CalculateNumbers(node, was_changed);
+        case PASS_DELETE:
+            return DeleteUselessNodes(node, was_changed);
+        default:
+            return CollectTerms(node, was_changed);
+        }
+    }
+
+    SimplifyTask task = {};
+    task.pass  = pass;
+    task.sizes = sizes;
+    task.node  = node;
+
+    SimplifySubtree(worker, &task);
+
+    free(sizes);
+
+    *was_changed = task.was_changed;
+    return task.node;
+}
+
+//-----------------------------------------------------------
+//! The size of a subtree is looked up by its preorder index
+//! (see PoolSubtreeSizes). Operands of a chain get their own
+//! sizes, as the chain is rebuilt.
+//-----------------------------------------------------------
+static void SimplifySubtree(PoolWorker *worker, SimplifyTask *task)
+{
+    Node *node = task->node;
+
+    bool wasLeftChanged  = false;
+    bool wasRightChanged = false;
+    bool wasCurChanged   = false;
+
+    switch (task->pass)
+    {
+    case PASS_CALCULATE:
+        if (task->sizes[task->index] < PARALLEL_DIFF_CUTOFF)
+        {
+            task->node = CalculateNumbers(node, &task->was_changed);
+            return;
+        }
+
+        SimplifyOperands(worker, task, &wasLeftChanged, &wasRightChanged);
+        task->node = CalculateNode(node, &wasCurChanged);
+        break;
+
+    case PASS_DELETE:
+        if (task->sizes[task->index] < PARALLEL_DIFF_CUTOFF)
+        {
+            task->node = DeleteUselessNodes(node, &task->was_changed);
+            return;
+        }
+
+        SimplifyOperands(worker, task, &wasLeftChanged, &wasRightChanged);
+        task->node = DeleteUselessNode(node, &wasCurChanged);
+        break;
+
+    case PASS_COLLECT:
+        if (task->sizes == nullptr || task->sizes[task->index] < PARALLEL_DIFF_CUTOFF)
+        {
+            task->node = CollectTerms(node, &task->was_changed);
+            return;
+        }
+        if (isChainNode(node, true) || isChainNode(node, false))
+        {
+            task->node = CollectChain(node, &task->was_changed, worker);
+            return;
+        }
+
+        SimplifyOperands(worker, task, &wasLeftChanged, &wasRightChanged);
+
+        if (node->left  != nullptr) {node->left->parent  = node;}
+        if (node->right != nullptr) {node->right->parent = node;}
+        nodeRehash(node);
+        break;
+
+    case PASS_COLLECT_TERMS:
+        SimplifyTerms(worker, task);
+        return;
+
+    default:
+        assert(0 && "Error: unknown simplifier pass!\n");
+        return;
+    }
+
+    task->was_changed = wasCurChanged || wasLeftChanged || wasRightChanged;
+}
+
+//-----------------------------------------------------------
+//! The left operand goes to a task. Operands are detached from
+//! the node meanwhile, so rules that relink the parent of a
+//! subtree never write to a node seen by two threads.
+//-----------------------------------------------------------
+static void SimplifyOperands(PoolWorker *worker, SimplifyTask *task, bool *wasLeftChanged, bool *wasRightChanged)
+{
+    Node *node = task->node;
+
+    SimplifyTask left  = {};
+    SimplifyTask right = {};
+
+    left.pass  = right.pass  = task->pass;
+    left.sizes = right.sizes = task->sizes;
+
+    left.node  = node->left;
+    right.node = node->right;
+
+    if (task->sizes != nullptr)
+    {
+        left.index  = task->index + 1;
+        right.index = task->index + 1 + ((node->left != nullptr) ? task->sizes[left.index] : 0);
+    }
+
+    Node *left_parent  = (node->left  != nullptr) ? node->left->parent  : nullptr;
+    Node *right_parent = (node->right != nullptr) ? node->right->parent : nullptr;
+
+    if (node->left  != nullptr) {node->left->parent  = nullptr;}
+    if (node->right != nullptr) {node->right->parent = nullptr;}
+
+    PoolTask pool_task = {};
+    if (node->left != nullptr && node->right != nullptr)
+    {
+        SpawnSimplify(worker, &left, &pool_task);
+    }
+    else if (node->left != nullptr)
+    {
+        SimplifySubtree(worker, &left);
+    }
+
+    if (node->right != nullptr) {SimplifySubtree(worker, &right);}
+
+    if (pool_task.run != nullptr) {JoinSimplify(worker, &left, &pool_task);}
+
+    node->left  = left.node;
+    node->right = right.node;
+
+    if (node->left  != nullptr) {node->left->parent  = left_parent;}
+    if (node->right != nullptr) {node->right->parent = right_parent;}
+
+    *wasLeftChanged  = left.was_changed;
+    *wasRightChanged = right.was_changed;
+}
+
+//-----------------------------------------------------------
+//! CollectTerms of the operands [index, end) of a chain, the
+//! first half of a long range goes to a task
+//-----------------------------------------------------------
+static void SimplifyTerms(PoolWorker *worker, SimplifyTask *task)
+{
+    if (task->end - task->index <= TERMS_PER_TASK)
+    {
+        for (size_t i = task->index; i < task->end; i++)
+        {
+            SimplifyTask term = {};
+            term.pass  = PASS_COLLECT;
+            term.node  = task->terms[i].node;
+            term.sizes = PoolSubtreeSizes(term.node);
+
+            SimplifySubtree(worker, &term);
+
+            free((void *)term.sizes);
+
+            task->terms[i].node = term.node;
+            task->was_changed   = task->was_changed || term.was_changed;
+        }
+        return;
+    }
+
+    size_t middle = task->index + (task->end - task->index) / 2;
+
+    SimplifyTask first  = {};
+    SimplifyTask second = {};
+
+    first.pass  = second.pass  = PASS_COLLECT_TERMS;
+    first.terms = second.terms = task->terms;
+
+    first.index  = task->index;
+    first.end    = middle;
+    second.index = middle;
+    second.end   = task->end;
+
+    PoolTask pool_task = {};
+    SpawnSimplify  (worker, &first, &pool_task);
+    SimplifySubtree(worker, &second);
+    if (pool_task.run != nullptr) {JoinSimplify(worker, &first, &pool_task);}
+
+    task->was_changed = task->was_changed || first.was_changed || second.was_changed;
+}
+
+static bool CollectOperands(PoolWorker *worker, Term *terms, size_t size)
+{
+    //Parents of the operands were freed with the chain
+    for (size_t i = 0; i < size; i++)
+    {
+        terms[i].node->parent = nullptr;
+    }
+
+    SimplifyTask task = {};
+    task.pass  = PASS_COLLECT_TERMS;
+    task.terms = terms;
+    task.index = 0;
+    task.end   = size;
+
+    SimplifySubtree(worker, &task);
+
+    return task.was_changed;
+}
+
+//-----------------------------------------------------------
+//! If the deque is full the task is run at once, pool_task->run
+//! stays nullptr then and there is nothing to join
+//-----------------------------------------------------------
+static void SpawnSimplify(PoolWorker *worker, SimplifyTask *task, PoolTask *pool_task)
+{
+    task->isTimed = Stats.isTimed;
+
+    pool_task->run = RunSimplifyTask;
+    pool_task->arg = task;
+
+    if (!PoolSpawn(worker, pool_task))
+    {
+        pool_task->run = nullptr;
+        SimplifySubtree(worker, task);
+    }
+}
+
+static void JoinSimplify(PoolWorker *worker, SimplifyTask *task, PoolTask *pool_task)
+{
+    PoolJoin(worker, pool_task);
+
+    for (int i = 0; i < NUMBER_OF_SIMPLIFIER_RULES; i++)
+    {
+        Stats.rules[i].calls         += task->rules[i].calls;
+        Stats.rules[i].fires         += task->rules[i].fires;
+        Stats.rules[i].nodes_removed += task->rules[i].nodes_removed;
+        Stats.rules[i].time_ns       += task->rules[i].time_ns;
+    }
+
+    treeMoveThreadNodes(task->nodes);
+}
+
+static void RunSimplifyTask(PoolWorker *worker, void *task_ptr)
+{
+    SimplifyTask *task = (SimplifyTask *)task_ptr;
+
+    SimplifierStats saved = Stats;
+    for (int i = 0; i < NUMBER_OF_SIMPLIFIER_RULES; i++)
+    {
+        Stats.rules[i] = {};
+    }
+    Stats.isTimed = task->isTimed;
+
+    long long nodes = treeThreadNodes();
+
+    SimplifySubtree(worker, task);
+
+    task->nodes = treeThreadNodes() - nodes;
+    treeMoveThreadNodes(-task->nodes);
+
+    for (int i = 0; i < NUMBER_OF_SIMPLIFIER_RULES; i++)
+    {
+        task->rules[i] = Stats.rules[i];
+    }
+    Stats = saved;
+}
+
+static void RuleBegin(RuleProbe *probe)
+{
+    probe->live  = treeThreadNodes();
+    probe->start = Stats.isTimed ? NowNs() : 0;
+}
+
+static void RuleEnd(SimplifierRule rule, const RuleProbe *probe, bool wasFired)
+{
+    SimplifierRuleStats *stats = &Stats.rules[rule];
+
+    stats->calls++;
+    if (wasFired) {stats->fires++;}
+
+    stats->nodes_removed += probe->live - treeThreadNodes();
+
+    if (Stats.isTimed)
+    {
+        stats->time_ns += NowNs() - probe->start;
+    }
+}
+
+static double NowNs()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
 static void Set_o_add(char *o_add, double point, int power)
 {
     if (isEqualDoubleNumbers(power, 0)) 
@@ -825,4 +2099,260 @@ static void Set_o_add(char *o_add, double point, int power)
         sprintf(o_add, "+o((x-%lg)^{%d})", point, power);
 }
 
+static void EvaluatePoints(void *task_ptr, size_t start, size_t end)
+{
+    PointsTask   *task   = (PointsTask *)task_ptr;
+    size_t        size   = end - start;
+    const double *points = task->points + start;
+
+    for (int i = 0; i < task->orders; i++)
+    {
+        double *values = task->values + i * task->number_of_points + start;
+
+        if (task->isCompiled[i] && compactEvaluateBatch(&task->compiled[i], task->var, points, values, size)) {continue;}
+
+        for (size_t j = 0; j < size; j++)
+        {
+            values[j] = Evaluate(task->trees[i], task->var, points[j]);
+        }
+    }
+}
+
+//-----------------------------------------------------------
+//! Builds the derivative of order n >= 1 if derivative is not
+//! nullptr. Returns false if some term has no closed form, it
+//! is differentiated n times then.
+//-----------------------------------------------------------
+static bool ClosedDiff(Node *node, const char *var, int n, Node **derivative)
+{
+    if (isConstant(node, var))
+    {
+        if (derivative != nullptr) {*derivative = CreateNum(0);}
+        return true;
+    }
+
+    if (node->type == VAR)
+    {
+        if (derivative != nullptr) {*derivative = CreateNum((n == 1) ? 1 : 0);}
+        return true;
+    }
+
+    Node   *left   = nullptr;
+    Node   *right  = nullptr;
+    double  slope  = 0;
+    double  value  = 0;
+
+    Node  **left_derivative  = (derivative != nullptr) ? &left  : nullptr;
+    Node  **right_derivative = (derivative != nullptr) ? &right : nullptr;
+
+    if (node->type == OP && node->right != nullptr)
+    {
+        switch (node->data.op)
+        {
+        case ADD:
+        case SUB:
+            {
+            bool isLeftClosed  = (node->left == nullptr) || ClosedDiff(node->left, var, n, left_derivative);
+            bool isRightClosed = ClosedDiff(node->right, var, n, right_derivative);
+
+            if (derivative != nullptr)
+            {
+                if (left == nullptr) {left = CreateNum(0);}
+                *derivative = (node->data.op == ADD) ? Add(left, right) : Sub(left, right);
+            }
+            return isLeftClosed && isRightClosed;
+            }
+        case MUL:
+            if (isConstant(node->left, var))
+            {
+                bool isClosed = ClosedDiff(node->right, var, n, right_derivative);
+                if (derivative != nullptr) {*derivative = Mul(copyNode(node->left), right);}
+                return isClosed;
+            }
+            if (isConstant(node->right, var))
+            {
+                bool isClosed = ClosedDiff(node->left, var, n, left_derivative);
+                if (derivative != nullptr) {*derivative = Mul(left, copyNode(node->right));}
+                return isClosed;
+            }
+            break;
+        case DIV:
+            if (isConstant(node->right, var) && node->left != nullptr)
+            {
+                bool isClosed = ClosedDiff(node->left, var, n, left_derivative);
+                if (derivative != nullptr) {*derivative = Div(left, copyNode(node->right));}
+                return isClosed;
+            }
+            break;
+        case SIN:
+        case COS:
+            if (LinearSlope(node->right, var, &slope))
+            {
+                //sin, cos, -sin, -cos
+                int phase = (n + (node->data.op == COS)) % 4;
+                if (derivative != nullptr)
+                {
+                    Node *func  = (phase % 2 == 0) ? Sin(copyNode(node->right)) : Cos(copyNode(node->right));
+                    *derivative = Mul(CreateNum(((phase < 2) ? 1 : -1) * pow(slope, n)), func);
+                }
+                return true;
+            }
+            break;
+        case LN:
+            if (LinearSlope(node->right, var, &slope))
+            {
+                //(-1)^(n-1) (n-1)! a^n / u^n
+                if (derivative != nullptr)
+                {
+                    double coef = (n % 2 == 1) ? 1 : -1;
+                    for (int i = 1; i < n; i++)
+                    {
+                        coef *= i;
+                    }
+                    coef *= pow(slope, n);
+
+                    *derivative = Div(CreateNum(coef), Pow(copyNode(node->right), CreateNum(n)));
+                }
+                return true;
+            }
+            break;
+        case SQRT:
+            if (LinearSlope(node->right, var, &slope))
+            {
+                if (derivative != nullptr) {*derivative = PowerDiff(node->right, 0.5, slope, n);}
+                return true;
+            }
+            break;
+        case POW:
+            if (node->left == nullptr) {break;}
+            if (isConstant(node->left, var) && ConstantValue(node->left, &value) && value > 0 &&
+                LinearSlope(node->right, var, &slope))
+            {
+                //(a ln c)^n c^u, ln e is taken as 1
+                if (derivative != nullptr)
+                {
+                    bool   isE    = (node->left->type == VAR && strcmp(node->left->data.var, "e") == 0);
+                    double factor = isE ? slope : slope * log(value);
+
+                    *derivative = Mul(CreateNum(pow(factor, n)), copyNode(node));
+                }
+                return true;
+            }
+            if (isConstant(node->right, var) && ConstantValue(node->right, &value) &&
+                LinearSlope(node->left, var, &slope))
+            {
+                if (derivative != nullptr) {*derivative = PowerDiff(node->left, value, slope, n);}
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (derivative != nullptr) {*derivative = IteratedDiff(node, var, n);}
+    return false;
+}
+
+//-----------------------------------------------------------
+//! k (k-1) ... (k-n+1) a^n u^(k-n), zero after the last power
+//! of a polynomial
+//-----------------------------------------------------------
+static Node *PowerDiff(Node *base, double power, double slope, int n)
+{
+    double coef = pow(slope, n);
+    for (int i = 0; i < n; i++)
+    {
+        coef *= power - i;
+    }
+
+    if (coef == 0) {return CreateNum(0);}
+
+    return Mul(CreateNum(coef), Pow(copyNode(base), CreateNum(power - n)));
+}
+
+static Node *IteratedDiff(Node *node, const char *var, int n)
+{
+    Node *current = copyNode(node);
+
+    for (int i = 1; i <= n; i++)
+    {
+        Node *next = OptimizeExpression(Diff(current, var));
+        treeDtor(current);
+        current = next;
+    }
+
+    return current;
+}
+
+//-----------------------------------------------------------
+//! Slope of a u = a*var + b, where a is a number. b may be any
+//! constant subtree.
+//-----------------------------------------------------------
+static bool LinearSlope(Node *node, const char *var, double *slope)
+{
+    if (isConstant(node, var))
+    {
+        *slope = 0;
+        return true;
+    }
+
+    if (node->type == VAR)
+    {
+        *slope = 1;
+        return true;
+    }
+
+    if (node->type != OP || node->right == nullptr) {return false;}
+
+    double left  = 0;
+    double right = 0;
+
+    switch (node->data.op)
+    {
+    case ADD:
+    case SUB:
+        if (node->left != nullptr && !LinearSlope(node->left, var, &left)) {return false;}
+        if (!LinearSlope(node->right, var, &right))                         {return false;}
+
+        *slope = (node->data.op == ADD) ? left + right : left - right;
+        return true;
+    case MUL:
+        if (node->left == nullptr) {return false;}
+        if (isConstant(node->left, var) && ConstantValue(node->left, &left) && LinearSlope(node->right, var, &right))
+        {
+            *slope = left * right;
+            return true;
+        }
+        if (isConstant(node->right, var) && ConstantValue(node->right, &right) && LinearSlope(node->left, var, &left))
+        {
+            *slope = left * right;
+            return true;
+        }
+        return false;
+    case DIV:
+        if (node->left == nullptr) {return false;}
+        if (isConstant(node->right, var) && ConstantValue(node->right, &right) && right != 0 &&
+            LinearSlope(node->left, var, &left))
+        {
+            *slope = left / right;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+//-----------------------------------------------------------
+//! Value of a subtree without variables (but e)
+//-----------------------------------------------------------
+static bool ConstantValue(const Node *node, double *value)
+{
+    EvalStatus status = EVAL_OK;
+    *value = Evaluate(node, nullptr, 0, &status);
+
+    return status == EVAL_OK && std::isfinite(*value);
+}
+
 //----------------------------------------------------------------------------------------------------------------
@@ -3,19 +3,135 @@
 
 //----------------------------------------------------------------------------------------------------------------
 
+#include "DiffCache.hpp"
+#include "ParallelDiff.hpp"
+#include "Polynomial.hpp"
 #include "Tree.hpp"
 
 //----------------------------------------------------------------------------------------------------------------
 
+enum EvalStatus
+{
+    EVAL_OK,
+    EVAL_DIVISION_BY_ZERO,
+    EVAL_DOMAIN_ERROR,
+    EVAL_UNBOUND_VARIABLE,
+    EVAL_WRONG_TREE
+};
+
+struct Binding
+{
+    const char *var   = nullptr;
+    double      value = 0;
+};
+
+enum SimplifierRule
+{
+    RULE_CALCULATE_OPERATIONS,
+    RULE_CALCULATE_DIVISION,
+    RULE_DELETE_SUM_SUB,
+    RULE_DELETE_MUL_DIV,
+    RULE_DELETE_FUNC,
+    RULE_COLLECT_TERMS,
+
+    NUMBER_OF_SIMPLIFIER_RULES
+};
+
+struct SimplifierRuleStats
+{
+    long long calls         = 0;
+    long long fires         = 0;
+    long long nodes_removed = 0;
+    double    time_ns       = 0;
+};
+
+//-----------------------------------------------------------
+//! Work of OptimizeExpression in the calling thread since the
+//! last reset. Rules are counted always, time is measured only
+//! when timing is on (it costs two clock reads per rule call).
+//! nodes_removed is counted by the nodes of the thread (see
+//! treeThreadNodes), so other threads do not change it.
+//-----------------------------------------------------------
+struct SimplifierStats
+{
+    SimplifierRuleStats rules[NUMBER_OF_SIMPLIFIER_RULES] = {};
+
+    long long calls          = 0;
+    long long iterations     = 0;
+    long long max_iterations = 0;
+    bool      isTimed        = false;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
 Node *Diff(Node *node, const char *var);
+
+//-----------------------------------------------------------
+//! One step of Diff: DiffOperands tells which operands must
+//! be differentiated, DiffNode builds the derivative of the
+//! node from their derivatives (nullptr for the others) and
+//! takes them. Parallel differentiation is built on these.
+//-----------------------------------------------------------
+void  DiffOperands (Node *node, const char *var, bool *needLeft, bool *needRight);
+Node *DiffNode     (Node *node, const char *var, Node *left_derivative, Node *right_derivative);
+
+//-----------------------------------------------------------
+//! Simplified derivative of order n. Sums, constant factors
+//! and sin, cos, c^u, ln, sqrt and u^k of a linear u (with a
+//! numeric slope) have closed forms, built at once from the
+//! node. Other terms are differentiated n times.
+//-----------------------------------------------------------
+Node *DiffN         (Node *node, const char *var, int n);
+
+//-----------------------------------------------------------
+//! True if DiffN(node, var, n) needs no iterated Diff
+//-----------------------------------------------------------
+bool  hasClosedDiff (Node *node, const char *var);
+
 Node *FuncValue(Node *node, const char *var, double value);
-Node *OptimizeExpression(Node *node);
-Node *Taylor(Node *node, const char *var, double point, int count, FILE *texfile);
-bool  GetFuncForAnalyze(char *data, char *function, double *point, int *count, int *width, int *height);
+double Evaluate(const Node *node, const Binding *bindings, int number_of_bindings, EvalStatus *status = nullptr);
+double Evaluate(const Node *node, const char *var, double value, EvalStatus *status = nullptr);
+const char *EvalStatusMsg(EvalStatus status);
+//-----------------------------------------------------------
+//! With a pool large subtrees are simplified in parallel, the
+//! result and the stats are the same as without it
+//-----------------------------------------------------------
+Node *OptimizeExpression(Node *node, DiffPool *pool = nullptr);
+bool  Taylor(Node *node, const char *var, double point, int count, FILE *texfile, Polynomial *taylor, DiffCache *cache = nullptr,
+             OutputSink *sink = nullptr);
+
+//-----------------------------------------------------------
+//! taylors[i] is the expansion at points[i], the same as one
+//! Taylor call for it. The derivatives are taken once and
+//! evaluated at all points in batches, in parallel with a
+//! pool. The caller frees taylors[] with PolynomialDtor.
+//-----------------------------------------------------------
+bool  TaylorPoints(Node *node, const char *var, const double *points, int number_of_points, int count, FILE *texfile,
+                   Polynomial *taylors, DiffCache *cache = nullptr, DiffPool *pool = nullptr);
+
+//-----------------------------------------------------------
+//! Fields of the first job of the text, read by InputFile, so
+//! the format and the defaults are the ones of funcfile.
+//! function must have room for MAX_FUNC_NAME_LEN symbols.
+//! *point is the first point. If points != nullptr, *points
+//! is the allocated list of all of them (free it), its length
+//! goes to *number_of_points. "integral: a, b" sets
+//! *isIntegral and integral[0], integral[1].
+//-----------------------------------------------------------
+bool  GetFuncForAnalyze(char *data, char *function, double *point, int *count, int *width, int *height,
+                        double **points = nullptr, int *number_of_points = nullptr, bool *isIntegral = nullptr,
+                        double *integral = nullptr);
 void  AnalyseFunction(FILE *input);
 
 //----------------------------------------------------------------------------------------------------------------
 
+void SimplifierStatsReset  ();
+void SimplifierStatsTiming (bool isTimed);
+void SimplifierGetStats    (SimplifierStats *stats);
+void SimplifierPrintStats  (FILE *stream);
+
+//----------------------------------------------------------------------------------------------------------------
+
 Node *CreateNode (Type type, Data data , Node *left, Node *right);
 Node *CreateNum  (double val);
 Node *CreateVar  (const char *var);
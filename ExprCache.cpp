@@ -0,0 +1,298 @@
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CompactTree.hpp"
+#include "ExprCache.hpp"
+#include "Metrics.hpp"
+#include "MyGeneralFunctions.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const char     CACHE_MAGIC[8]       = {'D', 'I', 'F', 'F', 'C', 'A', 'C', 'H'};
+static const uint32_t CACHE_VERSION        = 2;
+static const int      MAX_CACHE_PATH_LEN   = 256;
+static const char    *CACHE_ENTRY_PATH     = "%s/%016llx.dcache";
+static const char    *CACHE_TMP_ENTRY_PATH = "%s/%016llx.dcache.%d.%u.tmp";
+
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME  = 1099511628211ULL;
+
+//Tells apart temporary files of threads storing the same entry
+static std::atomic<unsigned> StoreCounter(0);
+
+//----------------------------------------------------------------------------------------------------------------
+
+static size_t             CanonicalText (const char *function, char *canonical);
+static unsigned long long FnvHash       (const void *data, size_t size, unsigned long long hash = FNV_OFFSET);
+static bool               WriteTree     (FILE *stream, CompactTree *compact, const Node *node);
+static Node              *ReadTree      (FILE *stream, CompactTree *compact);
+static bool               ReadHeader    (FILE *stream, const char *canonical, size_t canonical_len, const char *var, uint32_t *count);
+
+//----------------------------------------------------------------------------------------------------------------
+
+unsigned long long ExprCacheKey(const char *function, const char *var)
+{
+    assert(function && var);
+
+    char *canonical = (char *)calloc(strlen(function) + 1, sizeof(char));
+    size_t len = CanonicalText(function, canonical);
+
+    unsigned long long hash = FnvHash(canonical, len);
+    hash = FnvHash(var, strnlen(var, MAX_VAR_NAME_LEN), FnvHash("|", 1, hash));
+
+    free(canonical);
+    return hash;
+}
+
+bool ExprCacheLoad(const char *dir, const char *function, const char *var, int count, CachedAnalysis *analysis)
+{
+    assert(dir && function && var && analysis);
+
+    METRICS_SCOPE("cache load");
+
+    *analysis = {};
+
+    char path[MAX_CACHE_PATH_LEN] = "";
+    snprintf(path, MAX_CACHE_PATH_LEN, CACHE_ENTRY_PATH, dir, ExprCacheKey(function, var));
+
+    FILE *entry = fopen(path, "rb");
+    if (entry == nullptr) {return false;}
+
+    size_t file_size = (size_t)getFileSize(entry);
+    char  *data      = (char *)calloc(file_size + 1, sizeof(char));
+    size_t read      = (data != nullptr) ? fread(data, sizeof(char), file_size, entry) : 0;
+    fclose(entry);
+
+    unsigned long long checksum = 0;
+    if (read != file_size || file_size < sizeof(checksum))
+    {
+        free(data);
+        return false;
+    }
+
+    memcpy(&checksum, data + file_size - sizeof(checksum), sizeof(checksum));
+    if (checksum != FnvHash(data, file_size - sizeof(checksum)))
+    {
+        printf("Expression cache: entry %s is damaged, ignoring it.\n", path);
+        free(data);
+        return false;
+    }
+
+    FILE *stream = fmemopen(data, file_size - sizeof(checksum), "rb");
+
+    char *canonical = (char *)calloc(strlen(function) + 1, sizeof(char));
+    size_t canonical_len = CanonicalText(function, canonical);
+
+    uint32_t    stored  = 0;
+    CompactTree compact = {};
+    CompactTreeCtor(&compact);
+
+    bool isValid = (stream != nullptr) && ReadHeader(stream, canonical, canonical_len, var, &stored);
+
+    if (isValid)
+    {
+        analysis->count       = ((int)stored < count) ? (int)stored : count;
+        analysis->derivatives = (Node **)calloc(analysis->count + 1, sizeof(Node *));
+        analysis->parsed      = ReadTree(stream, &compact);
+        analysis->function    = ReadTree(stream, &compact);
+
+        isValid = analysis->derivatives && analysis->parsed && analysis->function;
+
+        for (int i = 0; isValid && i < analysis->count; i++)
+        {
+            analysis->derivatives[i] = ReadTree(stream, &compact);
+            isValid = (analysis->derivatives[i] != nullptr);
+        }
+    }
+
+    if (!isValid)
+    {
+        CachedAnalysisDtor(analysis);
+    }
+
+    CompactTreeDtor(&compact);
+    free(canonical);
+    if (stream != nullptr) {fclose(stream);}
+    free(data);
+
+    return isValid;
+}
+
+bool ExprCacheStore(const char *dir, const char *function, const char *var,
+                    const Node *parsed, const Node *optimized, const Node *const *derivatives, int count)
+{
+    assert(dir && function && var && parsed && optimized && (derivatives || count == 0));
+
+    METRICS_SCOPE("cache store");
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Expression cache: error creating directory %s.\n", dir);
+        return false;
+    }
+
+    char  *buffer      = nullptr;
+    size_t buffer_size = 0;
+    FILE  *stream      = open_memstream(&buffer, &buffer_size);
+    if (stream == nullptr) {return false;}
+
+    char *canonical = (char *)calloc(strlen(function) + 1, sizeof(char));
+    uint32_t canonical_len = (uint32_t)CanonicalText(function, canonical);
+
+    char var_name[MAX_VAR_NAME_LEN] = "";
+    memcpy(var_name, var, strnlen(var, MAX_VAR_NAME_LEN));
+
+    uint32_t stored = (uint32_t)count;
+
+    CompactTree compact = {};
+    CompactTreeCtor(&compact);
+
+    bool isWritten = fwrite(CACHE_MAGIC,    sizeof(CACHE_MAGIC), 1,             stream) == 1             &&
+                     fwrite(&CACHE_VERSION, sizeof(uint32_t),    1,             stream) == 1             &&
+                     fwrite(&canonical_len, sizeof(uint32_t),    1,             stream) == 1             &&
+                     fwrite(canonical,      sizeof(char),        canonical_len, stream) == canonical_len &&
+                     fwrite(var_name,       MAX_VAR_NAME_LEN,    1,             stream) == 1             &&
+                     fwrite(&stored,        sizeof(uint32_t),    1,             stream) == 1             &&
+                     WriteTree(stream, &compact, parsed)                                                 &&
+                     WriteTree(stream, &compact, optimized);
+
+    for (int i = 0; isWritten && i < count; i++)
+    {
+        isWritten = WriteTree(stream, &compact, derivatives[i]);
+    }
+
+    CompactTreeDtor(&compact);
+    free(canonical);
+    fclose(stream);
+
+    unsigned long long key = ExprCacheKey(function, var);
+
+    char path    [MAX_CACHE_PATH_LEN] = "";
+    char tmp_path[MAX_CACHE_PATH_LEN] = "";
+    snprintf(path,     MAX_CACHE_PATH_LEN, CACHE_ENTRY_PATH,     dir, key);
+    snprintf(tmp_path, MAX_CACHE_PATH_LEN, CACHE_TMP_ENTRY_PATH, dir, key, (int)getpid(), StoreCounter++);
+
+    FILE *entry = isWritten ? fopen(tmp_path, "wb") : nullptr;
+    if (entry != nullptr)
+    {
+        unsigned long long checksum = FnvHash(buffer, buffer_size);
+
+        isWritten = fwrite(buffer,    sizeof(char), buffer_size, entry) == buffer_size &&
+                    fwrite(&checksum, sizeof(checksum), 1,       entry) == 1;
+        isWritten = (fclose(entry) == 0) && isWritten;
+
+        isWritten = isWritten && rename(tmp_path, path) == 0;
+        if (!isWritten)
+        {
+            unlink(tmp_path);
+        }
+    }
+    else
+    {
+        isWritten = false;
+    }
+
+    free(buffer);
+
+    if (!isWritten)
+    {
+        printf("Expression cache: error writing entry %s.\n", path);
+    }
+
+    return isWritten;
+}
+
+void CachedAnalysisDtor(CachedAnalysis *analysis)
+{
+    if (analysis == nullptr) {return;}
+
+    treeDtor(analysis->parsed);
+    treeDtor(analysis->function);
+
+    if (analysis->derivatives != nullptr)
+    {
+        for (int i = 0; i < analysis->count; i++)
+        {
+            treeDtor(analysis->derivatives[i]);
+        }
+        free(analysis->derivatives);
+    }
+
+    *analysis = {};
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static size_t CanonicalText(const char *function, char *canonical)
+{
+    size_t len = 0;
+
+    for (; *function != '\0'; function++)
+    {
+        if (*function != ' ' && *function != '\t' && *function != '\n' && *function != '\r')
+        {
+            canonical[len++] = *function;
+        }
+    }
+    canonical[len] = '\0';
+
+    return len;
+}
+
+static unsigned long long FnvHash(const void *data, size_t size, unsigned long long hash)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static bool WriteTree(FILE *stream, CompactTree *compact, const Node *node)
+{
+    return compactFromNode(compact, node) && compactWrite(stream, compact);
+}
+
+static Node *ReadTree(FILE *stream, CompactTree *compact)
+{
+    if (!compactRead(stream, compact) || compact->size == 0) {return nullptr;}
+
+    return nodeFromCompact(compact);
+}
+
+static bool ReadHeader(FILE *stream, const char *canonical, size_t canonical_len, const char *var, uint32_t *count)
+{
+    char     magic[sizeof(CACHE_MAGIC)]  = {};
+    char     var_name[MAX_VAR_NAME_LEN]  = "";
+    uint32_t version  = 0;
+    uint32_t text_len = 0;
+
+    if (fread(magic,     sizeof(magic),    1, stream) != 1 || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&version,  sizeof(uint32_t), 1, stream) != 1 || version  != CACHE_VERSION                     ||
+        fread(&text_len, sizeof(uint32_t), 1, stream) != 1 || text_len != canonical_len)
+    {
+        return false;
+    }
+
+    char *text = (char *)calloc(text_len + 1, sizeof(char));
+    bool isSameText = text != nullptr && fread(text, sizeof(char), text_len, stream) == text_len &&
+                      memcmp(text, canonical, text_len) == 0;
+    free(text);
+
+    return isSameText                                                    &&
+           fread(var_name, MAX_VAR_NAME_LEN, 1, stream) == 1             &&
+           strncmp(var_name, var, MAX_VAR_NAME_LEN) == 0                 &&
+           fread(count, sizeof(uint32_t), 1, stream) == 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------
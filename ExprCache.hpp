@@ -0,0 +1,51 @@
+#ifndef EXPR_CACHE_HPP
+#define EXPR_CACHE_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const char *const EXPR_CACHE_DIR = "./Cache";
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Trees of one analysed function: the tree as it was parsed,
+//! the simplified tree and its simplified derivatives
+//! (derivatives[i] is the derivative of order i + 1)
+//-----------------------------------------------------------
+struct CachedAnalysis
+{
+    Node  *parsed      = nullptr;
+    Node  *function    = nullptr;
+    Node **derivatives = nullptr;
+    int    count       = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+unsigned long long ExprCacheKey(const char *function, const char *var);
+
+//-----------------------------------------------------------
+//! Load up to 'count' derivatives of the function from the
+//! cache directory. Returns false if there is no valid entry.
+//! analysis->count may be less than 'count' if fewer orders
+//! were stored.
+//-----------------------------------------------------------
+bool ExprCacheLoad  (const char *dir, const char *function, const char *var, int count, CachedAnalysis *analysis);
+
+//-----------------------------------------------------------
+//! Store the trees of the function. The entry is written to a
+//! temporary file and renamed, so readers never see a partly
+//! written entry.
+//-----------------------------------------------------------
+bool ExprCacheStore (const char *dir, const char *function, const char *var,
+                     const Node *parsed, const Node *optimized, const Node *const *derivatives, int count);
+
+void CachedAnalysisDtor(CachedAnalysis *analysis);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //EXPR_CACHE_HPP
@@ -0,0 +1,658 @@
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "FastMath.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Values are copied to a chunk, so that arguments out of range can be redone by libm when x and y are one array
+static const size_t FAST_MATH_CHUNK = 64;
+
+//1.5*2^52: adding it rounds a double below 2^51 to an integer, which is then in the low bits of the sum
+static const double   ROUND_SHIFTER      = 6755399441055744.0;
+static const uint64_t ROUND_SHIFTER_BITS = 0x4338000000000000;
+
+//pi/2 in four parts, the first three have 33 bits, so k*PIO2_n is exact for k < 2^20
+static const double TWO_OVER_PI  = 6.36619772367581382433e-01;
+static const double PIO2_1       = 1.57079632673412561417e+00;
+static const double PIO2_2       = 6.07710050630396597660e-11;
+static const double PIO2_3       = 2.02226624871116645580e-21;
+static const double PIO2_3T      = 8.47842766036889956997e-32;
+static const double TRIG_MAX_ARG = 8e5;
+
+static const double PI_2_HI   = 1.57079632679489655800e+00;
+static const double PI_2_LO   = 6.12323399573676603587e-17;
+static const double PI_4_HI   = 7.85398163397448278999e-01;
+static const double PI_4_LO   = 3.06161699786838301793e-17;
+static const double TAN_PI_8  = 4.14213562373095034e-01;
+static const double TAN_3PI_8 = 2.41421356237309492e+00;
+
+static const double LN2_HI      = 6.93147180369123816490e-01;
+static const double LN2_LO      = 1.90821492927058770002e-10;
+static const double INV_LN2     = 1.44269504088896338700e+00;
+static const double EXP_MAX_ARG = 700;
+
+//x^n with the same integer n for all points is done by multiplication up to this |n|
+static const int POW_MAX_PRODUCT = 4;
+
+//Bits of ln(x) = e*ln2 + ln(m) are split so that m is in [sqrt(2)/2, sqrt(2))
+static const uint64_t LOG_MANTISSA_MASK   = 0x000fffffffffffff;
+static const uint64_t LOG_SQRT_HALF_BITS  = 0x3fe6a09e00000000;
+static const uint64_t LOG_ONE_BITS        = 0x3ff0000000000000;
+static const uint64_t EXPONENT_SHIFT_BITS = 0x4330000000000000;
+static const double   EXPONENT_SHIFT      = 4503599627370496.0 + 1023;
+
+//Minimax coefficients of fdlibm (k_sin.c, k_cos.c, s_atan.c, e_log.c, e_exp.c)
+static const double S1 = -1.66666666666666324348e-01;
+static const double S2 =  8.33333333332248946124e-03;
+static const double S3 = -1.98412698298579493134e-04;
+static const double S4 =  2.75573137070700676789e-06;
+static const double S5 = -2.50507602534068634195e-08;
+static const double S6 =  1.58969099521155010221e-10;
+
+static const double C1 =  4.16666666666666019037e-02;
+static const double C2 = -1.38888888888741095749e-03;
+static const double C3 =  2.48015872894767294178e-05;
+static const double C4 = -2.75573143513906633035e-07;
+static const double C5 =  2.08757232129817482790e-09;
+static const double C6 = -1.13596475577881948265e-11;
+
+static const double AT[] =
+{
+     3.33333333333329318027e-01,
+    -1.99999999998764832476e-01,
+     1.42857142725034663711e-01,
+    -1.11111104054623557880e-01,
+     9.09088713343650656196e-02,
+    -7.69187620504482999495e-02,
+     6.66107313738753120669e-02,
+    -5.83357013379057348645e-02,
+     4.97687799461593236017e-02,
+    -3.65315727442169155270e-02,
+     1.62858201153657823623e-02,
+};
+
+//Fast tier of arctan on [0, tan(pi/8)]: Chebyshev fit of the same form, within 1e-10 relative
+static const double AT_FAST[] =
+{
+     3.33333332792548009404e-01,
+    -1.99999772586883867165e-01,
+     1.42841511936286136297e-01,
+    -1.10713650218847936557e-01,
+     8.62467614524949355292e-02,
+    -5.04813851207974451096e-02,
+};
+
+static const double LG1 = 6.666666666666735130e-01;
+static const double LG2 = 3.999999999940941908e-01;
+static const double LG3 = 2.857142874366239149e-01;
+static const double LG4 = 2.222219843214978396e-01;
+static const double LG5 = 1.818357216161805012e-01;
+static const double LG6 = 1.531383769920937332e-01;
+static const double LG7 = 1.479819860511658591e-01;
+
+static const double P1 =  1.66666666666666019037e-01;
+static const double P2 = -2.77777777770155933842e-03;
+static const double P3 =  6.61375632143793436117e-05;
+static const double P4 = -1.65339022054652515390e-06;
+static const double P5 =  4.13813679705723846039e-08;
+
+//----------------------------------------------------------------------------------------------------------------
+
+typedef void   (*ArrayKernel)(const double *x, double *y, size_t count, bool isFast);
+typedef double (*LibmFunc)   (double x);
+
+static void   RunKernel      (const double *x, double *y, size_t count, MathAccuracy accuracy, ArrayKernel kernel,
+                              LibmFunc libm, double min_arg, double max_arg);
+
+static void   SinKernel      (const double *x, double *y, size_t count, bool isFast);
+static void   CosKernel      (const double *x, double *y, size_t count, bool isFast);
+static void   TanKernel      (const double *x, double *y, size_t count, bool isFast);
+static void   CotKernel      (const double *x, double *y, size_t count, bool isFast);
+static void   ArcsinKernel   (const double *x, double *y, size_t count, bool isFast);
+static void   ArccosKernel   (const double *x, double *y, size_t count, bool isFast);
+static void   ArctanKernel   (const double *x, double *y, size_t count, bool isFast);
+static void   ArccotKernel   (const double *x, double *y, size_t count, bool isFast);
+static void   LnKernel       (const double *x, double *y, size_t count, bool isFast);
+
+static bool   isSamePower    (const double *power, size_t count, int *exponent);
+static void   ProductPow     (const double *base, double *y, size_t count, int exponent);
+
+static inline double SinValue    (double x, bool isFast);
+static inline double CosValue    (double x, bool isFast);
+static inline double TanValue    (double x, bool isFast);
+static inline double CotValue    (double x, bool isFast);
+static inline double ArcsinValue (double x, bool isFast);
+static inline double ArccosValue (double x, bool isFast);
+static inline double ArctanValue (double x, bool isFast);
+static inline double ArccotValue (double x, bool isFast);
+
+static inline double ReduceTrig (double x, double *tail, uint64_t *quadrant);
+static inline double SinPoly    (double x, double tail, bool isFast);
+static inline double CosPoly    (double x, double tail, bool isFast);
+static inline double AtanPoly   (double x, bool isFast);
+static inline double LnPoly     (double x, bool isFast);
+static inline double ExpPoly    (double x);
+
+static double LibmSin    (double x);
+static double LibmCos    (double x);
+static double LibmTan    (double x);
+static double LibmCot    (double x);
+static double LibmArcsin (double x);
+static double LibmArccos (double x);
+static double LibmArctan (double x);
+static double LibmArccot (double x);
+static double LibmLn     (double x);
+
+//----------------------------------------------------------------------------------------------------------------
+
+void FastSin(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, SinKernel, LibmSin, -TRIG_MAX_ARG, TRIG_MAX_ARG);
+}
+
+void FastCos(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, CosKernel, LibmCos, -TRIG_MAX_ARG, TRIG_MAX_ARG);
+}
+
+void FastTan(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, TanKernel, LibmTan, -TRIG_MAX_ARG, TRIG_MAX_ARG);
+}
+
+void FastCot(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, CotKernel, LibmCot, -TRIG_MAX_ARG, TRIG_MAX_ARG);
+}
+
+void FastArcsin(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, ArcsinKernel, LibmArcsin, -1, 1);
+}
+
+void FastArccos(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, ArccosKernel, LibmArccos, -1, 1);
+}
+
+void FastArctan(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, ArctanKernel, LibmArctan, -HUGE_VAL, HUGE_VAL);
+}
+
+void FastArccot(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, ArccotKernel, LibmArccot, -HUGE_VAL, HUGE_VAL);
+}
+
+void FastLn(const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    RunKernel(x, y, count, accuracy, LnKernel, LibmLn, DBL_MIN, DBL_MAX);
+}
+
+void FastSqrt(const double *x, double *y, size_t count)
+{
+    assert((x && y) || count == 0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        y[i] = sqrt(x[i]);
+    }
+}
+
+void FastPow(const double *base, const double *power, double *y, size_t count, MathAccuracy accuracy)
+{
+    assert((base && power && y) || count == 0);
+
+    int exponent = 0;
+    if (accuracy != MATH_EXACT && isSamePower(power, count, &exponent))
+    {
+        ProductPow(base, y, count, exponent);
+        return;
+    }
+
+    if (accuracy != MATH_FAST)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            y[i] = pow(base[i], power[i]);
+        }
+        return;
+    }
+
+    double bases [FAST_MATH_CHUNK] = {};
+    double powers[FAST_MATH_CHUNK] = {};
+    double logs  [FAST_MATH_CHUNK] = {};
+
+    for (size_t start = 0; start < count; start += FAST_MATH_CHUNK)
+    {
+        size_t size = (count - start < FAST_MATH_CHUNK) ? count - start : FAST_MATH_CHUNK;
+
+        memcpy(bases,  base  + start, size * sizeof(double));
+        memcpy(powers, power + start, size * sizeof(double));
+
+        LnKernel(bases, logs, size, false);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            y[start + i] = ExpPoly(powers[i] * logs[i]);
+        }
+
+        for (size_t i = 0; i < size; i++)
+        {
+            if (!(bases[i] >= DBL_MIN && bases[i] <= DBL_MAX && fabs(powers[i] * logs[i]) <= EXP_MAX_ARG))
+            {
+                y[start + i] = pow(bases[i], powers[i]);
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Arguments outside [min_arg, max_arg], NaN and zeros (for
+//! the sign of the result) are redone by libm after the kernel
+//-----------------------------------------------------------
+static void RunKernel(const double *x, double *y, size_t count, MathAccuracy accuracy, ArrayKernel kernel,
+                      LibmFunc libm, double min_arg, double max_arg)
+{
+    assert((x && y) || count == 0);
+
+    if (accuracy == MATH_EXACT)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            y[i] = libm(x[i]);
+        }
+        return;
+    }
+
+    double args[FAST_MATH_CHUNK] = {};
+
+    for (size_t start = 0; start < count; start += FAST_MATH_CHUNK)
+    {
+        size_t size = (count - start < FAST_MATH_CHUNK) ? count - start : FAST_MATH_CHUNK;
+
+        memcpy(args, x + start, size * sizeof(double));
+
+        kernel(args, y + start, size, accuracy == MATH_FAST);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            if (!(args[i] >= min_arg && args[i] <= max_arg) || args[i] == 0) {y[start + i] = libm(args[i]);}
+        }
+    }
+}
+
+static bool isSamePower(const double *power, size_t count, int *exponent)
+{
+    if (count == 0 || !(fabs(power[0]) <= POW_MAX_PRODUCT) || power[0] != (int)power[0]) {return false;}
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if (power[i] != power[0]) {return false;}
+    }
+
+    *exponent = (int)power[0];
+    return true;
+}
+
+//-----------------------------------------------------------
+//! At most two roundings more than libm for |exponent| <= 4
+//-----------------------------------------------------------
+static void ProductPow(const double *base, double *y, size_t count, int exponent)
+{
+    switch (abs(exponent))
+    {
+    case 0:
+        for (size_t i = 0; i < count; i++) {y[i] = 1;}
+        break;
+    case 1:
+        for (size_t i = 0; i < count; i++) {y[i] = base[i];}
+        break;
+    case 2:
+        for (size_t i = 0; i < count; i++) {y[i] = base[i] * base[i];}
+        break;
+    case 3:
+        for (size_t i = 0; i < count; i++) {y[i] = base[i] * base[i] * base[i];}
+        break;
+    default:
+        for (size_t i = 0; i < count; i++)
+        {
+            double square = base[i] * base[i];
+            y[i] = square * square;
+        }
+        break;
+    }
+
+    if (exponent < 0)
+    {
+        for (size_t i = 0; i < count; i++) {y[i] = 1 / y[i];}
+    }
+}
+
+static inline double SinValue(double x, bool isFast)
+{
+    double   tail     = 0;
+    uint64_t quadrant = 0;
+    double   r        = ReduceTrig(x, &tail, &quadrant);
+
+    double sine   = SinPoly(r, tail, isFast);
+    double cosine = CosPoly(r, tail, isFast);
+
+    double value = (quadrant & 1) ? cosine : sine;
+    return (quadrant & 2) ? -value : value;
+}
+
+static inline double CosValue(double x, bool isFast)
+{
+    double   tail     = 0;
+    uint64_t quadrant = 0;
+    double   r        = ReduceTrig(x, &tail, &quadrant);
+
+    double sine   = SinPoly(r, tail, isFast);
+    double cosine = CosPoly(r, tail, isFast);
+
+    double value = (quadrant & 1) ? sine : cosine;
+    return ((quadrant + 1) & 2) ? -value : value;
+}
+
+static inline double TanValue(double x, bool isFast)
+{
+    double   tail     = 0;
+    uint64_t quadrant = 0;
+    double   r        = ReduceTrig(x, &tail, &quadrant);
+
+    double sine   = SinPoly(r, tail, isFast);
+    double cosine = CosPoly(r, tail, isFast);
+
+    double tangent   = sine / cosine;
+    double cotangent = cosine / sine;
+    return (quadrant & 1) ? -cotangent : tangent;
+}
+
+static inline double CotValue(double x, bool isFast)
+{
+    double   tail     = 0;
+    uint64_t quadrant = 0;
+    double   r        = ReduceTrig(x, &tail, &quadrant);
+
+    double sine   = SinPoly(r, tail, isFast);
+    double cosine = CosPoly(r, tail, isFast);
+
+    double tangent   = sine / cosine;
+    double cotangent = cosine / sine;
+    return (quadrant & 1) ? -tangent : cotangent;
+}
+
+//-----------------------------------------------------------
+//! arcsin(x) = arctan(x / sqrt(1 - x^2)), the argument has a
+//! small relative error and arctan does not increase it
+//-----------------------------------------------------------
+static inline double ArcsinValue(double x, bool isFast)
+{
+    return AtanPoly(x / sqrt((1 - x) * (1 + x)), isFast);
+}
+
+//-----------------------------------------------------------
+//! arccos(x) = 2 arctan(sqrt((1 - x) / (1 + x))) keeps the
+//! relative accuracy near x = 1, unlike pi/2 - arcsin(x)
+//-----------------------------------------------------------
+static inline double ArccosValue(double x, bool isFast)
+{
+    return 2 * AtanPoly(sqrt((1 - x) / (1 + x)), isFast);
+}
+
+static inline double ArctanValue(double x, bool isFast)
+{
+    return AtanPoly(x, isFast);
+}
+
+static inline double ArccotValue(double x, bool isFast)
+{
+    return (PI_2_HI - AtanPoly(x, isFast)) + PI_2_LO;
+}
+
+//-----------------------------------------------------------
+//! Separate loops for the tiers, so that neither has a branch
+//-----------------------------------------------------------
+#define ARRAY_KERNEL(kernel, value)                                                    \
+    static void kernel(const double *x, double *y, size_t count, bool isFast)         \
+    {                                                                                  \
+        if (isFast) {for (size_t i = 0; i < count; i++) {y[i] = value(x[i], true );}}  \
+        else        {for (size_t i = 0; i < count; i++) {y[i] = value(x[i], false);}}  \
+    }
+
+ARRAY_KERNEL(SinKernel,    SinValue   )
+ARRAY_KERNEL(CosKernel,    CosValue   )
+ARRAY_KERNEL(TanKernel,    TanValue   )
+ARRAY_KERNEL(CotKernel,    CotValue   )
+ARRAY_KERNEL(ArcsinKernel, ArcsinValue)
+ARRAY_KERNEL(ArccosKernel, ArccosValue)
+ARRAY_KERNEL(ArctanKernel, ArctanValue)
+ARRAY_KERNEL(ArccotKernel, ArccotValue)
+ARRAY_KERNEL(LnKernel,     LnPoly     )
+
+#undef ARRAY_KERNEL
+
+//-----------------------------------------------------------
+//! x = k*pi/2 + r + tail, |r| <= pi/4. Returns r, the low two
+//! bits of quadrant are k mod 4.
+//-----------------------------------------------------------
+static inline double ReduceTrig(double x, double *tail, uint64_t *quadrant)
+{
+    double shifted = x * TWO_OVER_PI + ROUND_SHIFTER;
+    memcpy(quadrant, &shifted, sizeof(*quadrant));
+
+    double k  = shifted - ROUND_SHIFTER;
+    double hi = x - k * PIO2_1;
+
+    //Two exact subtractions of k*PIO2_2 and k*PIO2_3, errors go to the tail
+    double w2 = k * PIO2_2;
+    double r2 = hi - w2;
+    double b2 = r2 - hi;
+    double e2 = (hi - (r2 - b2)) - (w2 + b2);
+
+    double w3 = k * PIO2_3;
+    double r3 = r2 - w3;
+    double b3 = r3 - r2;
+    double e3 = (r2 - (r3 - b3)) - (w3 + b3);
+
+    double lo = (e2 + e3) - k * PIO2_3T;
+    double r  = r3 + lo;
+
+    *tail = (r3 - r) + lo;
+    return r;
+}
+
+//-----------------------------------------------------------
+//! sin(x + tail) and cos(x + tail) for |x| <= pi/4. The fast
+//! tier is Taylor series up to x^9 and x^10.
+//-----------------------------------------------------------
+static inline double SinPoly(double x, double tail, bool isFast)
+{
+    double z = x * x;
+
+    if (isFast)
+    {
+        return x + x * z * (-1.0/6 + z * (1.0/120 + z * (-1.0/5040 + z * (1.0/362880))));
+    }
+
+    double w = z * z;
+    double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+    double v = z * x;
+
+    return x - ((z * (0.5 * tail - v * r) - tail) - v * S1);
+}
+
+static inline double CosPoly(double x, double tail, bool isFast)
+{
+    double z = x * x;
+
+    if (isFast)
+    {
+        return 1 + z * (-0.5 + z * (1.0/24 + z * (-1.0/720 + z * (1.0/40320 + z * (-1.0/3628800)))));
+    }
+
+    double w  = z * z;
+    double r  = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+    double hz = 0.5 * z;
+    double v  = 1 - hz;
+
+    return v + (((1 - v) - hz) + (z * r - x * tail));
+}
+
+//-----------------------------------------------------------
+//! |x| >= tan(3pi/8) is reduced by arctan(x) = pi/2 -
+//! arctan(1/x), |x| > tan(pi/8) by arctan(x) = pi/4 +
+//! arctan((x-1)/(x+1)), so there is one division. The fast
+//! tier has 6 coefficients instead of 11.
+//-----------------------------------------------------------
+static inline double AtanPoly(double x, bool isFast)
+{
+    double a       = fabs(x);
+    bool   isInv   = a >= TAN_3PI_8;
+    bool   isShift = a > TAN_PI_8 && !isInv;
+    double u       = (isInv ? 1 : (isShift ? a - 1 : a)) / (isInv ? a : (isShift ? a + 1 : 1));
+
+    double z  = u * u;
+    double w  = z * z;
+    double s1 = 0;
+    double s2 = 0;
+
+    if (isFast)
+    {
+        s1 = z * (AT_FAST[0] + w * (AT_FAST[2] + w * AT_FAST[4]));
+        s2 = w * (AT_FAST[1] + w * (AT_FAST[3] + w * AT_FAST[5]));
+    }
+    else
+    {
+        s1 = z * (AT[0] + w * (AT[2] + w * (AT[4] + w * (AT[6] + w * (AT[8] + w * AT[10])))));
+        s2 = w * (AT[1] + w * (AT[3] + w * (AT[5] + w * (AT[7] + w * AT[9]))));
+    }
+
+    double angle = u - u * (s1 + s2);
+    angle = isShift ? PI_4_HI + (angle + PI_4_LO) : angle;
+    angle = isInv   ? PI_2_HI - (angle - PI_2_LO) : angle;
+
+    return copysign(angle, x);
+}
+
+//-----------------------------------------------------------
+//! ln(2^e * m) = e*ln2 + 2 atanh(s), s = (m-1)/(m+1). Only
+//! positive normal x, others are redone by libm.
+//-----------------------------------------------------------
+static inline double LnPoly(double x, bool isFast)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &x, sizeof(bits));
+
+    bits += LOG_ONE_BITS - LOG_SQRT_HALF_BITS;
+
+    uint64_t exponent_bits = (bits >> 52) | EXPONENT_SHIFT_BITS;
+    uint64_t mantissa_bits = (bits & LOG_MANTISSA_MASK) + LOG_SQRT_HALF_BITS;
+
+    double e = 0;
+    double m = 0;
+    memcpy(&e, &exponent_bits, sizeof(e));
+    memcpy(&m, &mantissa_bits, sizeof(m));
+    e -= EXPONENT_SHIFT;
+
+    double f    = m - 1;
+    double hfsq = 0.5 * f * f;
+    double s    = f / (2 + f);
+    double z    = s * s;
+    double R    = 0;
+
+    if (isFast)
+    {
+        R = z * (2.0/3 + z * (2.0/5 + z * (2.0/7 + z * (2.0/9))));
+    }
+    else
+    {
+        double w  = z * z;
+        double t1 = w * (LG2 + w * (LG4 + w * LG6));
+        double t2 = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7)));
+        R = t1 + t2;
+    }
+
+    return e * LN2_HI - ((hfsq - (s * (hfsq + R) + e * LN2_LO)) - f);
+}
+
+//-----------------------------------------------------------
+//! exp(x) for |x| <= EXP_MAX_ARG, 2^k is put together from bits
+//-----------------------------------------------------------
+static inline double ExpPoly(double x)
+{
+    double   shifted = x * INV_LN2 + ROUND_SHIFTER;
+    uint64_t bits    = 0;
+    memcpy(&bits, &shifted, sizeof(bits));
+
+    double k  = shifted - ROUND_SHIFTER;
+    double hi = x - k * LN2_HI;
+    double lo = k * LN2_LO;
+    double r  = hi - lo;
+
+    double z = r * r;
+    double c = r - z * (P1 + z * (P2 + z * (P3 + z * (P4 + z * P5))));
+    double v = 1 - ((lo - (r * c) / (2 - c)) - hi);
+
+    uint64_t scale_bits = (bits - ROUND_SHIFTER_BITS + 1023) << 52;
+    double   scale      = 0;
+    memcpy(&scale, &scale_bits, sizeof(scale));
+
+    return v * scale;
+}
+
+static double LibmSin(double x)
+{
+    return sin(x);
+}
+
+static double LibmCos(double x)
+{
+    return cos(x);
+}
+
+static double LibmTan(double x)
+{
+    return tan(x);
+}
+
+static double LibmCot(double x)
+{
+    return 1 / tan(x);
+}
+
+static double LibmArcsin(double x)
+{
+    return asin(x);
+}
+
+static double LibmArccos(double x)
+{
+    return acos(x);
+}
+
+static double LibmArctan(double x)
+{
+    return atan(x);
+}
+
+static double LibmArccot(double x)
+{
+    return M_PI_2 - atan(x);
+}
+
+static double LibmLn(double x)
+{
+    return log(x);
+}
+
+//----------------------------------------------------------------------------------------------------------------
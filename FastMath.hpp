@@ -0,0 +1,66 @@
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Accuracy of the array kernels below.
+//!
+//! MATH_EXACT   - libm, one call per value.
+//! MATH_PRECISE - own polynomial kernels, within 3 ulp.
+//! MATH_FAST    - shorter polynomials where they help, within
+//!                1e-8 relative (absolute near zeros of the
+//!                function).
+//!
+//! Kernels are branch-free loops, so the compiler can
+//! vectorize them. Arguments out of the range of a kernel
+//! (huge, infinite, NaN, subnormal) are done by libm. They
+//! beat libm only when built with the flags of
+//! LibBuild/FastMath.o in the makefile, so plots and samples
+//! use MATH_EXACT unless a faster tier is chosen.
+//-----------------------------------------------------------
+enum MathAccuracy
+{
+    MATH_EXACT,
+    MATH_PRECISE,
+    MATH_FAST,
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! y[i] = f(x[i]), x and y may be the same array. The values
+//! match the scalar evaluator: cot(x) = 1/tan(x) and
+//! arccot(x) = pi/2 - arctan(x).
+//-----------------------------------------------------------
+void FastSin    (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastCos    (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastTan    (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastCot    (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastArcsin (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastArccos (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastArctan (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastArccot (const double *x, double *y, size_t count, MathAccuracy accuracy);
+void FastLn     (const double *x, double *y, size_t count, MathAccuracy accuracy);
+
+//-----------------------------------------------------------
+//! sqrt is correctly rounded by the processor, it has no
+//! tiers
+//-----------------------------------------------------------
+void FastSqrt   (const double *x, double *y, size_t count);
+
+//-----------------------------------------------------------
+//! y[i] = base[i]^power[i]. If all powers are one integer
+//! n, |n| <= 4, both own tiers multiply. Otherwise
+//! MATH_PRECISE is libm, as exp(power*ln(base)) loses up to
+//! 10 bits, and MATH_FAST uses it for positive bases.
+//-----------------------------------------------------------
+void FastPow    (const double *base, const double *power, double *y, size_t count, MathAccuracy accuracy);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //FAST_MATH_HPP
@@ -0,0 +1,414 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "InputFile.hpp"
+#include "Metrics.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int    MAX_NUMBER_LEN  = 64;
+static const size_t READ_CHUNK_SIZE = 1 << 16;
+
+static const char  *JOB_KEY         = "func";
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool        ReadStream    (InputFile *file, FILE *input);
+static bool        ReadLine      (InputFile *file, const char **begin, const char **end);
+static bool        isJobLine     (const char *begin, const char *end);
+static bool        ReadField     (InputFile *file, const char *begin, const char *end, AnalysisRequest *request,
+                                  int offset);
+static bool        ReadJob       (InputFile *file, const char *begin, const char *end, AnalysisRequest *request);
+static int         ReadList      (const char *text, const char *end, double *list, int capacity);
+static bool        ReadNumber    (const char **text, const char *end, double *value);
+static bool        ReadInt       (const char *text, const char *end, int *value);
+static bool        ReservePoints (InputFile *file, int count);
+static const char *SkipSpaces    (const char *text, const char *end);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool InputFileCtor(InputFile *file, FILE *input)
+{
+    assert(file);
+
+    *file = {};
+
+    if (input == nullptr)
+    {
+        fprintf(stderr, "Error opening input file.\n");
+        return false;
+    }
+
+    struct stat info = {};
+    if (fstat(fileno(input), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+            file->data     = (const char *)data;
+            file->size     = info.st_size;
+            file->isMapped = true;
+        }
+    }
+
+    if (!file->isMapped && !ReadStream(file, input)) {return false;}
+
+    if (file->size == 0)
+    {
+        fprintf(stderr, "Error in input file. The file is empty.\n");
+        InputFileDtor(file);
+        return false;
+    }
+
+    file->cursor = file->data;
+
+    //Header: the fields before the first job
+    const char *begin  = nullptr;
+    const char *end    = nullptr;
+    const char *cursor = file->cursor;
+    int         line   = file->line;
+
+    while (ReadLine(file, &begin, &end) && !isJobLine(begin, end))
+    {
+        ReadField(file, begin, end, &file->defaults, 0);
+
+        cursor = file->cursor;
+        line   = file->line;
+    }
+    file->cursor = cursor;
+    file->line   = line;
+
+    if (file->defaults.number_of_points == 0)
+    {
+        if (!ReservePoints(file, 1)) {return false;}
+
+        file->points[0] = file->defaults.point;
+        file->defaults.number_of_points = 1;
+    }
+
+    return true;
+}
+
+void InputFileDtor(InputFile *file)
+{
+    if (file == nullptr) {return;}
+
+    if (file->isMapped)
+    {
+        munmap((void *)file->data, file->size);
+    }
+    else
+    {
+        free((void *)file->data);
+    }
+    free(file->points);
+
+    *file = {};
+}
+
+bool InputFileNext(InputFile *file, AnalysisRequest *request)
+{
+    assert(file && request);
+
+    const char *begin = nullptr;
+    const char *end   = nullptr;
+
+    while (ReadLine(file, &begin, &end))
+    {
+        METRICS_SCOPE("input job");
+
+        *request = file->defaults;
+        request->points = nullptr;
+
+        if (ReadJob(file, begin, end, request)) {return true;}
+    }
+
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool ReadStream(InputFile *file, FILE *input)
+{
+    char   *data     = nullptr;
+    size_t  size     = 0;
+    size_t  capacity = 0;
+    size_t  read     = 0;
+
+    do
+    {
+        if (size + READ_CHUNK_SIZE > capacity)
+        {
+            capacity = 2 * capacity + READ_CHUNK_SIZE;
+
+            char *new_data = (char *)realloc(data, capacity);
+            if (new_data == nullptr)
+            {
+                fprintf(stderr, "Error allocating memory for the input file.\n");
+                free(data);
+                return false;
+            }
+            data = new_data;
+        }
+
+        read  = fread(data + size, sizeof(char), READ_CHUNK_SIZE, input);
+        size += read;
+    }
+    while (read == READ_CHUNK_SIZE);
+
+    file->data = data;
+    file->size = size;
+
+    return true;
+}
+
+//-----------------------------------------------------------
+//! Next line that is not blank or a '#' comment, without the
+//! line break and the spaces around it
+//-----------------------------------------------------------
+static bool ReadLine(InputFile *file, const char **begin, const char **end)
+{
+    const char *file_end = file->data + file->size;
+
+    while (file->cursor < file_end)
+    {
+        const char *line_end = (const char *)memchr(file->cursor, '\n', file_end - file->cursor);
+        if (line_end == nullptr) {line_end = file_end;}
+
+        const char *line_begin = SkipSpaces(file->cursor, line_end);
+
+        file->cursor = (line_end < file_end) ? line_end + 1 : file_end;
+        file->line++;
+
+        while (line_end > line_begin && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r'))
+        {
+            line_end--;
+        }
+
+        if (line_begin == line_end || *line_begin == '#') {continue;}
+
+        *begin = line_begin;
+        *end   = line_end;
+        return true;
+    }
+
+    return false;
+}
+
+static bool isJobLine(const char *begin, const char *end)
+{
+    size_t key_len = strlen(JOB_KEY);
+
+    return (size_t)(end - begin) > key_len && strncmp(begin, JOB_KEY, key_len) == 0 && begin[key_len] == ':';
+}
+
+//-----------------------------------------------------------
+//! The "func:" line is given, the fields up to the next job
+//! are read. Lists of points go to file->points + offset.
+//-----------------------------------------------------------
+static bool ReadJob(InputFile *file, const char *begin, const char *end, AnalysisRequest *request)
+{
+    assert(isJobLine(begin, end));
+
+    int  job_line  = file->line;
+    bool isCorrect = true;
+
+    const char *function = SkipSpaces(begin + strlen(JOB_KEY) + 1, end);
+    size_t      length   = end - function;
+
+    if (length == 0 || length >= (size_t)MAX_FUNC_NAME_LEN)
+    {
+        fprintf(stderr, "Error in input file, line %d. The function is empty or longer than %d symbols.\n",
+                job_line, MAX_FUNC_NAME_LEN - 1);
+        isCorrect = false;
+    }
+    else
+    {
+        memcpy(request->function, function, length);
+        request->function[length] = '\0';
+    }
+
+    int offset = file->defaults.number_of_points;
+
+    const char *cursor = file->cursor;
+    int         line   = file->line;
+
+    while (ReadLine(file, &begin, &end) && !isJobLine(begin, end))
+    {
+        isCorrect = ReadField(file, begin, end, request, offset) && isCorrect;
+
+        cursor = file->cursor;
+        line   = file->line;
+    }
+    file->cursor = cursor;
+    file->line   = line;
+
+    request->points = (request->points == nullptr) ? file->points : file->points + offset;
+
+    if (!isCorrect)
+    {
+        fprintf(stderr, "Job of line %d is skipped.\n", job_line);
+    }
+
+    return isCorrect;
+}
+
+//-----------------------------------------------------------
+//! "key: value" line of a job or of the header
+//-----------------------------------------------------------
+static bool ReadField(InputFile *file, const char *begin, const char *end, AnalysisRequest *request, int offset)
+{
+    const char *colon = (const char *)memchr(begin, ':', end - begin);
+    if (colon == nullptr)
+    {
+        fprintf(stderr, "Error in input file, line %d. Expected 'key: value'.\n", file->line);
+        return false;
+    }
+
+    size_t      key_len = colon - begin;
+    const char *value   = colon + 1;
+
+    #define IS_KEY(name) (key_len == strlen(name) && strncmp(begin, name, key_len) == 0)
+
+    bool isCorrect = true;
+
+    if (IS_KEY("point"))
+    {
+        int capacity = 1;
+        for (const char *symbol = value; symbol < end; symbol++)
+        {
+            if (*symbol == ',') {capacity++;}
+        }
+
+        isCorrect = ReservePoints(file, offset + capacity) &&
+                    ReadList(value, end, file->points + offset, capacity) == capacity;
+        if (isCorrect)
+        {
+            request->point            = file->points[offset];
+            request->points           = file->points + offset;
+            request->number_of_points = capacity;
+        }
+    }
+    else if (IS_KEY("integral"))
+    {
+        isCorrect = (ReadList(value, end, request->integral, 2) == 2);
+        request->isIntegral = isCorrect;
+    }
+    else if (IS_KEY("count"))
+    {
+        isCorrect = ReadInt(value, end, &request->count) && request->count >= 0;
+    }
+    else if (IS_KEY("width"))
+    {
+        isCorrect = ReadInt(value, end, &request->width) && request->width > 0;
+    }
+    else if (IS_KEY("height"))
+    {
+        isCorrect = ReadInt(value, end, &request->height) && request->height > 0;
+    }
+    else
+    {
+        fprintf(stderr, "Error in input file, line %d. Unknown field '%.*s'.\n", file->line, (int)key_len, begin);
+        return false;
+    }
+
+    #undef IS_KEY
+
+    if (!isCorrect)
+    {
+        fprintf(stderr, "Error in input file, line %d. Wrong value of '%.*s'.\n", file->line, (int)key_len, begin);
+    }
+
+    return isCorrect;
+}
+
+//-----------------------------------------------------------
+//! Comma separated numbers. Returns their number, or -1 if
+//! the text is not such a list of at most 'capacity' numbers.
+//-----------------------------------------------------------
+static int ReadList(const char *text, const char *end, double *list, int capacity)
+{
+    int size = 0;
+
+    while (size < capacity && ReadNumber(&text, end, &list[size]))
+    {
+        size++;
+
+        text = SkipSpaces(text, end);
+        if (text == end)  {return size;}
+        if (*text != ',') {return -1;}
+        text++;
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------
+//! The number is copied out, the file is not terminated by
+//! '\0' and strtod could read past its end
+//-----------------------------------------------------------
+static bool ReadNumber(const char **text, const char *end, double *value)
+{
+    const char *begin = SkipSpaces(*text, end);
+
+    char   number[MAX_NUMBER_LEN] = "";
+    size_t length = 0;
+    while (begin + length < end && length + 1 < (size_t)MAX_NUMBER_LEN && strchr("+-.0123456789eE", begin[length]) &&
+           begin[length] != '\0')
+    {
+        number[length] = begin[length];
+        length++;
+    }
+    number[length] = '\0';
+
+    char *number_end = nullptr;
+    *value = strtod(number, &number_end);
+    if (number_end == number || !std::isfinite(*value)) {return false;}
+
+    *text = begin + (number_end - number);
+    return true;
+}
+
+static bool ReadInt(const char *text, const char *end, int *value)
+{
+    double number = 0;
+    if (!ReadNumber(&text, end, &number) || SkipSpaces(text, end) != end) {return false;}
+
+    if (number != floor(number) || fabs(number) > 1e9) {return false;}
+
+    *value = (int)number;
+    return true;
+}
+
+static bool ReservePoints(InputFile *file, int count)
+{
+    if (count <= file->capacity) {return true;}
+
+    int     capacity   = (count > 2 * file->capacity) ? count : 2 * file->capacity;
+    double *new_points = (double *)realloc(file->points, capacity * sizeof(double));
+    if (new_points == nullptr)
+    {
+        fprintf(stderr, "Error allocating memory for the points of the input file.\n");
+        return false;
+    }
+
+    file->points   = new_points;
+    file->capacity = capacity;
+
+    return true;
+}
+
+static const char *SkipSpaces(const char *text, const char *end)
+{
+    while (text < end && (*text == ' ' || *text == '\t' || *text == '\r')) {text++;}
+
+    return text;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,79 @@
+#ifndef INPUT_FILE_HPP
+#define INPUT_FILE_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int    MAX_FUNC_NAME_LEN = 100;
+
+//Fields of a job that are not given in the file or in its header
+static const double JOB_STD_POINT     = 0;
+static const int    JOB_STD_COUNT     = 3;
+static const int    JOB_STD_WIDTH     = 1;
+static const int    JOB_STD_HEIGHT    = 3;
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Fields of one job of an input file (see funcfile). points
+//! belongs to the InputFile and is valid until the next job.
+//-----------------------------------------------------------
+struct AnalysisRequest
+{
+    char    function[MAX_FUNC_NAME_LEN] = "";
+    double  point  = JOB_STD_POINT;
+    int     count  = JOB_STD_COUNT;
+    int     width  = JOB_STD_WIDTH;
+    int     height = JOB_STD_HEIGHT;
+
+    double *points           = nullptr;
+    int     number_of_points = 0;
+
+    bool    isIntegral  = false;
+    double  integral[2] = {};
+};
+
+//-----------------------------------------------------------
+//! Input file mapped into memory and the position of the next
+//! job in it. Fields before the first "func:" line are the
+//! header, they are the defaults of all jobs.
+//-----------------------------------------------------------
+struct InputFile
+{
+    const char     *data     = nullptr;
+    size_t          size     = 0;
+    bool            isMapped = false;
+
+    const char     *cursor   = nullptr;
+    int             line     = 0;
+
+    AnalysisRequest defaults = {};
+
+    double         *points   = nullptr;
+    int             capacity = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Maps the file with mmap. Streams that can not be mapped
+//! (pipes) are read into memory. Reads the header.
+//-----------------------------------------------------------
+bool InputFileCtor (InputFile *file, FILE *input);
+void InputFileDtor (InputFile *file);
+
+//-----------------------------------------------------------
+//! Next job of the file: a "func:" line and the fields after
+//! it, which override the header. The function is the only
+//! text copied. Jobs with errors are reported and skipped.
+//! Returns false at the end of the file.
+//-----------------------------------------------------------
+bool InputFileNext (InputFile *file, AnalysisRequest *request);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //INPUT_FILE_HPP
@@ -0,0 +1,477 @@
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "CompactTree.hpp"
+#include "Differentiator.hpp"
+#include "Integral.hpp"
+#include "Metrics.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Nodes of the 15-point Kronrod rule: the center and 7 pairs
+static const int    KRONROD_POINTS   = 15;
+static const int    KRONROD_PAIRS    = 7;
+
+//Quadrature nodes evaluated by one task
+static const size_t POINTS_PER_TASK  = 16 * COMPACT_BATCH_LEN;
+
+//Smallest tolerance reachable with MATH_FAST values
+static const double FAST_TOLERANCE   = 1e-7;
+
+//Intervals with at least this share of the largest error are halved
+static const double SPLIT_SHARE      = 0.5;
+
+//Totals kept for the epsilon algorithm (limexp of QUADPACK), they are extrapolated while
+//every difference is below EXTRAP_MAX_RATIO of the one before
+static const int    EXTRAP_TERMS     = 50;
+static const double EXTRAP_MAX_RATIO = 0.99;
+
+//-----------------------------------------------------------
+//! Abscissae of the Kronrod rule on [-1, 1], odd ones are the
+//! Gauss nodes. The last weights are the ones of the center.
+//-----------------------------------------------------------
+static const double KRONROD_NODES[KRONROD_PAIRS] =
+{
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+};
+
+static const double KRONROD_WEIGHTS[KRONROD_PAIRS + 1] =
+{
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714,
+};
+
+static const double GAUSS_WEIGHTS[KRONROD_PAIRS / 2 + 1] =
+{
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327,
+};
+
+struct Interval
+{
+    double from  = 0;
+    double to    = 0;
+    double value = 0;
+    double error = 0;
+};
+
+//-----------------------------------------------------------
+//! Quadrature nodes of one round and the values of f at them
+//-----------------------------------------------------------
+struct NodeBatch
+{
+    const char        *var        = nullptr;
+    const Node        *node       = nullptr;
+    const CompactTree *compiled   = nullptr;
+    bool               isCompiled = false;
+    MathAccuracy       accuracy   = MATH_EXACT;
+
+    const double      *points     = nullptr;
+    double            *values     = nullptr;
+};
+
+//-----------------------------------------------------------
+//! Totals of the last rounds for the epsilon algorithm and
+//! the last extrapolated values
+//-----------------------------------------------------------
+struct Extrapolation
+{
+    double totals [EXTRAP_TERMS] = {};
+    int    size                  = 0;
+
+    double results[3]            = {};
+    int    results_size          = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void EvaluateNodes (void *batch, size_t start, size_t end);
+static void KronrodNodes  (const Interval *interval, double *points);
+static void KronrodRule   (Interval *interval, const double *values);
+static bool Extrapolate   (Extrapolation *table, double total, double *value, double *error);
+static bool ReserveRound  (size_t count, Interval **intervals, size_t **fresh, double **points, double **values,
+                           size_t *capacity);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool Integrate(Node *node, const char *var, double from, double to, IntegralResult *result, MathAccuracy accuracy,
+               DiffPool *pool, double tolerance)
+{
+    assert(node && var && result);
+
+    *result = {};
+
+    if (!std::isfinite(from) || !std::isfinite(to))
+    {
+        printf("Error: wrong range [%lg, %lg] of the integral.\n", from, to);
+        return false;
+    }
+
+    if (from == to)
+    {
+        result->isConverged = true;
+        return true;
+    }
+
+    if (accuracy == MATH_FAST && tolerance < FAST_TOLERANCE) {tolerance = FAST_TOLERANCE;}
+
+    METRICS_SCOPE("integral");
+
+    NodeBatch batch = {};
+    batch.var      = var;
+    batch.node     = node;
+    batch.accuracy = accuracy;
+
+    CompactTree compiled = {};
+    batch.isCompiled = compactIsExact(node, var) && CompactTreeCtor(&compiled) && compactFromNode(&compiled, node);
+    batch.compiled   = &compiled;
+
+    Interval *intervals = nullptr;
+    size_t   *fresh     = nullptr;
+    double   *points    = nullptr;
+    double   *values    = nullptr;
+    size_t    capacity  = 0;
+
+    bool isCorrect = ReserveRound(INTEGRAL_START_INTERVALS, &intervals, &fresh, &points, &values, &capacity);
+
+    size_t count       = INTEGRAL_START_INTERVALS;
+    size_t fresh_count = count;
+    double width       = (to - from) / count;
+
+    for (size_t i = 0; isCorrect && i < count; i++)
+    {
+        intervals[i].from = from + i * width;
+        intervals[i].to   = (i + 1 == count) ? to : from + (i + 1) * width;
+        fresh[i]          = i;
+    }
+
+    Extrapolation table      = {};
+    size_t        last_split = 0;
+
+    for (int round = 0; isCorrect && fresh_count > 0; round++)
+    {
+        METRICS_SCOPE_ARG("integral round", round);
+
+        for (size_t k = 0; k < fresh_count; k++)
+        {
+            KronrodNodes(&intervals[fresh[k]], points + k * KRONROD_POINTS);
+        }
+
+        batch.points = points;
+        batch.values = values;
+        PoolFor(pool, fresh_count * KRONROD_POINTS, POINTS_PER_TASK, EvaluateNodes, &batch);
+
+        for (size_t k = 0; k < fresh_count; k++)
+        {
+            KronrodRule(&intervals[fresh[k]], values + k * KRONROD_POINTS);
+        }
+
+        double total_value = 0;
+        double total_error = 0;
+        double max_error   = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            total_value += intervals[i].value;
+            total_error += intervals[i].error;
+            max_error    = fmax(max_error, intervals[i].error);
+        }
+
+        double goal = fmax(tolerance * fabs(total_value), INTEGRAL_ABS_TOLERANCE);
+
+        result->value     = total_value;
+        result->error     = total_error;
+        result->intervals = count;
+
+        if (total_error <= goal)
+        {
+            result->isConverged = true;
+            break;
+        }
+
+        double extrap_value = 0;
+        double extrap_error = 0;
+        if (Extrapolate(&table, total_value, &extrap_value, &extrap_error) && extrap_error < total_error)
+        {
+            result->value = extrap_value;
+            result->error = extrap_error;
+
+            if (extrap_error <= fmax(tolerance * fabs(extrap_value), INTEGRAL_ABS_TOLERANCE))
+            {
+                result->isConverged = true;
+                break;
+            }
+        }
+
+        if (round + 1 == INTEGRAL_MAX_ROUNDS) {break;}
+
+        //Intervals with the largest errors are halved, the left half stays in place
+        size_t most = (2 * count < INTEGRAL_MAX_INTERVALS) ? 2 * count : INTEGRAL_MAX_INTERVALS;
+        if (!ReserveRound(most, &intervals, &fresh, &points, &values, &capacity))
+        {
+            isCorrect = false;
+            break;
+        }
+
+        double threshold = max_error * SPLIT_SHARE;
+        size_t old_count = count;
+
+        fresh_count = 0;
+        for (size_t i = 0; i < old_count && count < INTEGRAL_MAX_INTERVALS; i++)
+        {
+            Interval *interval = &intervals[i];
+            double    middle   = interval->from + (interval->to - interval->from) / 2;
+
+            if (!(interval->error >= threshold) || middle == interval->from || middle == interval->to) {continue;}
+
+            intervals[count] = {middle, interval->to, 0, 0};
+            interval->to     = middle;
+
+            fresh[fresh_count++] = i;
+            fresh[fresh_count++] = count;
+            count++;
+        }
+
+        //The totals of the epsilon algorithm have to come from the same kind of refinement
+        if (fresh_count != last_split) {table = {};}
+        last_split = fresh_count;
+    }
+
+    result->isConverged = isCorrect && result->isConverged;
+
+    CompactTreeDtor(&compiled);
+    free(intervals);
+    free(fresh);
+    free(points);
+    free(values);
+
+    return isCorrect;
+}
+
+void IntegralLatex(FILE *texfile, const IntegralResult *result, double from, double to)
+{
+    assert(result);
+
+    if (texfile == nullptr) {return;}
+
+    fprintf(texfile, "Интеграл функции на отрезке $[%lg, %lg]$: $\\int_{%lg}^{%lg} f(x)\\,dx = %.12lg$, "
+                     "оценка погрешности $%.2lg$ (%zu отрезков).\n\n", from, to, from, to, result->value, result->error,
+                     result->intervals);
+
+    if (!result->isConverged)
+    {
+        fprintf(texfile, "Заданная точность не достигнута, интеграл может расходиться.\n\n");
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void EvaluateNodes(void *batch_ptr, size_t start, size_t end)
+{
+    NodeBatch    *batch  = (NodeBatch *)batch_ptr;
+    const double *points = batch->points + start;
+    double       *values = batch->values + start;
+    size_t        size   = end - start;
+
+    if (batch->isCompiled && compactEvaluateBatch(batch->compiled, batch->var, points, values, size, batch->accuracy))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        values[i] = Evaluate(batch->node, batch->var, points[i]);
+    }
+}
+
+//-----------------------------------------------------------
+//! points[0] is the center, points[2j + 1] and points[2j + 2]
+//! are the pair of KRONROD_NODES[j]
+//-----------------------------------------------------------
+static void KronrodNodes(const Interval *interval, double *points)
+{
+    double half   = (interval->to - interval->from) / 2;
+    double center = interval->from + half;
+
+    points[0] = center;
+    for (int j = 0; j < KRONROD_PAIRS; j++)
+    {
+        points[2 * j + 1] = center - half * KRONROD_NODES[j];
+        points[2 * j + 2] = center + half * KRONROD_NODES[j];
+    }
+}
+
+//-----------------------------------------------------------
+//! The Kronrod value and the QUADPACK error estimate from the
+//! difference to the embedded 7-point Gauss rule
+//-----------------------------------------------------------
+static void KronrodRule(Interval *interval, const double *values)
+{
+    double half   = (interval->to - interval->from) / 2;
+    double center = values[0];
+
+    double gauss   = center * GAUSS_WEIGHTS[KRONROD_PAIRS / 2];
+    double kronrod = center * KRONROD_WEIGHTS[KRONROD_PAIRS];
+    double abs_sum = fabs(kronrod);
+
+    for (int j = 0; j < KRONROD_PAIRS; j++)
+    {
+        double sum = values[2 * j + 1] + values[2 * j + 2];
+
+        kronrod += KRONROD_WEIGHTS[j] * sum;
+        abs_sum += KRONROD_WEIGHTS[j] * (fabs(values[2 * j + 1]) + fabs(values[2 * j + 2]));
+        if (j % 2 == 1) {gauss += GAUSS_WEIGHTS[j / 2] * sum;}
+    }
+
+    double mean      = kronrod / 2;
+    double deviation = KRONROD_WEIGHTS[KRONROD_PAIRS] * fabs(center - mean);
+    for (int j = 0; j < KRONROD_PAIRS; j++)
+    {
+        deviation += KRONROD_WEIGHTS[j] * (fabs(values[2 * j + 1] - mean) + fabs(values[2 * j + 2] - mean));
+    }
+
+    abs_sum   *= fabs(half);
+    deviation *= fabs(half);
+
+    double error = fabs((kronrod - gauss) * half);
+    if (deviation != 0 && error != 0)
+    {
+        error = deviation * fmin(1, pow(200 * error / deviation, 1.5));
+    }
+    if (abs_sum > DBL_MIN / (50 * DBL_EPSILON))
+    {
+        error = fmax(50 * DBL_EPSILON * abs_sum, error);
+    }
+
+    interval->value = kronrod * half;
+    interval->error = std::isfinite(interval->value) ? error : HUGE_VAL;
+}
+
+//-----------------------------------------------------------
+//! Wynn's epsilon algorithm on the totals of the rounds, as in
+//! QUADPACK QAGS. The totals near an integrable singularity
+//! converge geometrically, the algorithm takes their limit.
+//! It is used only while the differences of the totals keep
+//! shrinking, so divergent integrals are not extrapolated.
+//! The error is the spread of the last three results.
+//-----------------------------------------------------------
+static bool Extrapolate(Extrapolation *table, double total, double *value, double *error)
+{
+    if (!std::isfinite(total))
+    {
+        *table = {};
+        return false;
+    }
+
+    if (table->size == EXTRAP_TERMS)
+    {
+        memmove(table->totals, table->totals + 1, (EXTRAP_TERMS - 1) * sizeof(double));
+        table->size--;
+    }
+    table->totals[table->size++] = total;
+
+    int size = table->size;
+    if (size < 3) {return false;}
+
+    double last   = fabs(table->totals[size - 1] - table->totals[size - 2]);
+    double before = fabs(table->totals[size - 2] - table->totals[size - 3]);
+    if (!(last < EXTRAP_MAX_RATIO * before))
+    {
+        table->results_size = 0;
+        return false;
+    }
+
+    //Columns of the table, column k + 1 is built from columns k - 1 and k
+    double previous[EXTRAP_TERMS] = {};
+    double current [EXTRAP_TERMS] = {};
+    memcpy(current, table->totals, size * sizeof(double));
+
+    double limit = total;
+
+    for (int column = 1, length = size - 1; length > 0; column++, length--)
+    {
+        double next[EXTRAP_TERMS] = {};
+        bool   isStable = true;
+
+        for (int j = 0; j < length; j++)
+        {
+            double difference = current[j + 1] - current[j];
+            if (difference == 0 || !std::isfinite(difference))
+            {
+                isStable = false;
+                break;
+            }
+
+            next[j] = previous[j + 1] + 1 / difference;
+        }
+
+        if (!isStable) {break;}
+
+        memcpy(previous, current, (length + 1) * sizeof(double));
+        memcpy(current,  next,    length       * sizeof(double));
+
+        if (column % 2 == 0) {limit = current[length - 1];}
+    }
+
+    if (table->results_size == 3)
+    {
+        table->results[0] = table->results[1];
+        table->results[1] = table->results[2];
+        table->results_size--;
+    }
+    table->results[table->results_size++] = limit;
+
+    if (table->results_size < 3) {return false;}
+
+    *value = limit;
+    *error = fabs(limit - table->results[1]) + fabs(limit - table->results[0]) + 5 * DBL_EPSILON * fabs(limit);
+
+    return true;
+}
+
+//-----------------------------------------------------------
+//! Room for 'count' intervals, their indices and the nodes of
+//! as many new ones, the intervals are kept
+//-----------------------------------------------------------
+static bool ReserveRound(size_t count, Interval **intervals, size_t **fresh, double **points, double **values,
+                         size_t *capacity)
+{
+    if (count <= *capacity) {return true;}
+
+    Interval *new_intervals = (Interval *)realloc(*intervals, count * sizeof(Interval));
+    if (new_intervals != nullptr) {*intervals = new_intervals;}
+    size_t   *new_fresh     = (size_t   *)realloc(*fresh,     count * sizeof(size_t));
+    if (new_fresh     != nullptr) {*fresh     = new_fresh;    }
+    double   *new_points    = (double   *)realloc(*points,    count * KRONROD_POINTS * sizeof(double));
+    if (new_points    != nullptr) {*points    = new_points;   }
+    double   *new_values    = (double   *)realloc(*values,    count * KRONROD_POINTS * sizeof(double));
+    if (new_values    != nullptr) {*values    = new_values;   }
+
+    if (new_intervals == nullptr || new_fresh == nullptr || new_points == nullptr || new_values == nullptr)
+    {
+        printf("Error allocating memory for the integral.\n");
+        return false;
+    }
+
+    *capacity = count;
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------
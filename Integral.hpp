@@ -0,0 +1,68 @@
+#ifndef INTEGRAL_HPP
+#define INTEGRAL_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+#include "FastMath.hpp"
+#include "ParallelDiff.hpp"
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Relative error of the integral and absolute error for integrals close to zero
+static const double INTEGRAL_STD_TOLERANCE = 1e-10;
+static const double INTEGRAL_ABS_TOLERANCE = 1e-14;
+
+//Equal intervals of the first round, rounds of bisection and intervals in total
+static const size_t INTEGRAL_START_INTERVALS = 16;
+static const int    INTEGRAL_MAX_ROUNDS      = 200;
+static const size_t INTEGRAL_MAX_INTERVALS   = 1 << 16;
+
+//----------------------------------------------------------------------------------------------------------------
+
+struct IntegralResult
+{
+    double value       = 0;
+    double error       = 0;
+    size_t intervals   = 0;
+    bool   isConverged = false;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Definite integral of f over [from, to] by adaptive 15-point
+//! Gauss-Kronrod rules with global error priority, as QUADPACK
+//! QAGS. The integral is done when the sum of the errors is
+//! below max(tolerance*|value|, INTEGRAL_ABS_TOLERANCE).
+//! Otherwise the intervals with the largest errors are halved
+//! and the new halves of a round are evaluated in one batch,
+//! in parallel with a pool. Near an integrable singularity at
+//! or inside the range the totals of the rounds are
+//! extrapolated with the epsilon algorithm.
+//!
+//! Trees that compile exactly (compactIsExact) are evaluated
+//! by compactEvaluateBatch with the given accuracy, the others
+//! by Evaluate. MATH_FAST values are within 1e-8, so the
+//! tolerance is raised to 1e-7 for it.
+//!
+//! isConverged is false if the rounds or the intervals run out
+//! first, as for divergent integrals. A value of f that is not
+//! finite makes the error of its interval unknown, so the
+//! interval is halved further. Singularities that are not
+//! integrable and strong oscillations are not extrapolated.
+//-----------------------------------------------------------
+bool Integrate (Node *node, const char *var, double from, double to, IntegralResult *result,
+                MathAccuracy accuracy = MATH_EXACT, DiffPool *pool = nullptr, double tolerance = INTEGRAL_STD_TOLERANCE);
+
+//-----------------------------------------------------------
+//! Paragraph of the LaTeX report with the value and its error
+//-----------------------------------------------------------
+void IntegralLatex (FILE *texfile, const IntegralResult *result, double from, double to);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //INTEGRAL_HPP
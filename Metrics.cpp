@@ -0,0 +1,261 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+
+#include "Metrics.hpp"
+
+//--------------------------------------------------------------
+
+#ifdef METRICS
+
+struct MetricsEvent
+{
+    const char *name     = nullptr;
+    int         arg      = -1;
+    double      start    = 0;
+    double      duration = 0;
+    long long   live     = 0;
+    int         thread   = 0;
+};
+
+struct MetricsStage
+{
+    const char *name  = nullptr;
+    int         arg   = -1;
+    long        calls = 0;
+    double      total = 0;
+    double      max   = 0;
+};
+
+static const char *COUNTER_NAMES[NUMBER_OF_METRICS_COUNTERS] =
+{
+    "nodes allocated",
+    "nodes freed",
+    "live nodes",
+    "peak live nodes",
+    "simplifier passes",
+    "derivatives computed",
+};
+
+static MetricsEvent *Events         = nullptr;
+static size_t        EventsSize     = 0;
+static size_t        EventsCapacity = 0;
+
+static long long     Counters[NUMBER_OF_METRICS_COUNTERS] = {};
+static double        StartTime      = 0;
+
+//Nodes are created by every thread, so counters and events are locked
+static pthread_mutex_t  Lock = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<int> ThreadCounter(0);
+static thread_local int ThreadId = 0;
+
+//--------------------------------------------------------------
+
+static double NowUs        ();
+static int    GetThreadId  ();
+static void   PushEvent    (const MetricsEvent *event);
+static void   WriteTrace   (const char *trace_filename);
+static void   PrintSummary (FILE *summary);
+
+//--------------------------------------------------------------
+
+MetricsScope::MetricsScope(const char *name, int arg)
+{
+    this->name  = name;
+    this->arg   = arg;
+    this->start = NowUs();
+}
+
+MetricsScope::~MetricsScope()
+{
+    pthread_mutex_lock(&Lock);
+
+    MetricsEvent event = {name, arg, start, NowUs() - start, Counters[METRICS_LIVE_NODES], GetThreadId()};
+    PushEvent(&event);
+
+    pthread_mutex_unlock(&Lock);
+}
+
+void MetricsInit()
+{
+    pthread_mutex_lock(&Lock);
+
+    free(Events);
+
+    Events         = nullptr;
+    EventsSize     = 0;
+    EventsCapacity = 0;
+
+    memset(Counters, 0, sizeof(Counters));
+    StartTime = NowUs();
+
+    pthread_mutex_unlock(&Lock);
+}
+
+void MetricsAdd(MetricsCounter counter, long long value)
+{
+    pthread_mutex_lock(&Lock);
+    Counters[counter] += value;
+    pthread_mutex_unlock(&Lock);
+}
+
+void MetricsNodeCtor()
+{
+    pthread_mutex_lock(&Lock);
+
+    Counters[METRICS_NODES_ALLOCATED]++;
+    Counters[METRICS_LIVE_NODES]++;
+
+    if (Counters[METRICS_LIVE_NODES] > Counters[METRICS_PEAK_LIVE_NODES])
+    {
+        Counters[METRICS_PEAK_LIVE_NODES] = Counters[METRICS_LIVE_NODES];
+    }
+
+    pthread_mutex_unlock(&Lock);
+}
+
+void MetricsNodeDtor()
+{
+    pthread_mutex_lock(&Lock);
+
+    Counters[METRICS_NODES_FREED]++;
+    Counters[METRICS_LIVE_NODES]--;
+
+    pthread_mutex_unlock(&Lock);
+}
+
+void MetricsReport(const char *trace_filename, FILE *summary)
+{
+    pthread_mutex_lock(&Lock);
+
+    WriteTrace(trace_filename);
+    PrintSummary(summary);
+
+    pthread_mutex_unlock(&Lock);
+}
+
+//--------------------------------------------------------------
+
+static double NowUs()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec * 1e6 + (double)time.tv_nsec / 1e3;
+}
+
+static int GetThreadId()
+{
+    if (ThreadId == 0) {ThreadId = ++ThreadCounter;}
+
+    return ThreadId;
+}
+
+static void PushEvent(const MetricsEvent *event)
+{
+    if (EventsSize == EventsCapacity)
+    {
+        size_t        capacity = 2*EventsCapacity + 64;
+        MetricsEvent *events   = (MetricsEvent *)realloc(Events, capacity * sizeof(MetricsEvent));
+        if (events == nullptr) {return;}
+
+        Events         = events;
+        EventsCapacity = capacity;
+    }
+
+    Events[EventsSize++] = *event;
+}
+
+//-----------------------------------------------------------
+//! Chrome trace-event format, open it in chrome://tracing or
+//! ui.perfetto.dev
+//-----------------------------------------------------------
+static void WriteTrace(const char *trace_filename)
+{
+    FILE *trace = fopen(trace_filename, "w");
+    if (trace == nullptr)
+    {
+        printf("Error opening trace file: %s\n", trace_filename);
+        return;
+    }
+
+    fprintf(trace, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    for (size_t i = 0; i < EventsSize; i++)
+    {
+        const MetricsEvent *event = &Events[i];
+        double ts = event->start - StartTime;
+
+        fprintf(trace, "  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3lf, \"dur\": %.3lf",
+                event->name, event->thread, ts, event->duration);
+        if (event->arg >= 0)
+        {
+            fprintf(trace, ", \"args\": {\"i\": %d}", event->arg);
+        }
+        fprintf(trace, "},\n");
+
+        fprintf(trace, "  {\"name\": \"live nodes\", \"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"ts\": %.3lf, "
+                       "\"args\": {\"nodes\": %lld}}%s\n",
+                ts + event->duration, event->live, (i + 1 < EventsSize) ? "," : "");
+    }
+
+    fprintf(trace, "]}\n");
+    fclose(trace);
+}
+
+static void PrintSummary(FILE *summary)
+{
+    double total_time = NowUs() - StartTime;
+
+    MetricsStage *stages = (MetricsStage *)calloc(EventsSize + 1, sizeof(MetricsStage));
+    size_t        size   = 0;
+
+    for (size_t i = 0; i < EventsSize; i++)
+    {
+        const MetricsEvent *event = &Events[i];
+        MetricsStage       *stage = nullptr;
+
+        for (size_t j = 0; j < size && stage == nullptr; j++)
+        {
+            if (stages[j].arg == event->arg && strcmp(stages[j].name, event->name) == 0) {stage = &stages[j];}
+        }
+        if (stage == nullptr)
+        {
+            stage = &stages[size++];
+            stage->name = event->name;
+            stage->arg  = event->arg;
+        }
+
+        stage->calls++;
+        stage->total += event->duration;
+        if (event->duration > stage->max) {stage->max = event->duration;}
+    }
+
+    fprintf(summary, "\n%-28s %8s %12s %12s %12s %7s\n", "stage", "calls", "total, ms", "mean, us", "max, us", "%");
+
+    for (size_t i = 0; i < size; i++)
+    {
+        char name[64] = "";
+        if (stages[i].arg >= 0) {snprintf(name, sizeof(name), "%s %d", stages[i].name, stages[i].arg);}
+        else                    {snprintf(name, sizeof(name), "%s",    stages[i].name);}
+
+        fprintf(summary, "%-28s %8ld %12.3lf %12.1lf %12.1lf %6.1lf%%\n", name, stages[i].calls,
+                stages[i].total / 1e3, stages[i].total / stages[i].calls, stages[i].max,
+                100 * stages[i].total / total_time);
+    }
+
+    fprintf(summary, "%-28s %8s %12.3lf\n\n", "whole run", "", total_time / 1e3);
+
+    for (int i = 0; i < NUMBER_OF_METRICS_COUNTERS; i++)
+    {
+        fprintf(summary, "%-28s %lld\n", COUNTER_NAMES[i], Counters[i]);
+    }
+
+    free(stages);
+}
+
+#endif //METRICS
+
+//--------------------------------------------------------------
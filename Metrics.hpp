@@ -0,0 +1,75 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstdio>
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Pipeline metrics. Build with -DMETRICS (make metrics) to
+//! enable them, otherwise every macro below expands to nothing.
+//-----------------------------------------------------------
+
+enum MetricsCounter
+{
+    METRICS_NODES_ALLOCATED,
+    METRICS_NODES_FREED,
+    METRICS_LIVE_NODES,
+    METRICS_PEAK_LIVE_NODES,
+    METRICS_SIMPLIFIER_PASSES,
+    METRICS_DERIVATIVES_COMPUTED,
+
+    NUMBER_OF_METRICS_COUNTERS
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+#ifdef METRICS
+
+    static const char *METRICS_TRACE_FILE = "./Log/trace.json";
+
+    //-----------------------------------------------------------
+    //! Timer of the enclosing scope. 'arg' tells apart calls of
+    //! one stage (order of the derivative etc), -1 if unused.
+    //-----------------------------------------------------------
+    struct MetricsScope
+    {
+        const char *name  = nullptr;
+        int         arg   = -1;
+        double      start = 0;
+
+        MetricsScope (const char *name, int arg = -1);
+        ~MetricsScope();
+    };
+
+    void MetricsInit     ();
+    void MetricsAdd      (MetricsCounter counter, long long value);
+    void MetricsNodeCtor ();
+    void MetricsNodeDtor ();
+    void MetricsReport   (const char *trace_filename, FILE *summary);
+
+    #define METRICS_CONCAT_(first, second) first##second
+    #define METRICS_CONCAT(first, second)  METRICS_CONCAT_(first, second)
+
+    #define METRICS_SCOPE(name)            MetricsScope METRICS_CONCAT(metrics_scope_, __LINE__)(name)
+    #define METRICS_SCOPE_ARG(name, arg)   MetricsScope METRICS_CONCAT(metrics_scope_, __LINE__)(name, arg)
+    #define METRICS_ADD(counter, value)    MetricsAdd(counter, value)
+    #define METRICS_NODE_CTOR()            MetricsNodeCtor()
+    #define METRICS_NODE_DTOR()            MetricsNodeDtor()
+    #define METRICS_INIT()                 MetricsInit()
+    #define METRICS_REPORT()               MetricsReport(METRICS_TRACE_FILE, stdout)
+#else
+    #define METRICS_SCOPE(name)
+    #define METRICS_SCOPE_ARG(name, arg)
+    #define METRICS_ADD(counter, value)
+    #define METRICS_NODE_CTOR()
+    #define METRICS_NODE_DTOR()
+    #define METRICS_INIT()
+    #define METRICS_REPORT()
+#endif //METRICS
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //METRICS_HPP
@@ -0,0 +1,447 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Differentiator.hpp"
+#include "Metrics.hpp"
+#include "ParallelDiff.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Failed steal attempts of an idle worker before it starts to sleep between them
+static const int  IDLE_SPINS    = 64;
+static const long IDLE_SLEEP_NS = 50000;
+
+//-----------------------------------------------------------
+//! Differentiation of one subtree. sizes are shared by all
+//! subtrees of one ParallelDiff call.
+//-----------------------------------------------------------
+struct DiffJob
+{
+    const char   *var    = nullptr;
+    const size_t *sizes  = nullptr;
+    Node         *node   = nullptr;
+    size_t        index  = 0;
+    Node         *result = nullptr;
+};
+
+//-----------------------------------------------------------
+//! Indices [start, end) of a PoolFor call
+//-----------------------------------------------------------
+struct ForRange
+{
+    PoolRangeFunc  body  = nullptr;
+    void          *arg   = nullptr;
+    size_t         grain = 0;
+    size_t         start = 0;
+    size_t         end   = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void     *PoolThread    (void *worker);
+static void      DiffSubtree   (PoolWorker *worker, void *job);
+static void      RunRange      (PoolWorker *worker, void *range);
+static PoolTask *PopTask       (PoolWorker *worker);
+static PoolTask *StealTask     (PoolWorker *worker);
+static PoolTask *FindTask      (PoolWorker *worker);
+static void      RunTask       (PoolWorker *worker, PoolTask *task);
+static size_t    CountNodes    (const Node *node);
+static size_t    FillSizes     (const Node *node, size_t *sizes, size_t index);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool DiffPoolCtor(DiffPool *pool, int workers)
+{
+    assert(pool);
+
+    if (workers <= 0) {workers = (int)sysconf(_SC_NPROCESSORS_ONLN);}
+    if (workers <= 0) {workers = 1;}
+
+    pool->workers    = workers;
+    pool->generation = 0;
+    pool->isActive   = false;
+    pool->isStopped  = false;
+
+    pthread_mutex_init(&pool->job_lock, nullptr);
+    pthread_mutex_init(&pool->lock,     nullptr);
+    pthread_cond_init (&pool->wake,     nullptr);
+
+    pool->worker  = (PoolWorker *)aligned_alloc(alignof(PoolWorker), workers * sizeof(PoolWorker));
+    pool->threads = (pthread_t  *)calloc(workers, sizeof(pthread_t));
+    if (pool->worker == nullptr || pool->threads == nullptr)
+    {
+        printf("Error allocating memory for differentiation pool.\n");
+        free(pool->worker);
+        free(pool->threads);
+        pool->worker  = nullptr;
+        pool->threads = nullptr;
+        pool->workers = 0;
+        return false;
+    }
+
+    memset((void *)pool->worker, 0, workers * sizeof(PoolWorker));
+    for (int i = 0; i < workers; i++)
+    {
+        PoolWorker *worker = &pool->worker[i];
+
+        worker->pool = pool;
+        worker->id   = i;
+        worker->seed = 2*i + 1;
+        pthread_mutex_init(&worker->lock, nullptr);
+    }
+
+    for (int i = 1; i < workers; i++)
+    {
+        if (pthread_create(&pool->threads[i], nullptr, PoolThread, &pool->worker[i]) != 0)
+        {
+            printf("Error starting differentiation worker %d.\n", i);
+            pool->workers = i;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void DiffPoolDtor(DiffPool *pool)
+{
+    if (pool == nullptr || pool->worker == nullptr) {return;}
+
+    pthread_mutex_lock(&pool->lock);
+    pool->isStopped = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->workers; i++)
+    {
+        pthread_join(pool->threads[i], nullptr);
+    }
+
+    for (int i = 0; i < pool->workers; i++)
+    {
+        pthread_mutex_destroy(&pool->worker[i].lock);
+    }
+
+    free(pool->worker);
+    free(pool->threads);
+    pool->worker  = nullptr;
+    pool->threads = nullptr;
+    pool->workers = 0;
+
+    pthread_mutex_destroy(&pool->job_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy (&pool->wake);
+}
+
+Node *ParallelDiff(DiffPool *pool, Node *node, const char *var)
+{
+    assert(pool && node && var);
+
+    if (pool->workers <= 1) {return Diff(node, var);}
+
+    size_t *sizes = PoolSubtreeSizes(node);
+    if (sizes == nullptr) {return Diff(node, var);}
+
+    METRICS_SCOPE("parallel diff");
+
+    DiffJob job = {};
+    job.var   = var;
+    job.sizes = sizes;
+    job.node  = node;
+
+    if (!PoolRun(pool, DiffSubtree, &job))
+    {
+        job.result = Diff(node, var);
+    }
+
+    free(sizes);
+
+    return job.result;
+}
+
+bool PoolRun(DiffPool *pool, PoolFunc job, void *arg)
+{
+    assert(pool && job);
+
+    if (pool->workers <= 1 || pthread_mutex_trylock(&pool->job_lock) != 0) {return false;}
+
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pool->isActive = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    job(&pool->worker[0], arg);
+
+    //Every spawned task is joined, so the other workers are idle now
+    pool->isActive = false;
+
+    pthread_mutex_unlock(&pool->job_lock);
+
+    return true;
+}
+
+bool PoolSpawn(PoolWorker *worker, PoolTask *task)
+{
+    assert(worker && task && task->run);
+
+    pthread_mutex_lock(&worker->lock);
+
+    bool isPushed = (worker->bottom - worker->top < TASK_DEQUE_LEN);
+    if (isPushed)
+    {
+        worker->tasks[worker->bottom % TASK_DEQUE_LEN] = task;
+        worker->bottom++;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return isPushed;
+}
+
+//-----------------------------------------------------------
+//! While the task is run by a thief, the worker runs other
+//! tasks instead of waiting
+//-----------------------------------------------------------
+void PoolJoin(PoolWorker *worker, PoolTask *task)
+{
+    assert(worker && task);
+
+    while (!task->isDone.load(std::memory_order_acquire))
+    {
+        PoolTask *other = FindTask(worker);
+        if (other != nullptr)
+        {
+            RunTask(worker, other);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
+
+void PoolFor(DiffPool *pool, size_t count, size_t grain, PoolRangeFunc body, void *arg)
+{
+    assert(body);
+
+    ForRange range = {};
+    range.body  = body;
+    range.arg   = arg;
+    range.grain = (grain > 0) ? grain : 1;
+    range.end   = count;
+
+    if (pool == nullptr || count <= range.grain || !PoolRun(pool, RunRange, &range))
+    {
+        body(arg, 0, count);
+    }
+}
+
+size_t *PoolSubtreeSizes(const Node *node)
+{
+    size_t size = CountNodes(node);
+    if (size < PARALLEL_DIFF_CUTOFF) {return nullptr;}
+
+    size_t *sizes = (size_t *)calloc(size, sizeof(size_t));
+    if (sizes == nullptr) {return nullptr;}
+
+    FillSizes(node, sizes, 0);
+
+    return sizes;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void *PoolThread(void *worker_ptr)
+{
+    PoolWorker *worker = (PoolWorker *)worker_ptr;
+    DiffPool   *pool   = worker->pool;
+
+    long long seen = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->isStopped && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->isStopped)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        int idle = 0;
+        while (pool->isActive)
+        {
+            PoolTask *task = FindTask(worker);
+            if (task != nullptr)
+            {
+                RunTask(worker, task);
+                idle = 0;
+            }
+            else if (++idle < IDLE_SPINS)
+            {
+                sched_yield();
+            }
+            else
+            {
+                timespec pause = {0, IDLE_SLEEP_NS};
+                nanosleep(&pause, nullptr);
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+static void DiffSubtree(PoolWorker *worker, void *job_ptr)
+{
+    DiffJob    *job   = (DiffJob *)job_ptr;
+    Node       *node  = job->node;
+    const char *var   = job->var;
+    size_t      index = job->index;
+
+    if (job->sizes[index] < PARALLEL_DIFF_CUTOFF)
+    {
+        job->result = Diff(node, var);
+        return;
+    }
+
+    bool needLeft  = false;
+    bool needRight = false;
+    DiffOperands(node, var, &needLeft, &needRight);
+
+    DiffJob left  = *job;
+    DiffJob right = *job;
+
+    left.node   = node->left;
+    left.index  = index + 1;
+    right.node  = node->right;
+    right.index = index + 1 + ((node->left != nullptr) ? job->sizes[left.index] : 0);
+
+    PoolTask task = {};
+    task.run = DiffSubtree;
+    task.arg = &left;
+
+    bool isSpawned = needLeft && needRight && PoolSpawn(worker, &task);
+
+    if (needLeft && !isSpawned) {DiffSubtree(worker, &left );}
+    if (needRight)              {DiffSubtree(worker, &right);}
+    if (isSpawned)              {PoolJoin   (worker, &task );}
+
+    job->result = DiffNode(node, var, left.result, right.result);
+}
+
+static void RunRange(PoolWorker *worker, void *range_ptr)
+{
+    ForRange *range = (ForRange *)range_ptr;
+    size_t    size  = range->end - range->start;
+
+    if (size <= range->grain)
+    {
+        range->body(range->arg, range->start, range->end);
+        return;
+    }
+
+    //Halves are whole grains
+    size_t half = (size / 2 + range->grain - 1) / range->grain * range->grain;
+
+    ForRange first  = *range;
+    ForRange second = *range;
+    first.end    = range->start + half;
+    second.start = range->start + half;
+
+    PoolTask task = {};
+    task.run = RunRange;
+    task.arg = &first;
+
+    bool isSpawned = PoolSpawn(worker, &task);
+
+    if (!isSpawned) {RunRange(worker, &first);}
+    RunRange(worker, &second);
+    if (isSpawned)  {PoolJoin(worker, &task);}
+}
+
+static PoolTask *PopTask(PoolWorker *worker)
+{
+    PoolTask *task = nullptr;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom > worker->top)
+    {
+        worker->bottom--;
+        task = worker->tasks[worker->bottom % TASK_DEQUE_LEN];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return task;
+}
+
+static PoolTask *StealTask(PoolWorker *worker)
+{
+    DiffPool *pool = worker->pool;
+
+    int start = rand_r(&worker->seed) % pool->workers;
+
+    for (int i = 0; i < pool->workers; i++)
+    {
+        PoolWorker *victim = &pool->worker[(start + i) % pool->workers];
+        if (victim == worker) {continue;}
+
+        PoolTask *task = nullptr;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->bottom > victim->top)
+        {
+            task = victim->tasks[victim->top % TASK_DEQUE_LEN];
+            victim->top++;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (task != nullptr) {return task;}
+    }
+
+    return nullptr;
+}
+
+static PoolTask *FindTask(PoolWorker *worker)
+{
+    PoolTask *task = PopTask(worker);
+
+    return (task != nullptr) ? task : StealTask(worker);
+}
+
+static void RunTask(PoolWorker *worker, PoolTask *task)
+{
+    task->run(worker, task->arg);
+    task->isDone.store(true, std::memory_order_release);
+}
+
+static size_t CountNodes(const Node *node)
+{
+    if (node == nullptr) {return 0;}
+
+    return 1 + CountNodes(node->left) + CountNodes(node->right);
+}
+
+static size_t FillSizes(const Node *node, size_t *sizes, size_t index)
+{
+    if (node == nullptr) {return 0;}
+
+    size_t left_size  = FillSizes(node->left,  sizes, index + 1);
+    size_t right_size = FillSizes(node->right, sizes, index + 1 + left_size);
+
+    sizes[index] = 1 + left_size + right_size;
+
+    return sizes[index];
+}
+
+//----------------------------------------------------------------------------------------------------------------
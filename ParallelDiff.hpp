@@ -0,0 +1,118 @@
+#ifndef PARALLEL_DIFF_HPP
+#define PARALLEL_DIFF_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <pthread.h>
+
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Subtrees smaller than this are differentiated and simplified serially
+static const size_t PARALLEL_DIFF_CUTOFF = 4096;
+static const int    TASK_DEQUE_LEN       = 1024;
+
+//----------------------------------------------------------------------------------------------------------------
+
+struct PoolWorker;
+
+typedef void (*PoolFunc)     (PoolWorker *worker, void *arg);
+typedef void (*PoolRangeFunc)(void *arg, size_t start, size_t end);
+
+//-----------------------------------------------------------
+//! Work spawned by a worker. It is run by this worker or
+//! stolen by another one. arg lives in the frame of the
+//! spawner, which always joins the task.
+//-----------------------------------------------------------
+struct PoolTask
+{
+    PoolFunc          run    = nullptr;
+    void             *arg    = nullptr;
+    std::atomic<bool> isDone = {false};
+};
+
+//-----------------------------------------------------------
+//! The owner pushes and pops tasks at the bottom, thieves take
+//! the oldest ones from the top
+//-----------------------------------------------------------
+struct alignas(64) PoolWorker
+{
+    struct DiffPool *pool  = nullptr;
+    int              id    = 0;
+    unsigned         seed  = 0;
+
+    PoolTask        *tasks[TASK_DEQUE_LEN] = {};
+    size_t           top    = 0;
+    size_t           bottom = 0;
+    pthread_mutex_t  lock   = PTHREAD_MUTEX_INITIALIZER;
+};
+
+//-----------------------------------------------------------
+//! Work-stealing pool for ParallelDiff and the parallel
+//! simplifier. Worker 0 is the thread running a job, the
+//! others sleep between jobs. One job runs on a pool at a time.
+//-----------------------------------------------------------
+struct DiffPool
+{
+    int               workers    = 0;
+    PoolWorker       *worker     = nullptr;
+    pthread_t        *threads    = nullptr;
+
+    long long         generation = 0;
+    std::atomic<bool> isActive   = {false};
+    bool              isStopped  = false;
+
+    pthread_mutex_t   job_lock   = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t   lock       = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t    wake       = PTHREAD_COND_INITIALIZER;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! workers <= 0 means one per processor
+//-----------------------------------------------------------
+bool  DiffPoolCtor (DiffPool *pool, int workers = 0);
+void  DiffPoolDtor (DiffPool *pool);
+
+//-----------------------------------------------------------
+//! The same tree as Diff(node, var). Operands of large nodes
+//! are differentiated in parallel. If the pool is busy with
+//! another call, the serial Diff is used.
+//-----------------------------------------------------------
+Node *ParallelDiff (DiffPool *pool, Node *node, const char *var);
+
+//-----------------------------------------------------------
+//! Runs job(worker 0, arg) in the calling thread with the
+//! other workers taking spawned tasks. Returns false without
+//! running it if the pool has one worker or is busy.
+//-----------------------------------------------------------
+bool  PoolRun      (DiffPool *pool, PoolFunc job, void *arg);
+
+//-----------------------------------------------------------
+//! Returns false if the deque of the worker is full, then the
+//! task must be run by the caller
+//-----------------------------------------------------------
+bool  PoolSpawn    (PoolWorker *worker, PoolTask *task);
+void  PoolJoin     (PoolWorker *worker, PoolTask *task);
+
+//-----------------------------------------------------------
+//! body(arg, start, end) for ranges that cover [0, count),
+//! start is a multiple of grain. With a pool the ranges are
+//! at most grain long and run in parallel, without it (or if
+//! the pool is busy) body gets all of [0, count) at once.
+//-----------------------------------------------------------
+void  PoolFor      (DiffPool *pool, size_t count, size_t grain, PoolRangeFunc body, void *arg);
+
+//-----------------------------------------------------------
+//! Subtree sizes in preorder: the left operand of the node at
+//! index is index + 1, the right one follows the left subtree.
+//! Returns nullptr if the tree is smaller than the cutoff.
+//-----------------------------------------------------------
+size_t *PoolSubtreeSizes (const Node *node);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //PARALLEL_DIFF_HPP
@@ -0,0 +1,730 @@
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "Metrics.hpp"
+#include "ParallelDiff.hpp"
+#include "PlotRaster.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int      TILE_SIZE        = 64;
+static const size_t   TILES_PER_TASK   = 4;
+
+//About this many grid lines on each axis
+static const int      GRID_LINES       = 10;
+static const double   LINE_HALF_WIDTH  = 0.75;
+
+static const uint32_t BACKGROUND_COLOR = 0xFFFFFF;
+static const uint32_t GRID_COLOR       = 0xD0D0D0;
+static const uint32_t AXIS_COLOR       = 0x000000;
+
+//Colors of gnuplot line types 1..8
+static const int      NUMBER_OF_COLORS = 8;
+static const uint32_t LINE_COLORS[NUMBER_OF_COLORS] =
+{
+    0x9400D3, 0x009E73, 0x56B4E9, 0xE69F00, 0xF0E442, 0x0072B2, 0xE51E10, 0x000000,
+};
+static const char    *LINE_COLOR_NAMES[NUMBER_OF_COLORS] =
+{
+    "фиолетовая", "зелёная", "голубая", "оранжевая", "жёлтая", "синяя", "красная", "чёрная",
+};
+
+static const int      BYTES_PER_PIXEL  = 3;
+
+//Deflate matches only repeat the previous pixel
+static const size_t   MIN_MATCH_LEN    = 3;
+static const size_t   MAX_MATCH_LEN    = 258;
+static const int      LENGTH_CODES     = 29;
+static const int      LENGTH_BASES[LENGTH_CODES] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const int      LENGTH_EXTRA_BITS[LENGTH_CODES] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const int      PIXEL_DISTANCE_CODE = 2;
+static const uint32_t ADLER_MOD           = 65521;
+static const size_t   ADLER_BLOCK_LEN     = 5552;
+
+static const uint8_t  PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Image of a figure and the samples in pixel coordinates,
+//! curve i has its x at coords + 2*starts[i] and y after them.
+//! Segments of curve i that reach tile column k are
+//! segments[bins[i*(columns + 1) + k] .. bins[... + k + 1]).
+//-----------------------------------------------------------
+struct Raster
+{
+    const PlotFigure *figure = nullptr;
+
+    uint8_t *pixels = nullptr;
+    int      width  = 0;
+    int      height = 0;
+
+    double  *coords = nullptr;
+    size_t  *starts = nullptr;
+
+    int      columns  = 0;
+    size_t  *bins     = nullptr;
+    size_t  *segments = nullptr;
+
+    double   step_x = 0;
+    double   step_y = 0;
+};
+
+//-----------------------------------------------------------
+//! Bits of a deflate stream, least significant first
+//-----------------------------------------------------------
+struct BitWriter
+{
+    uint8_t *data  = nullptr;
+    size_t   size  = 0;
+    uint32_t bits  = 0;
+    int      count = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool     BinSegments (Raster *raster);
+static bool     SegmentSpan (const double *x, const double *y, size_t i, int *first, int *last);
+static void     RenderTiles (void *raster, size_t start, size_t end);
+static void     DrawCurve   (const Raster *raster, int curve, int left, int top, int right, int bottom, float *coverage);
+static void     FillPixel   (const Raster *raster, int x, int y, uint32_t color, double alpha = 1);
+static double   GridStep    (double range);
+static bool     isRangeValid(double min, double max, double step);
+static double   ToPixelX    (const Raster *raster, double x);
+static double   ToPixelY    (const Raster *raster, double y);
+static uint32_t LineColor   (int line_type);
+static bool     WritePng    (const char *filename, const uint8_t *pixels, int width, int height);
+static void     Deflate     (BitWriter *writer, const uint8_t *data, size_t size);
+static void     PutBits     (BitWriter *writer, uint32_t value, int count);
+static void     PutCode     (BitWriter *writer, uint32_t code, int length);
+static void     PutLiteral  (BitWriter *writer, int value);
+static void     PutChunk    (FILE *file, const char *type, const uint8_t *data, size_t size);
+static void     PutBigEndian(uint8_t *data, uint32_t value);
+static uint32_t Crc32       (uint32_t crc, const uint8_t *data, size_t size);
+static uint32_t Adler32     (const uint8_t *data, size_t size);
+
+//----------------------------------------------------------------------------------------------------------------
+
+void PlotFigureDtor(PlotFigure *figure)
+{
+    if (figure == nullptr) {return;}
+
+    for (int i = 0; i < figure->size; i++)
+    {
+        free(figure->curves[i].x);
+    }
+    free(figure->curves);
+
+    *figure = {};
+}
+
+bool PlotFigureAdd(PlotFigure *figure, double *x, size_t count, const char *mode, const char *title)
+{
+    assert(figure && x);
+
+    if (figure->size == figure->capacity)
+    {
+        int        capacity   = (figure->capacity > 0) ? 2 * figure->capacity : 4;
+        PlotCurve *new_curves = (PlotCurve *)realloc(figure->curves, capacity * sizeof(PlotCurve));
+        if (new_curves == nullptr)
+        {
+            printf("Error allocating memory for plot curves\n");
+            free(x);
+            return false;
+        }
+
+        figure->curves   = new_curves;
+        figure->capacity = capacity;
+    }
+
+    PlotCurve *curve = &figure->curves[figure->size];
+    *curve = {};
+    curve->x         = x;
+    curve->y         = x + count;
+    curve->count     = count;
+    curve->line_type = figure->size + 1;
+
+    const char *line_type = (mode != nullptr) ? strstr(mode, "lt ") : nullptr;
+    if (line_type != nullptr) {sscanf(line_type, "lt %d", &curve->line_type);}
+
+    if (title != nullptr) {strncpy(curve->title, title, MAX_CURVE_TITLE_LEN - 1);}
+
+    figure->size++;
+    return true;
+}
+
+bool PlotRender(const PlotFigure *figure, const char *filename, DiffPool *pool)
+{
+    assert(figure && filename);
+
+    METRICS_SCOPE("plot render");
+
+    size_t samples = 0;
+    for (int i = 0; i < figure->size; i++)
+    {
+        samples += figure->curves[i].count;
+    }
+
+    if (!isRangeValid(figure->x_min, figure->x_max, GridStep(figure->x_max - figure->x_min)) ||
+        !isRangeValid(figure->y_min, figure->y_max, GridStep(figure->y_max - figure->y_min)))
+    {
+        printf("Error: the plot range [%lg, %lg] x [%lg, %lg] is empty or not finite\n",
+               figure->x_min, figure->x_max, figure->y_min, figure->y_max);
+        return false;
+    }
+
+    Raster raster = {};
+    raster.figure = figure;
+    raster.width  = PLOT_RASTER_WIDTH;
+    raster.height = PLOT_RASTER_HEIGHT;
+    raster.pixels = (uint8_t *)calloc((size_t)raster.width * raster.height, BYTES_PER_PIXEL);
+    raster.coords = (double  *)calloc(2 * samples + 1, sizeof(double));
+    raster.starts = (size_t  *)calloc(figure->size + 1, sizeof(size_t));
+    raster.step_x = GridStep(figure->x_max - figure->x_min);
+    raster.step_y = GridStep(figure->y_max - figure->y_min);
+
+    bool isCorrect = (raster.pixels && raster.coords && raster.starts);
+    if (!isCorrect)
+    {
+        printf("Error allocating memory for the plot\n");
+    }
+
+    size_t start = 0;
+    for (int i = 0; isCorrect && i < figure->size; i++)
+    {
+        const PlotCurve *curve = &figure->curves[i];
+
+        raster.starts[i] = start;
+        double *x = raster.coords + 2 * start;
+        double *y = x + curve->count;
+        for (size_t j = 0; j < curve->count; j++)
+        {
+            x[j] = ToPixelX(&raster, curve->x[j]);
+            y[j] = ToPixelY(&raster, curve->y[j]);
+        }
+
+        start += curve->count;
+    }
+
+    raster.columns = (raster.width + TILE_SIZE - 1) / TILE_SIZE;
+    isCorrect = isCorrect && BinSegments(&raster);
+
+    if (isCorrect)
+    {
+        size_t tiles = (size_t)raster.columns * ((raster.height + TILE_SIZE - 1) / TILE_SIZE);
+        PoolFor(pool, tiles, TILES_PER_TASK, RenderTiles, &raster);
+
+        METRICS_SCOPE("png");
+        isCorrect = WritePng(filename, raster.pixels, raster.width, raster.height);
+    }
+
+    free(raster.pixels);
+    free(raster.coords);
+    free(raster.starts);
+    free(raster.bins);
+    free(raster.segments);
+
+    return isCorrect;
+}
+
+void PlotLegendLatex(FILE *texfile, const PlotFigure *figure)
+{
+    assert(figure);
+
+    if (texfile == nullptr || figure->size == 0) {return;}
+
+    fprintf(texfile, "Линии графика: ");
+    for (int i = 0; i < figure->size; i++)
+    {
+        int line_type = figure->curves[i].line_type;
+        int color     = (line_type > 0) ? (line_type - 1) % NUMBER_OF_COLORS : NUMBER_OF_COLORS - 1;
+
+        fprintf(texfile, "%s%s --- %s", (i > 0) ? ", " : "", figure->curves[i].title, LINE_COLOR_NAMES[color]);
+    }
+    fprintf(texfile, ".\n\n");
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Counting sort of the segments by the tile columns they
+//! reach, so a tile looks only at the segments near it
+//-----------------------------------------------------------
+static bool BinSegments(Raster *raster)
+{
+    const PlotFigure *figure = raster->figure;
+
+    size_t number_of_bins = (size_t)figure->size * (raster->columns + 1) + 1;
+    raster->bins = (size_t *)calloc(number_of_bins, sizeof(size_t));
+    if (raster->bins == nullptr)
+    {
+        printf("Error allocating memory for the plot\n");
+        return false;
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int curve = 0; curve < figure->size; curve++)
+        {
+            const double *x      = raster->coords + 2 * raster->starts[curve];
+            const double *y      = x + figure->curves[curve].count;
+            size_t       *bins   = raster->bins + (size_t)curve * (raster->columns + 1);
+            int           first  = 0;
+            int           last   = 0;
+
+            for (size_t i = 1; i < figure->curves[curve].count; i++)
+            {
+                if (!SegmentSpan(x, y, i, &first, &last)) {continue;}
+
+                first = (first > 0) ? first / TILE_SIZE : 0;
+                last  = (last  < raster->width - 1) ? last / TILE_SIZE : raster->columns - 1;
+                for (int column = first; column <= last; column++)
+                {
+                    if (pass == 0) {bins[column + 1]++;}
+                    else           {raster->segments[bins[column]++] = i;}
+                }
+            }
+        }
+
+        if (pass == 1) {break;}
+
+        //Starts of the bins, the second pass moves each to its end
+        for (size_t bin = 1; bin < number_of_bins; bin++)
+        {
+            raster->bins[bin] += raster->bins[bin - 1];
+        }
+
+        raster->segments = (size_t *)calloc(raster->bins[number_of_bins - 1] + 1, sizeof(size_t));
+        if (raster->segments == nullptr)
+        {
+            printf("Error allocating memory for the plot\n");
+            return false;
+        }
+    }
+
+    //Back to the starts
+    for (size_t bin = number_of_bins - 1; bin > 0; bin--)
+    {
+        raster->bins[bin] = raster->bins[bin - 1];
+    }
+    raster->bins[0] = 0;
+
+    return true;
+}
+
+//-----------------------------------------------------------
+//! Columns of pixels the segment from sample i - 1 to sample i
+//! reaches. False if it is not drawn.
+//-----------------------------------------------------------
+static bool SegmentSpan(const double *x, const double *y, size_t i, int *first, int *last)
+{
+    if (!std::isfinite(y[i - 1]) || !std::isfinite(y[i])) {return false;}
+
+    double reach = LINE_HALF_WIDTH + 1;
+
+    *first = (int)floor(fmin(x[i - 1], x[i]) - reach);
+    *last  = (int)ceil (fmax(x[i - 1], x[i]) + reach);
+
+    return true;
+}
+
+static void RenderTiles(void *raster_ptr, size_t start, size_t end)
+{
+    const Raster     *raster = (const Raster *)raster_ptr;
+    const PlotFigure *figure = raster->figure;
+
+    int   tiles_x = raster->columns;
+    float coverage[TILE_SIZE * TILE_SIZE] = {};
+
+    for (size_t tile = start; tile < end; tile++)
+    {
+        int left   = (int)(tile % tiles_x) * TILE_SIZE;
+        int top    = (int)(tile / tiles_x) * TILE_SIZE;
+        int right  = (left + TILE_SIZE < raster->width ) ? left + TILE_SIZE : raster->width;
+        int bottom = (top  + TILE_SIZE < raster->height) ? top  + TILE_SIZE : raster->height;
+
+        for (int y = top; y < bottom; y++)
+        {
+            for (int x = left; x < right; x++) {FillPixel(raster, x, y, BACKGROUND_COLOR);}
+        }
+
+        for (double grid = ceil(figure->x_min / raster->step_x) * raster->step_x; grid <= figure->x_max; grid += raster->step_x)
+        {
+            int x = (int)lround(ToPixelX(raster, grid));
+            for (int y = top; x >= left && x < right && y < bottom; y++) {FillPixel(raster, x, y, GRID_COLOR);}
+        }
+        for (double grid = ceil(figure->y_min / raster->step_y) * raster->step_y; grid <= figure->y_max; grid += raster->step_y)
+        {
+            int y = (int)lround(ToPixelY(raster, grid));
+            for (int x = left; y >= top && y < bottom && x < right; x++) {FillPixel(raster, x, y, GRID_COLOR);}
+        }
+
+        //Axes through zero and the frame
+        int axis_x[] = {0, raster->width  - 1, (int)lround(ToPixelX(raster, 0))};
+        int axis_y[] = {0, raster->height - 1, (int)lround(ToPixelY(raster, 0))};
+        for (int i = 0; i < 3; i++)
+        {
+            for (int y = top;  axis_x[i] >= left && axis_x[i] < right  && y < bottom; y++) {FillPixel(raster, axis_x[i], y, AXIS_COLOR);}
+            for (int x = left; axis_y[i] >= top  && axis_y[i] < bottom && x < right;  x++) {FillPixel(raster, x, axis_y[i], AXIS_COLOR);}
+        }
+
+        for (int curve = 0; curve < figure->size; curve++)
+        {
+            DrawCurve(raster, curve, left, top, right, bottom, coverage);
+        }
+    }
+}
+
+//-----------------------------------------------------------
+//! Coverage of a pixel is its distance to the nearest segment
+//! of the curve, so joints of segments are not drawn twice
+//-----------------------------------------------------------
+static void DrawCurve(const Raster *raster, int curve, int left, int top, int right, int bottom, float *coverage)
+{
+    const PlotCurve *samples = &raster->figure->curves[curve];
+    const double    *x       = raster->coords + 2 * raster->starts[curve];
+    const double    *y       = x + samples->count;
+    const size_t    *bin     = raster->bins + (size_t)curve * (raster->columns + 1) + left / TILE_SIZE;
+
+    memset(coverage, 0, TILE_SIZE * TILE_SIZE * sizeof(float));
+
+    double reach   = LINE_HALF_WIDTH + 1;
+    double edge    = (LINE_HALF_WIDTH + 0.5) * (LINE_HALF_WIDTH + 0.5);
+    bool   isDrawn = false;
+
+    for (size_t segment = bin[0]; segment < bin[1]; segment++)
+    {
+        size_t i  = raster->segments[segment];
+        double ax = x[i - 1], ay = y[i - 1];
+        double bx = x[i],     by = y[i];
+
+        int from_x = (int)floor(fmin(ax, bx) - reach), to_x = (int)ceil(fmax(ax, bx) + reach);
+        int from_y = (int)floor(fmin(ay, by) - reach), to_y = (int)ceil(fmax(ay, by) + reach);
+        if (from_x < left) {from_x = left;}
+        if (from_y < top)  {from_y = top;}
+        if (to_x >= right)  {to_x = right  - 1;}
+        if (to_y >= bottom) {to_y = bottom - 1;}
+        if (from_x > to_x || from_y > to_y) {continue;}
+
+        double dx     = bx - ax;
+        double dy     = by - ay;
+        double length = dx * dx + dy * dy;
+
+        for (int py = from_y; py <= to_y; py++)
+        {
+            for (int px = from_x; px <= to_x; px++)
+            {
+                double t = (length > 0) ? ((px - ax) * dx + (py - ay) * dy) / length : 0;
+                t = fmin(fmax(t, 0), 1);
+
+                double off_x    = px - ax - t * dx;
+                double off_y    = py - ay - t * dy;
+                double distance = off_x * off_x + off_y * off_y;
+                if (distance >= edge) {continue;}
+
+                float cover = (float)fmin(LINE_HALF_WIDTH + 0.5 - sqrt(distance), 1);
+
+                float *pixel = &coverage[(py - top) * TILE_SIZE + (px - left)];
+                if (cover > *pixel)
+                {
+                    *pixel  = cover;
+                    isDrawn = true;
+                }
+            }
+        }
+    }
+
+    if (!isDrawn) {return;}
+
+    uint32_t color = LineColor(samples->line_type);
+    for (int py = top; py < bottom; py++)
+    {
+        for (int px = left; px < right; px++)
+        {
+            float cover = coverage[(py - top) * TILE_SIZE + (px - left)];
+            if (cover > 0) {FillPixel(raster, px, py, color, cover);}
+        }
+    }
+}
+
+static void FillPixel(const Raster *raster, int x, int y, uint32_t color, double alpha)
+{
+    uint8_t *pixel = raster->pixels + ((size_t)y * raster->width + x) * BYTES_PER_PIXEL;
+
+    for (int channel = 0; channel < BYTES_PER_PIXEL; channel++)
+    {
+        double value = (color >> (8 * (BYTES_PER_PIXEL - 1 - channel))) & 0xFF;
+        pixel[channel] = (uint8_t)lround(pixel[channel] * (1 - alpha) + value * alpha);
+    }
+}
+
+//-----------------------------------------------------------
+//! 1, 2 or 5 times a power of ten
+//-----------------------------------------------------------
+static double GridStep(double range)
+{
+    double step  = range / GRID_LINES;
+    double power = pow(10, floor(log10(step)));
+
+    if (step <= power)     {return power;}
+    if (step <= 2 * power) {return 2 * power;}
+    if (step <= 5 * power) {return 5 * power;}
+    return 10 * power;
+}
+
+//-----------------------------------------------------------
+//! The grid lines are walked by adding the step, so it has to
+//! move a line at both ends of the range
+//-----------------------------------------------------------
+static bool isRangeValid(double min, double max, double step)
+{
+    return std::isfinite(min) && std::isfinite(max) && min < max &&
+           std::isfinite(step) && min + step > min && max + step > max;
+}
+
+static double ToPixelX(const Raster *raster, double x)
+{
+    const PlotFigure *figure = raster->figure;
+
+    return (x - figure->x_min) * (raster->width - 1) / (figure->x_max - figure->x_min);
+}
+
+//-----------------------------------------------------------
+//! Far points are moved closer, so segments to them stay steep
+//! and the arithmetic stays finite. Values that are not finite
+//! stay NAN.
+//-----------------------------------------------------------
+static double ToPixelY(const Raster *raster, double y)
+{
+    const PlotFigure *figure = raster->figure;
+
+    if (!std::isfinite(y)) {return NAN;}
+
+    double pixel = (figure->y_max - y) * (raster->height - 1) / (figure->y_max - figure->y_min);
+
+    return fmin(fmax(pixel, -raster->height), 2.0 * raster->height);
+}
+
+static uint32_t LineColor(int line_type)
+{
+    return (line_type > 0) ? LINE_COLORS[(line_type - 1) % NUMBER_OF_COLORS] : LINE_COLORS[NUMBER_OF_COLORS - 1];
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! RGB PNG with rows of filter 0 in one deflate block of the
+//! fixed Huffman codes. Runs of one color are matches with
+//! the previous pixel, which is most of a plot.
+//-----------------------------------------------------------
+static bool WritePng(const char *filename, const uint8_t *pixels, int width, int height)
+{
+    size_t row_len = (size_t)width * BYTES_PER_PIXEL + 1;
+    size_t raw_len = row_len * height;
+
+    uint8_t  *raw    = (uint8_t *)calloc(raw_len, sizeof(uint8_t));
+    BitWriter writer = {};
+    writer.data = (uint8_t *)calloc(raw_len + raw_len / 8 + 16, sizeof(uint8_t));
+
+    if (raw == nullptr || writer.data == nullptr)
+    {
+        printf("Error allocating memory for the PNG\n");
+        free(raw);
+        free(writer.data);
+        return false;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(raw + y * row_len + 1, pixels + (size_t)y * width * BYTES_PER_PIXEL, row_len - 1);
+    }
+
+    //zlib header: deflate, 32K window, no dictionary
+    writer.data[writer.size++] = 0x78;
+    writer.data[writer.size++] = 0x01;
+    Deflate(&writer, raw, raw_len);
+    PutBigEndian(writer.data + writer.size, Adler32(raw, raw_len));
+    writer.size += 4;
+
+    free(raw);
+
+    uint8_t header[13] = {};
+    PutBigEndian(header,     width);
+    PutBigEndian(header + 4, height);
+    header[8] = 8;      //bits per channel
+    header[9] = 2;      //RGB
+
+    FILE *file = fopen(filename, "wb");
+    if (file == nullptr)
+    {
+        printf("Error opening file for plot: %s\n", filename);
+        free(writer.data);
+        return false;
+    }
+
+    fwrite(PNG_SIGNATURE, sizeof(uint8_t), sizeof(PNG_SIGNATURE), file);
+    PutChunk(file, "IHDR", header, sizeof(header));
+    PutChunk(file, "IDAT", writer.data, writer.size);
+    PutChunk(file, "IEND", nullptr, 0);
+
+    bool isWritten = (fclose(file) == 0);
+    if (!isWritten)
+    {
+        printf("Error writing file for plot: %s\n", filename);
+    }
+
+    free(writer.data);
+    return isWritten;
+}
+
+static void Deflate(BitWriter *writer, const uint8_t *data, size_t size)
+{
+    //Last block, fixed Huffman codes
+    PutBits(writer, 1, 1);
+    PutBits(writer, 1, 2);
+
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t run = 0;
+        while (i >= BYTES_PER_PIXEL && run < MAX_MATCH_LEN && i + run < size && data[i + run] == data[i + run - BYTES_PER_PIXEL])
+        {
+            run++;
+        }
+
+        if (run < MIN_MATCH_LEN)
+        {
+            PutLiteral(writer, data[i]);
+            i++;
+            continue;
+        }
+
+        int code = LENGTH_CODES - 1;
+        while (LENGTH_BASES[code] > (int)run) {code--;}
+
+        PutLiteral(writer, 257 + code);
+        PutBits   (writer, (uint32_t)run - LENGTH_BASES[code], LENGTH_EXTRA_BITS[code]);
+        PutCode   (writer, PIXEL_DISTANCE_CODE, 5);
+
+        i += run;
+    }
+
+    PutLiteral(writer, 256);
+
+    if (writer->count > 0)
+    {
+        writer->data[writer->size++] = (uint8_t)writer->bits;
+        writer->bits  = 0;
+        writer->count = 0;
+    }
+}
+
+static void PutBits(BitWriter *writer, uint32_t value, int count)
+{
+    writer->bits  |= value << writer->count;
+    writer->count += count;
+
+    while (writer->count >= 8)
+    {
+        writer->data[writer->size++] = (uint8_t)writer->bits;
+        writer->bits  >>= 8;
+        writer->count  -= 8;
+    }
+}
+
+//-----------------------------------------------------------
+//! Huffman codes go most significant bit first
+//-----------------------------------------------------------
+static void PutCode(BitWriter *writer, uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+
+    PutBits(writer, reversed, length);
+}
+
+static void PutLiteral(BitWriter *writer, int value)
+{
+    if      (value < 144) {PutCode(writer, 0x30  + value,       8);}
+    else if (value < 256) {PutCode(writer, 0x190 + value - 144, 9);}
+    else if (value < 280) {PutCode(writer,         value - 256, 7);}
+    else                  {PutCode(writer, 0xC0  + value - 280, 8);}
+}
+
+static void PutChunk(FILE *file, const char *type, const uint8_t *data, size_t size)
+{
+    uint8_t number[4] = {};
+
+    PutBigEndian(number, (uint32_t)size);
+    fwrite(number, sizeof(uint8_t), 4, file);
+    fwrite(type,   sizeof(char),    4, file);
+    if (size > 0) {fwrite(data, sizeof(uint8_t), size, file);}
+
+    uint32_t crc = Crc32(0xFFFFFFFF, (const uint8_t *)type, 4);
+    if (size > 0) {crc = Crc32(crc, data, size);}
+
+    PutBigEndian(number, crc ^ 0xFFFFFFFF);
+    fwrite(number, sizeof(uint8_t), 4, file);
+}
+
+static void PutBigEndian(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)(value >> 24);
+    data[1] = (uint8_t)(value >> 16);
+    data[2] = (uint8_t)(value >>  8);
+    data[3] = (uint8_t)(value);
+}
+
+//-----------------------------------------------------------
+//! Chunks are small except IDAT, which is compressed, so the
+//! CRC is done bit by bit without a table
+//-----------------------------------------------------------
+static uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t Adler32(const uint8_t *data, size_t size)
+{
+    uint32_t low  = 1;
+    uint32_t high = 0;
+
+    //The sums do not overflow in a block, so the modulo is taken once per block
+    for (size_t start = 0; start < size; start += ADLER_BLOCK_LEN)
+    {
+        size_t end = (start + ADLER_BLOCK_LEN < size) ? start + ADLER_BLOCK_LEN : size;
+        for (size_t i = start; i < end; i++)
+        {
+            low  += data[i];
+            high += low;
+        }
+
+        low  %= ADLER_MOD;
+        high %= ADLER_MOD;
+    }
+
+    return (high << 16) | low;
+}
+
+//----------------------------------------------------------------------------------------------------------------
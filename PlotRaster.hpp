@@ -0,0 +1,74 @@
+#ifndef PLOT_RASTER_HPP
+#define PLOT_RASTER_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Size of the PNG, the same as the png terminal of gnuplot
+static const int PLOT_RASTER_WIDTH  = 640;
+static const int PLOT_RASTER_HEIGHT = 480;
+
+static const int MAX_CURVE_TITLE_LEN = 32;
+
+//----------------------------------------------------------------------------------------------------------------
+
+struct DiffPool;
+
+//-----------------------------------------------------------
+//! Samples of one curve. x is one allocation of 2*count
+//! doubles owned by the curve, y = x + count. line_type is
+//! the gnuplot "lt" number, it picks the color.
+//-----------------------------------------------------------
+struct PlotCurve
+{
+    double *x         = nullptr;
+    double *y         = nullptr;
+    size_t  count     = 0;
+    int     line_type = 1;
+
+    char    title[MAX_CURVE_TITLE_LEN] = "";
+};
+
+struct PlotFigure
+{
+    double     x_min = -1;
+    double     x_max =  1;
+    double     y_min = -1;
+    double     y_max =  1;
+
+    PlotCurve *curves   = nullptr;
+    int        size     = 0;
+    int        capacity = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+void PlotFigureDtor (PlotFigure *figure);
+
+//-----------------------------------------------------------
+//! Takes x (2*count doubles, y = x + count) over. mode is the
+//! gnuplot style of the curve, only "lt N" is used.
+//-----------------------------------------------------------
+bool PlotFigureAdd  (PlotFigure *figure, double *x, size_t count, const char *mode, const char *title);
+
+//-----------------------------------------------------------
+//! Draws the grid, the axes and the curves of the figure into
+//! a PNG without gnuplot. Tiles of the image are drawn in
+//! parallel with a pool. Samples that are not finite break
+//! the curve. An empty or not finite range is not drawn.
+//-----------------------------------------------------------
+bool PlotRender     (const PlotFigure *figure, const char *filename, DiffPool *pool = nullptr);
+
+//-----------------------------------------------------------
+//! Colors of the curves for the LaTeX report, the PNG has no
+//! text
+//-----------------------------------------------------------
+void PlotLegendLatex (FILE *texfile, const PlotFigure *figure);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //PLOT_RASTER_HPP
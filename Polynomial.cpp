@@ -0,0 +1,153 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "Differentiator.hpp"
+#include "Polynomial.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool   PolynomialReserve (Polynomial *poly, int capacity);
+static double IntPower          (double base, int power);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool PolynomialCtor(Polynomial *poly, const char *var, double center, int capacity)
+{
+    assert(poly && var);
+
+    *poly = {};
+
+    poly->center = center;
+    strncpy(poly->var, var, MAX_VAR_NAME_LEN - 1);
+
+    return PolynomialReserve(poly, (capacity <= 0) ? 1 : capacity);
+}
+
+void PolynomialDtor(Polynomial *poly)
+{
+    if (poly == nullptr) {return;}
+
+    free(poly->powers);
+    free(poly->coefs );
+
+    *poly = {};
+}
+
+bool PolynomialAppend(Polynomial *poly, int power, double coef)
+{
+    assert(poly && power >= 0);
+
+    if (poly->size > 0 && poly->powers[poly->size - 1] >= power)
+    {
+        printf("Error: polynomial terms must be added in increasing order of power.\n");
+        return false;
+    }
+
+    if (coef == 0) {return true;}
+
+    if (poly->size == poly->capacity && !PolynomialReserve(poly, 2*poly->capacity + 1))
+    {
+        return false;
+    }
+
+    poly->powers[poly->size] = power;
+    poly->coefs [poly->size] = coef;
+    poly->size++;
+
+    return true;
+}
+
+double PolynomialEvaluate(const Polynomial *poly, double value)
+{
+    assert(poly);
+
+    if (poly->size == 0) {return 0;}
+
+    double shift  = value - poly->center;
+    double result = poly->coefs[poly->size - 1];
+
+    for (int i = poly->size - 2; i >= 0; i--)
+    {
+        result = result * IntPower(shift, poly->powers[i + 1] - poly->powers[i]) + poly->coefs[i];
+    }
+
+    return result * IntPower(shift, poly->powers[0]);
+}
+
+Node *PolynomialTermNode(const Polynomial *poly, int power, double coef)
+{
+    assert(poly);
+
+    if (power == 0 || coef == 0) {return CreateNum(coef);}
+
+    Node *base = CreateVar(poly->var);
+    if      (poly->center > 0) {base = Sub(base, CreateNum( poly->center));}
+    else if (poly->center < 0) {base = Add(base, CreateNum(-poly->center));}
+
+    Node *factor = (power == 1) ? base : Pow(base, CreateNum(power));
+
+    return (coef == 1) ? factor : Mul(CreateNum(coef), factor);
+}
+
+Node *nodeFromPolynomial(const Polynomial *poly)
+{
+    assert(poly);
+
+    if (poly->size == 0) {return CreateNum(0);}
+
+    Node *result = PolynomialTermNode(poly, poly->powers[0], poly->coefs[0]);
+
+    for (int i = 1; i < poly->size; i++)
+    {
+        double coef = poly->coefs[i];
+        Node  *term = PolynomialTermNode(poly, poly->powers[i], fabs(coef));
+
+        result = (coef < 0) ? Sub(result, term) : Add(result, term);
+    }
+
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool PolynomialReserve(Polynomial *poly, int capacity)
+{
+    int    *powers = (int    *)realloc(poly->powers, capacity * sizeof(int   ));
+    if (powers == nullptr)
+    {
+        printf("Error allocating memory for polynomial.\n");
+        return false;
+    }
+    poly->powers = powers;
+
+    double *coefs  = (double *)realloc(poly->coefs,  capacity * sizeof(double));
+    if (coefs == nullptr)
+    {
+        printf("Error allocating memory for polynomial.\n");
+        return false;
+    }
+    poly->coefs = coefs;
+
+    poly->capacity = capacity;
+
+    return true;
+}
+
+static double IntPower(double base, int power)
+{
+    double result = 1;
+
+    while (power > 0)
+    {
+        if (power & 1) {result *= base;}
+
+        base  *= base;
+        power >>= 1;
+    }
+
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,54 @@
+#ifndef POLYNOMIAL_HPP
+#define POLYNOMIAL_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Sparse polynomial in powers of (var - center).
+//!
+//! Only nonzero terms are stored, powers[] is strictly
+//! increasing and coefs[i] is the coefficient of
+//! (var - center)^powers[i].
+//-----------------------------------------------------------
+struct Polynomial
+{
+    int    *powers   = nullptr;
+    double *coefs    = nullptr;
+    int     size     = 0;
+    int     capacity = 0;
+
+    double  center   = 0;
+    char    var[MAX_VAR_NAME_LEN] = "";
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool PolynomialCtor (Polynomial *poly, const char *var, double center, int capacity = 16);
+void PolynomialDtor (Polynomial *poly);
+
+//-----------------------------------------------------------
+//! Add the term coef*(var - center)^power. Power must be
+//! greater than powers of the terms already added. Zero
+//! coefficients are not stored.
+//-----------------------------------------------------------
+bool   PolynomialAppend   (Polynomial *poly, int power, double coef);
+
+//-----------------------------------------------------------
+//! Value of the polynomial at the point (sparse Horner scheme)
+//-----------------------------------------------------------
+double PolynomialEvaluate (const Polynomial *poly, double value);
+
+//-----------------------------------------------------------
+//! Expression tree of one term or of the whole polynomial,
+//! terms in increasing order of power. Used for LaTeX output.
+//-----------------------------------------------------------
+Node  *PolynomialTermNode (const Polynomial *poly, int power, double coef);
+Node  *nodeFromPolynomial (const Polynomial *poly);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //POLYNOMIAL_HPP
@@ -0,0 +1,575 @@
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "logs.hpp"
+#include "Server.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int    SERVER_BACKLOG       = 64;
+//Open connections at most, the queues hold all of them
+static const int    CONNECTION_QUEUE_LEN = 256;
+static const size_t MAX_REQUEST_LEN      = 4096;
+static const int    MAX_REQUEST_ORDER    = 32;
+static const int    MAX_OUTPUTS_LEN      = 16;
+static const int    POLL_TIMEOUT_MS      = 200;
+
+//-----------------------------------------------------------
+//! A connection with the start of a request it has not ended
+//! yet
+//-----------------------------------------------------------
+struct Connection
+{
+    int    fd   = -1;
+    size_t size = 0;
+    char   buffer[MAX_REQUEST_LEN + 1] = "";
+};
+
+//-----------------------------------------------------------
+//! Connections waiting for a worker or for the poll loop
+//-----------------------------------------------------------
+struct ConnectionQueue
+{
+    Connection     *items[CONNECTION_QUEUE_LEN] = {};
+    int             head      = 0;
+    int             size      = 0;
+    bool            isStopped = false;
+
+    pthread_mutex_t lock      = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t  not_empty = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t  not_full  = PTHREAD_COND_INITIALIZER;
+};
+
+//-----------------------------------------------------------
+//! Workers take ready connections from 'queue' and put the
+//! open ones to 'idle', writing a byte to 'wake' so the poll
+//! loop takes them back
+//-----------------------------------------------------------
+struct Server
+{
+    DiffContext      context     = {};
+    ConnectionQueue  queue       = {};
+    ConnectionQueue  idle        = {};
+    int              wake[2]     = {-1, -1};
+    std::atomic<int> connections = {0};
+};
+
+//Set by the signal handler, read by all threads (lock-free, so signal-safe)
+static std::atomic<bool> IsStopping(false);
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void  StopHandler       (int signal_number);
+static bool  QueuePush         (ConnectionQueue *queue, Connection *connection);
+static Connection *QueuePop    (ConnectionQueue *queue, bool isWaiting);
+static void  QueueStop         (ConnectionQueue *queue);
+static void *Worker            (void *server);
+static bool  ServeConnection   (DiffContext *context, Connection *connection);
+static void  CloseConnection   (Server *server, Connection *connection);
+static void  HandleRequest     (DiffContext *context, const char *request, FILE *response);
+static bool  SendAll           (int fd, const char *data, size_t size);
+static bool  MakeSocketAddress (sockaddr_un *address, const char *socket_path);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool ServerRun(const char *socket_path, int workers, const DiffSettings *settings)
+{
+    assert(socket_path);
+
+    if (workers <= 0) {workers = 1;}
+
+    sockaddr_un address = {};
+    if (!MakeSocketAddress(&address, socket_path)) {return false;}
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        printf("Error creating socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    unlink(socket_path);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SERVER_BACKLOG) != 0)
+    {
+        printf("Error listening on %s: %s\n", socket_path, strerror(errno));
+        close(listener);
+        return false;
+    }
+
+    Server    *server  = (Server *)calloc(1, sizeof(Server));
+    pthread_t *threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+    if (server == nullptr || threads == nullptr || !DiffContextCtor(&server->context, settings))
+    {
+        printf("Error allocating memory for server.\n");
+        free(server);
+        free(threads);
+        close(listener);
+        return false;
+    }
+    server->queue       = {};
+    server->idle        = {};
+    server->connections = 0;
+
+    if (pipe2(server->wake, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        printf("Error creating a pipe: %s\n", strerror(errno));
+        DiffContextDtor(&server->context);
+        free(server);
+        free(threads);
+        close(listener);
+        return false;
+    }
+
+    //Workers block the stop signals, so they are delivered to this thread
+    sigset_t stop_signals = {}, old_signals = {};
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_create(&threads[i], nullptr, Worker, server);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+
+    struct sigaction action = {};
+    action.sa_handler = StopHandler;
+    sigaction(SIGINT,  &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Server is listening on %s with %d workers\n", socket_path, workers);
+    fflush(stdout);
+    LOG_INFO("<p>Server is listening on %s with %d workers</p>\n", socket_path, workers);
+
+    //poll_fds[0] is the listener, poll_fds[1] is the wake pipe, the rest are idle[]
+    Connection *idle[CONNECTION_QUEUE_LEN]         = {};
+    pollfd      poll_fds[CONNECTION_QUEUE_LEN + 2] = {};
+    int         idle_count = 0;
+
+    IsStopping = false;
+    while (!IsStopping)
+    {
+        //New connections wait in the backlog while the queues are full
+        poll_fds[0] = {(server->connections < CONNECTION_QUEUE_LEN) ? listener : -1, POLLIN, 0};
+        poll_fds[1] = {server->wake[0], POLLIN, 0};
+        for (int i = 0; i < idle_count; i++)
+        {
+            poll_fds[i + 2] = {idle[i]->fd, POLLIN, 0};
+        }
+
+        if (poll(poll_fds, idle_count + 2, POLL_TIMEOUT_MS) <= 0) {continue;}
+
+        //Ready connections go to the workers, the order of idle[] does not matter
+        for (int i = idle_count - 1; i >= 0; i--)
+        {
+            if (poll_fds[i + 2].revents == 0) {continue;}
+
+            QueuePush(&server->queue, idle[i]);
+            idle[i] = idle[--idle_count];
+        }
+
+        if (poll_fds[1].revents != 0)
+        {
+            char drain[CONNECTION_QUEUE_LEN] = "";
+            while (read(server->wake[0], drain, sizeof(drain)) > 0) {}
+
+            Connection *connection = nullptr;
+            while ((connection = QueuePop(&server->idle, false)) != nullptr)
+            {
+                idle[idle_count++] = connection;
+            }
+        }
+
+        if (poll_fds[0].revents == 0) {continue;}
+
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno != EINTR) {LOG_ERROR("accept: %s</p>\n", strerror(errno));}
+            continue;
+        }
+
+        Connection *connection = (Connection *)calloc(1, sizeof(Connection));
+        if (connection == nullptr)
+        {
+            LOG_ERROR("Error allocating memory for a connection</p>\n");
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        server->connections++;
+        idle[idle_count++] = connection;
+    }
+
+    QueueStop(&server->queue);
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_join(threads[i], nullptr);
+    }
+
+    Connection *connection = nullptr;
+    while ((connection = QueuePop(&server->idle, false)) != nullptr)
+    {
+        idle[idle_count++] = connection;
+    }
+    for (int i = 0; i < idle_count; i++)
+    {
+        CloseConnection(server, idle[i]);
+    }
+
+    close(server->wake[0]);
+    close(server->wake[1]);
+    close(listener);
+    unlink(socket_path);
+
+    printf("Server is stopped\n");
+    LOG_INFO("<p>Server is stopped</p>\n");
+
+    DiffContextDtor(&server->context);
+    free(threads);
+    free(server);
+
+    return true;
+}
+
+bool ClientRun(const char *socket_path, FILE *input, FILE *output)
+{
+    assert(socket_path && input && output);
+
+    sockaddr_un address = {};
+    if (!MakeSocketAddress(&address, socket_path)) {return false;}
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        printf("Error connecting to %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) {close(fd);}
+        return false;
+    }
+
+    char   *line     = nullptr;
+    size_t  line_cap = 0;
+    ssize_t line_len = 0;
+    bool    isOk     = true;
+
+    char    buffer[MAX_REQUEST_LEN] = "";
+
+    while (isOk && (line_len = getline(&line, &line_cap, input)) > 0)
+    {
+        if (line[line_len - 1] != '\n') {line[line_len++] = '\n';}
+        if (line_len == 1) {continue;}
+
+        isOk = SendAll(fd, line, line_len);
+
+        //The response ends with an empty line
+        char last[2] = {};
+        while (isOk)
+        {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                isOk = false;
+                break;
+            }
+
+            fwrite(buffer, sizeof(char), received, output);
+
+            if (received >= 2) {last[0] = buffer[received - 2];}
+            else               {last[0] = last[1];}
+            last[1] = buffer[received - 1];
+
+            if (last[0] == '\n' && last[1] == '\n') {break;}
+        }
+    }
+
+    free(line);
+    close(fd);
+
+    return isOk;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void StopHandler(int)
+{
+    IsStopping = true;
+}
+
+static bool QueuePush(ConnectionQueue *queue, Connection *connection)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->size == CONNECTION_QUEUE_LEN && !queue->isStopped)
+    {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    bool isPushed = !queue->isStopped;
+    if (isPushed)
+    {
+        queue->items[(queue->head + queue->size) % CONNECTION_QUEUE_LEN] = connection;
+        queue->size++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return isPushed;
+}
+
+//-----------------------------------------------------------
+//! Returns nullptr when the queue is empty and it is stopped
+//! or !isWaiting
+//-----------------------------------------------------------
+static Connection *QueuePop(ConnectionQueue *queue, bool isWaiting)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    while (isWaiting && queue->size == 0 && !queue->isStopped)
+    {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    Connection *connection = nullptr;
+    if (queue->size > 0)
+    {
+        connection = queue->items[queue->head];
+        queue->head = (queue->head + 1) % CONNECTION_QUEUE_LEN;
+        queue->size--;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return connection;
+}
+
+static void QueueStop(ConnectionQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    queue->isStopped = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *Worker(void *server)
+{
+    Server *self = (Server *)server;
+
+    Connection *connection = nullptr;
+    while ((connection = QueuePop(&self->queue, true)) != nullptr)
+    {
+        if (!ServeConnection(&self->context, connection))
+        {
+            CloseConnection(self, connection);
+            continue;
+        }
+
+        QueuePush(&self->idle, connection);
+
+        const char wake = 0;
+        write(self->wake[1], &wake, 1);
+    }
+
+    return nullptr;
+}
+
+//-----------------------------------------------------------
+//! Answers the requests the connection has sent, in order.
+//! Returns false if the connection is to be closed: the
+//! client has closed it or a line is longer than
+//! MAX_REQUEST_LEN.
+//-----------------------------------------------------------
+static bool ServeConnection(DiffContext *context, Connection *connection)
+{
+    char   *buffer = connection->buffer;
+    size_t  size   = connection->size;
+
+    ssize_t received = recv(connection->fd, buffer + size, MAX_REQUEST_LEN - size, MSG_DONTWAIT);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {return true;}
+    if (received <= 0) {return false;}
+    size += received;
+
+    char *start = buffer;
+    char *end   = nullptr;
+
+    while ((end = (char *)memchr(start, '\n', size - (start - buffer))) != nullptr)
+    {
+        *end = '\0';
+
+        char   *response      = nullptr;
+        size_t  response_size = 0;
+        FILE   *stream        = open_memstream(&response, &response_size);
+
+        HandleRequest(context, start, stream);
+        fclose(stream);
+
+        bool isSent = SendAll(connection->fd, response, response_size);
+        free(response);
+        if (!isSent) {return false;}
+
+        start = end + 1;
+    }
+
+    size -= start - buffer;
+    memmove(buffer, start, size);
+    connection->size = size;
+
+    if (size == MAX_REQUEST_LEN)
+    {
+        const char error[] = "error request is too long\n\n";
+        SendAll(connection->fd, error, sizeof(error) - 1);
+        return false;
+    }
+
+    return true;
+}
+
+static void CloseConnection(Server *server, Connection *connection)
+{
+    close(connection->fd);
+    free(connection);
+
+    server->connections--;
+}
+
+static void HandleRequest(DiffContext *context, const char *request, FILE *response)
+{
+    double point    = 0;
+    int    order    = 0;
+    int    position = 0;
+    char   outputs[MAX_OUTPUTS_LEN] = "";
+
+    if (sscanf(request, "%lg %d %15s %n", &point, &order, outputs, &position) != 3 || request[position] == '\0')
+    {
+        fprintf(response, "error expected '<point> <order> <outputs> <function>'\n\n");
+        return;
+    }
+    if (order < 0 || order > MAX_REQUEST_ORDER)
+    {
+        fprintf(response, "error order must be from 0 to %d\n\n", MAX_REQUEST_ORDER);
+        return;
+    }
+
+    Node *node = DiffContextFunction(context, request + position);
+    if (node == nullptr)
+    {
+        fprintf(response, "error syntax error in the function\n\n");
+        return;
+    }
+
+    bool needDerivatives = strpbrk(outputs, "dntg") != nullptr;
+    int  count           = needDerivatives ? ((order > 0) ? order : 1) : 0;
+
+    Node  **derivatives = (Node **)calloc(count + 1, sizeof(Node *));
+    double *values      = (double *)calloc(count + 1, sizeof(double));
+
+    Binding binding = {"x", point};
+
+    DiffContextDerivatives(context, node, "x", count, derivatives);
+
+    values[0] = DiffContextEvaluate(context, node, &binding, 1);
+    for (int i = 1; i <= count; i++)
+    {
+        values[i] = DiffContextEvaluate(context, derivatives[i - 1], &binding, 1);
+    }
+
+    fprintf(response, "ok\n");
+
+    if (strchr(outputs, 'f') != nullptr)
+    {
+        fprintf(response, "f ");
+        treePrintInfix(response, node);
+        fprintf(response, "\n");
+    }
+
+    if (strchr(outputs, 'v') != nullptr) {fprintf(response, "v %.17g\n", values[0]);}
+
+    for (int i = 1; i <= order && strchr(outputs, 'd') != nullptr; i++)
+    {
+        fprintf(response, "d%d ", i);
+        treePrintInfix(response, derivatives[i - 1]);
+        fprintf(response, "\n");
+    }
+
+    for (int i = 1; i <= order && strchr(outputs, 'n') != nullptr; i++)
+    {
+        fprintf(response, "n%d %.17g\n", i, values[i]);
+    }
+
+    if (strchr(outputs, 't') != nullptr)
+    {
+        fprintf(response, "t");
+
+        double inv_factorial = 1;
+        for (int i = 0; i <= order; i++)
+        {
+            if (i > 0) {inv_factorial /= i;}
+            fprintf(response, " %.17g", values[i] * inv_factorial);
+        }
+        fprintf(response, "\n");
+    }
+
+    if (strchr(outputs, 'g') != nullptr)
+    {
+        fprintf(response, "g %.17g %.17g\n", values[1], values[0] - values[1] * point);
+    }
+
+    fprintf(response, "\n");
+
+    for (int i = 0; i < count; i++)
+    {
+        treeDtor(derivatives[i]);
+    }
+    free(derivatives);
+    free(values);
+    treeDtor(node);
+}
+
+static bool SendAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {continue;}
+        if (sent <= 0) {return false;}
+
+        data += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+static bool MakeSocketAddress(sockaddr_un *address, const char *socket_path)
+{
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        printf("Error: socket path is too long: %s\n", socket_path);
+        return false;
+    }
+
+    *address = {};
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstdio>
+
+#include "DiffContext.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const char *const SERVER_STD_SOCKET = "./Diff.sock";
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Protocol: one request per line
+//!
+//!     <point> <order> <outputs> <function>
+//!
+//! outputs is a set of letters: f - simplified function,
+//! v - value, d - derivatives, n - values of derivatives,
+//! t - Taylor coefficients, g - tangent. The response is
+//! "ok" or "error <message>", one line per output and an
+//! empty line:
+//!
+//!     f <function>
+//!     v <value>
+//!     d<i> <derivative>           (for i = 1..order)
+//!     n<i> <value>
+//!     t <c0> <c1> ... <c_order>   (coefficients of (x - point)^i)
+//!     g <slope> <intercept>
+//-----------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Serve requests on the Unix socket until SIGINT or SIGTERM.
+//! Idle connections wait in one poll loop, a connection with
+//! data is answered by one of 'workers' threads and goes back
+//! to the loop, so idle clients do not hold the workers. The
+//! workers share one context, so parsed functions and
+//! derivatives stay cached between requests.
+//-----------------------------------------------------------
+bool ServerRun (const char *socket_path, int workers, const DiffSettings *settings = nullptr);
+
+//-----------------------------------------------------------
+//! Send every line of the input to the server and copy the
+//! responses to the output
+//-----------------------------------------------------------
+bool ClientRun (const char *socket_path, FILE *input, FILE *output);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //SERVER_HPP
@@ -0,0 +1,425 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "CompactTree.hpp"
+#include "Differentiator.hpp"
+#include "Metrics.hpp"
+#include "SpecialPoints.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const int    REFINE_ITERATIONS   = 100;
+static const double REFINE_TOLERANCE    = 1e-14;
+
+//|f| of an extremum, relative to max |f| on the grid, at which it is a root too
+static const double TOUCH_TOLERANCE     = 1e-10;
+
+//Points of one kind closer than this, relative to the range, are one point
+static const double DUPLICATE_TOLERANCE = 1e-9;
+
+//f, f' and f'' are scanned
+static const int    SCANNED_ORDERS      = 3;
+
+//-----------------------------------------------------------
+//! State of one FindSpecialPoints call. values[k*size + i] is
+//! the derivative of order k at grid[i], found[c] are the
+//! points of chunk c of the grid.
+//-----------------------------------------------------------
+struct SpecialSearch
+{
+    const char    *var        = nullptr;
+    const Node    *trees     [SPECIAL_DIFF_ORDERS + 1] = {};
+    CompactTree    compiled  [SCANNED_ORDERS] = {};
+    bool           isCompiled[SCANNED_ORDERS] = {};
+
+    double        *grid       = nullptr;
+    double        *values     = nullptr;
+    size_t         size       = 0;
+    double         scale      = 0;
+
+    SpecialPoints *found      = nullptr;
+    size_t         chunks     = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void   ScanGrid         (void *search, size_t start, size_t end);
+static void   RefineGrid       (void *search, size_t start, size_t end);
+static void   AddCrossing      (SpecialSearch *search, SpecialPoints *points, int order, double x, bool isRising);
+static double RefineZero       (const SpecialSearch *search, int order, double a, double b, double ga, double gb);
+static bool   PushPoint        (SpecialPoints *points, SpecialPointKind kind, double x, double value);
+static int    ComparePoints    (const void *first, const void *second);
+static void   DeleteDuplicates (SpecialPoints *points, double distance);
+
+//----------------------------------------------------------------------------------------------------------------
+
+void SpecialPointsDtor(SpecialPoints *points)
+{
+    if (points == nullptr) {return;}
+
+    free(points->points);
+
+    *points = {};
+}
+
+bool FindSpecialPoints(Node *node, const char *var, double from, double to, SpecialPoints *points, DiffCache *cache,
+                       DiffPool *pool)
+{
+    assert(node && var && points);
+
+    *points = {};
+
+    if (!(from < to) || !std::isfinite(from) || !std::isfinite(to))
+    {
+        printf("Error: wrong range [%lg, %lg] for the search of special points.\n", from, to);
+        return false;
+    }
+
+    METRICS_SCOPE("special points");
+
+    DiffCache local_cache = {};
+    if (cache == nullptr)
+    {
+        if (!DiffCacheCtor(&local_cache)) {return false;}
+        cache = &local_cache;
+    }
+
+    SpecialSearch search = {};
+    search.var    = var;
+    search.size   = SPECIAL_SCAN_POINTS;
+    search.chunks = (search.size + SPECIAL_CHUNK_LEN - 1) / SPECIAL_CHUNK_LEN;
+    search.grid   = (double        *)calloc(search.size,                  sizeof(double));
+    search.values = (double        *)calloc(search.size * SCANNED_ORDERS, sizeof(double));
+    search.found  = (SpecialPoints *)calloc(search.chunks,                sizeof(SpecialPoints));
+
+    bool isCorrect = (search.grid != nullptr && search.values != nullptr && search.found != nullptr);
+    if (!isCorrect)
+    {
+        printf("Error allocating memory for the search of special points.\n");
+    }
+
+    for (int k = 0; isCorrect && k <= SPECIAL_DIFF_ORDERS; k++)
+    {
+        //Trees of the cache may be evicted by the next DiffCached, so the orders are copied
+        search.trees[k] = (k == 0) ? node : copyNode((Node *)DiffCached(cache, node, var, k));
+
+        if (k < SCANNED_ORDERS)
+        {
+            search.isCompiled[k] = compactIsExact(search.trees[k], var) && CompactTreeCtor(&search.compiled[k]) &&
+                                   compactFromNode(&search.compiled[k], search.trees[k]);
+        }
+    }
+
+    if (isCorrect)
+    {
+        double step = (to - from) / (search.size - 1);
+        for (size_t i = 0; i < search.size; i++)
+        {
+            search.grid[i] = from + i * step;
+        }
+        search.grid[search.size - 1] = to;
+
+        //The refinement looks at the neighbours of a chunk, so the scan is finished first
+        PoolFor(pool, search.size, SPECIAL_CHUNK_LEN, ScanGrid, &search);
+
+        for (size_t i = 0; i < search.size; i++)
+        {
+            double value = fabs(search.values[i]);
+            if (std::isfinite(value) && value > search.scale) {search.scale = value;}
+        }
+
+        PoolFor(pool, search.size, SPECIAL_CHUNK_LEN, RefineGrid, &search);
+
+        size_t total = 0;
+        for (size_t c = 0; c < search.chunks; c++)
+        {
+            total += search.found[c].size;
+        }
+
+        points->points   = (SpecialPoint *)calloc(total + 1, sizeof(SpecialPoint));
+        points->capacity = total + 1;
+        isCorrect        = (points->points != nullptr);
+
+        for (size_t c = 0; isCorrect && c < search.chunks; c++)
+        {
+            memcpy(points->points + points->size, search.found[c].points, search.found[c].size * sizeof(SpecialPoint));
+            points->size += search.found[c].size;
+        }
+
+        if (isCorrect)
+        {
+            qsort(points->points, points->size, sizeof(SpecialPoint), ComparePoints);
+            DeleteDuplicates(points, DUPLICATE_TOLERANCE * (to - from));
+        }
+    }
+
+    for (size_t c = 0; search.found != nullptr && c < search.chunks; c++)
+    {
+        SpecialPointsDtor(&search.found[c]);
+    }
+    for (int k = 0; k < SCANNED_ORDERS; k++)
+    {
+        CompactTreeDtor(&search.compiled[k]);
+    }
+    for (int k = 1; k <= SPECIAL_DIFF_ORDERS; k++)
+    {
+        treeDtor((Node *)search.trees[k]);
+    }
+
+    free(search.grid);
+    free(search.values);
+    free(search.found);
+
+    if (cache == &local_cache)
+    {
+        DiffCacheDtor(&local_cache);
+    }
+
+    return isCorrect;
+}
+
+void SpecialPointsLatex(FILE *texfile, const SpecialPoints *points, double from, double to)
+{
+    assert(points);
+
+    if (texfile == nullptr) {return;}
+
+    static const char *TITLES[NUMBER_OF_POINT_KINDS] =
+    {
+        "Нули функции",
+        "Точки минимума",
+        "Точки максимума",
+        "Точки перегиба",
+    };
+
+    fprintf(texfile, "Особые точки функции на отрезке $[%lg, %lg]$.\n\n", from, to);
+
+    for (int kind = 0; kind < NUMBER_OF_POINT_KINDS; kind++)
+    {
+        fprintf(texfile, "%s: ", TITLES[kind]);
+
+        int written = 0;
+        for (size_t i = 0; i < points->size; i++)
+        {
+            const SpecialPoint *point = &points->points[i];
+            if (point->kind != kind) {continue;}
+
+            fprintf(texfile, "%s$x = %lg", (written > 0) ? "; " : "", point->x);
+            if (kind != POINT_ROOT) {fprintf(texfile, ", f(x) = %lg", point->value);}
+            fprintf(texfile, "$");
+
+            written++;
+        }
+
+        fprintf(texfile, "%s.\n\n", (written == 0) ? "нет" : "");
+    }
+}
+
+const char *SpecialPointName(SpecialPointKind kind)
+{
+    switch (kind)
+    {
+    case POINT_ROOT:
+        return "root";
+    case POINT_MINIMUM:
+        return "minimum";
+    case POINT_MAXIMUM:
+        return "maximum";
+    case POINT_INFLECTION:
+        return "inflection";
+    default:
+        return "unknown";
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+static void ScanGrid(void *search_ptr, size_t start, size_t end)
+{
+    SpecialSearch *search = (SpecialSearch *)search_ptr;
+    const double  *grid   = search->grid + start;
+    size_t         size   = end - start;
+
+    for (int k = 0; k < SCANNED_ORDERS; k++)
+    {
+        double *values = search->values + k * search->size + start;
+
+        if (search->isCompiled[k] && compactEvaluateBatch(&search->compiled[k], search->var, grid, values, size)) {continue;}
+
+        for (size_t i = 0; i < size; i++)
+        {
+            values[i] = Evaluate(search->trees[k], search->var, grid[i]);
+        }
+    }
+}
+
+//-----------------------------------------------------------
+//! Sign changes between grid[i] and grid[i + 1] for i in the
+//! range, and zeros at its grid points. The range is whole
+//! chunks, each has its own list of points.
+//-----------------------------------------------------------
+static void RefineGrid(void *search_ptr, size_t start, size_t end)
+{
+    SpecialSearch *search = (SpecialSearch *)search_ptr;
+    const double  *grid   = search->grid;
+
+    for (int k = 0; k < SCANNED_ORDERS; k++)
+    {
+        const double *values = search->values + k * search->size;
+
+        for (size_t i = start; i < end; i++)
+        {
+            SpecialPoints *points = &search->found[i / SPECIAL_CHUNK_LEN];
+
+            double value = values[i];
+            double next  = (i + 1 < search->size) ? values[i + 1] : NAN;
+
+            if (value == 0)
+            {
+                double previous = (i > 0) ? values[i - 1] : NAN;
+
+                //Roots may be at the ends of the range, but not on a zero interval
+                bool isIsolated = (i > 0 && previous != 0) || (i + 1 < search->size && next != 0);
+
+                if      (k == 0 && isIsolated)         {PushPoint(points, POINT_ROOT, grid[i], 0);}
+                else if (k >  0 && previous * next < 0) {AddCrossing(search, points, k, grid[i], previous < 0);}
+                continue;
+            }
+
+            if (!(value * next < 0)) {continue;}
+
+            double x = RefineZero(search, k, grid[i], grid[i + 1], value, next);
+
+            //A sign change at a pole grows instead of vanishing
+            if (!(fabs(Evaluate(search->trees[k], search->var, x)) <= fmin(fabs(value), fabs(next)))) {continue;}
+
+            AddCrossing(search, points, k, x, value < 0);
+        }
+    }
+}
+
+static void AddCrossing(SpecialSearch *search, SpecialPoints *points, int order, double x, bool isRising)
+{
+    double value = (order == 0) ? 0 : Evaluate(search->trees[0], search->var, x);
+
+    switch (order)
+    {
+    case 0:
+        PushPoint(points, POINT_ROOT, x, 0);
+        break;
+    case 1:
+        PushPoint(points, isRising ? POINT_MINIMUM : POINT_MAXIMUM, x, value);
+        if (fabs(value) <= TOUCH_TOLERANCE * search->scale)
+        {
+            PushPoint(points, POINT_ROOT, x, 0);
+        }
+        break;
+    default:
+        PushPoint(points, POINT_INFLECTION, x, value);
+        break;
+    }
+}
+
+//-----------------------------------------------------------
+//! Zero of the derivative g of this order on [a, b], where
+//! g(a) and g(b) have different signs. Halley steps that leave
+//! the bracket are replaced by bisection.
+//-----------------------------------------------------------
+static double RefineZero(const SpecialSearch *search, int order, double a, double b, double ga, double gb)
+{
+    const Node *g   = search->trees[order];
+    const Node *dg  = search->trees[order + 1];
+    const Node *d2g = search->trees[order + 2];
+    const char *var = search->var;
+
+    double x = a - ga * (b - a) / (gb - ga);
+    if (!(x > a && x < b)) {x = a + (b - a) / 2;}
+
+    for (int i = 0; i < REFINE_ITERATIONS; i++)
+    {
+        double gx = Evaluate(g, var, x);
+        if (gx == 0 || !std::isfinite(gx)) {return x;}
+
+        if ((gx < 0) == (ga < 0))
+        {
+            a  = x;
+            ga = gx;
+        }
+        else
+        {
+            b = x;
+        }
+
+        double d1   = Evaluate(dg,  var, x);
+        double d2   = Evaluate(d2g, var, x);
+        double next = x - 2 * gx * d1 / (2 * d1 * d1 - gx * d2);
+
+        if (!(next > a && next < b)) {next = a + (b - a) / 2;}
+
+        if (fabs(next - x) <= REFINE_TOLERANCE * fmax(1, fabs(x))) {return next;}
+
+        x = next;
+    }
+
+    return x;
+}
+
+static bool PushPoint(SpecialPoints *points, SpecialPointKind kind, double x, double value)
+{
+    if (points->size == points->capacity)
+    {
+        size_t        capacity = 2 * points->capacity + 4;
+        SpecialPoint *bigger   = (SpecialPoint *)realloc(points->points, capacity * sizeof(SpecialPoint));
+        if (bigger == nullptr)
+        {
+            printf("Error allocating memory for special points.\n");
+            return false;
+        }
+
+        points->points   = bigger;
+        points->capacity = capacity;
+    }
+
+    points->points[points->size].kind  = kind;
+    points->points[points->size].x     = x;
+    points->points[points->size].value = value;
+    points->size++;
+
+    return true;
+}
+
+//-----------------------------------------------------------
+//! A root of f touching zero may be found on the grid and as
+//! an extremum. Points are sorted, so duplicates are close.
+//-----------------------------------------------------------
+static void DeleteDuplicates(SpecialPoints *points, double distance)
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < points->size; i++)
+    {
+        bool isDuplicate = false;
+        for (size_t j = size; j > 0 && points->points[i].x - points->points[j - 1].x <= distance; j--)
+        {
+            if (points->points[j - 1].kind == points->points[i].kind) {isDuplicate = true;}
+        }
+
+        if (!isDuplicate) {points->points[size++] = points->points[i];}
+    }
+
+    points->size = size;
+}
+
+static int ComparePoints(const void *first, const void *second)
+{
+    const SpecialPoint *left  = (const SpecialPoint *)first;
+    const SpecialPoint *right = (const SpecialPoint *)second;
+
+    if (left->x != right->x) {return (left->x < right->x) ? -1 : 1;}
+
+    return (int)left->kind - (int)right->kind;
+}
+
+//----------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+#ifndef SPECIAL_POINTS_HPP
+#define SPECIAL_POINTS_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+#include "DiffCache.hpp"
+#include "ParallelDiff.hpp"
+#include "Tree.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+//Points of the coarse scan and points of the scan done by one task
+static const size_t SPECIAL_SCAN_POINTS = 4096;
+static const size_t SPECIAL_CHUNK_LEN   = 256;
+
+//Orders of the derivatives used: f'' is refined with f''' and f''''
+static const int    SPECIAL_DIFF_ORDERS = 4;
+
+//----------------------------------------------------------------------------------------------------------------
+
+enum SpecialPointKind
+{
+    POINT_ROOT,
+    POINT_MINIMUM,
+    POINT_MAXIMUM,
+    POINT_INFLECTION,
+    NUMBER_OF_POINT_KINDS
+};
+
+struct SpecialPoint
+{
+    SpecialPointKind kind  = POINT_ROOT;
+    double           x     = 0;
+    double           value = 0;
+};
+
+//-----------------------------------------------------------
+//! Points sorted by x
+//-----------------------------------------------------------
+struct SpecialPoints
+{
+    SpecialPoint *points   = nullptr;
+    size_t        size     = 0;
+    size_t        capacity = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+void SpecialPointsDtor (SpecialPoints *points);
+
+//-----------------------------------------------------------
+//! Roots, local extrema and inflection points of f on
+//! [from, to]. Sign changes of f, f' and f'' on a grid of
+//! SPECIAL_SCAN_POINTS are refined by Halley steps kept inside
+//! the bracket. Chunks of the grid are done in parallel with a
+//! pool. Roots where f touches zero are found as extrema with
+//! f = 0, sign changes at poles are dropped.
+//-----------------------------------------------------------
+bool FindSpecialPoints (Node *node, const char *var, double from, double to, SpecialPoints *points,
+                        DiffCache *cache = nullptr, DiffPool *pool = nullptr);
+
+//-----------------------------------------------------------
+//! Paragraph of the LaTeX report with the points of each kind
+//-----------------------------------------------------------
+void SpecialPointsLatex (FILE *texfile, const SpecialPoints *points, double from, double to);
+
+const char *SpecialPointName (SpecialPointKind kind);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //SPECIAL_POINTS_HPP
@@ -0,0 +1,116 @@
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#include "StringBuffer.hpp"
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const size_t MAX_NUMBER_LEN = 64;
+
+//----------------------------------------------------------------------------------------------------------------
+
+static bool StringBufferReserve (StringBuffer *buffer, size_t size);
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool StringBufferCtor(StringBuffer *buffer, size_t capacity)
+{
+    assert(buffer);
+
+    *buffer = {};
+
+    return StringBufferReserve(buffer, (capacity > 0) ? capacity : 1);
+}
+
+void StringBufferDtor(StringBuffer *buffer)
+{
+    if (buffer == nullptr) {return;}
+
+    free(buffer->data);
+
+    *buffer = {};
+}
+
+void StringBufferClear(StringBuffer *buffer)
+{
+    assert(buffer);
+
+    buffer->size = 0;
+    if (buffer->data != nullptr) {buffer->data[0] = '\0';}
+}
+
+void StringBufferAppend(StringBuffer *buffer, const char *text)
+{
+    assert(text);
+
+    StringBufferAppend(buffer, text, strlen(text));
+}
+
+void StringBufferAppend(StringBuffer *buffer, const char *text, size_t length)
+{
+    assert(buffer && text);
+
+    if (!StringBufferReserve(buffer, buffer->size + length)) {return;}
+
+    memcpy(buffer->data + buffer->size, text, length);
+    buffer->size += length;
+    buffer->data[buffer->size] = '\0';
+}
+
+void StringBufferAppendChar(StringBuffer *buffer, char symbol)
+{
+    assert(buffer);
+
+    if (!StringBufferReserve(buffer, buffer->size + 1)) {return;}
+
+    buffer->data[buffer->size++] = symbol;
+    buffer->data[buffer->size]   = '\0';
+}
+
+void StringBufferAppendNumber(StringBuffer *buffer, double value, int precision)
+{
+    assert(buffer);
+
+    char number[MAX_NUMBER_LEN] = "";
+
+    std::to_chars_result result = std::to_chars(number, number + MAX_NUMBER_LEN, value, std::chars_format::general, precision);
+
+    StringBufferAppend(buffer, number, result.ptr - number);
+}
+
+bool StringBufferWrite(const StringBuffer *buffer, FILE *stream)
+{
+    assert(buffer && stream);
+
+    return fwrite(buffer->data, sizeof(char), buffer->size, stream) == buffer->size;
+}
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Room for 'size' characters and the terminating '\0'
+//-----------------------------------------------------------
+static bool StringBufferReserve(StringBuffer *buffer, size_t size)
+{
+    if (size < buffer->capacity) {return true;}
+
+    size_t capacity = 2*buffer->capacity;
+    if (capacity <= size) {capacity = size + 1;}
+
+    char *data = (char *)realloc(buffer->data, capacity);
+    if (data == nullptr)
+    {
+        printf("Error allocating memory for string buffer.\n");
+        return false;
+    }
+
+    buffer->data     = data;
+    buffer->capacity = capacity;
+    buffer->data[buffer->size] = '\0';
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------
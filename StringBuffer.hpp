@@ -0,0 +1,50 @@
+#ifndef STRING_BUFFER_HPP
+#define STRING_BUFFER_HPP
+
+//----------------------------------------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdio>
+
+//----------------------------------------------------------------------------------------------------------------
+
+static const size_t STRING_BUFFER_STD_CAPACITY = 256;
+
+//----------------------------------------------------------------------------------------------------------------
+
+//-----------------------------------------------------------
+//! Growable text buffer, data is always terminated by '\0'.
+//! If memory runs out the buffer keeps what it has and drops
+//! further appends.
+//-----------------------------------------------------------
+struct StringBuffer
+{
+    char   *data     = nullptr;
+    size_t  size     = 0;
+    size_t  capacity = 0;
+};
+
+//----------------------------------------------------------------------------------------------------------------
+
+bool StringBufferCtor         (StringBuffer *buffer, size_t capacity = STRING_BUFFER_STD_CAPACITY);
+void StringBufferDtor         (StringBuffer *buffer);
+void StringBufferClear        (StringBuffer *buffer);
+
+void StringBufferAppend       (StringBuffer *buffer, const char *text);
+void StringBufferAppend       (StringBuffer *buffer, const char *text, size_t length);
+void StringBufferAppendChar   (StringBuffer *buffer, char symbol);
+
+//-----------------------------------------------------------
+//! Same text as printf("%.<precision>g"), without parsing a
+//! format string
+//-----------------------------------------------------------
+void StringBufferAppendNumber (StringBuffer *buffer, double value, int precision);
+
+//-----------------------------------------------------------
+//! The whole buffer with one fwrite
+//-----------------------------------------------------------
+bool StringBufferWrite        (const StringBuffer *buffer, FILE *stream);
+
+//----------------------------------------------------------------------------------------------------------------
+
+#endif //STRING_BUFFER_HPP
@@ -1,3 +1,4 @@
+#include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -9,14 +10,24 @@
 
 static bool GetOperationToken(const char **str, token *Token); 
 
-static void GetVariableToken(const char **str, token *Token);
+static bool GetVariableToken(const char **str, token *Token);
+
+static Node *SyntaxError(stack_id stk, int *reader, const char *err_sym, const char *expected);
 
 static void PrintSyntaxError(const char *str, const char *err_sym, const char *expected);
 
+//-----------------------------------------------------------
+//! Value of the reader after a syntax error. Every Get*
+//! function returns nullptr then and frees what it has built.
+//-----------------------------------------------------------
+static const int SYNTAX_ERROR = -1;
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void GetTokens(const char *str, stack_id stk)
+bool GetTokens(const char *str, stack_id stk)
 {
+    const char *start = str;
+
     token Token = {};
     char *endptr = nullptr;
 
@@ -36,29 +47,41 @@ void GetTokens(const char *str, stack_id stk)
 
             str = endptr;
         }
-        else if (!GetOperationToken(&str, &Token))
+        else if (!GetOperationToken(&str, &Token) && !GetVariableToken(&str, &Token))
         {
-            GetVariableToken(&str, &Token);
+            PrintSyntaxError(start, str, "number, operation or variable");
+            break;
         }
 
         StackPush(stk, Token);
     }
+    bool isCorrect = (*str == '\0');
+
     Token.type = END_EXPRESSION;
     Token.init_symbol = str;
     Token.data = {};
     StackPush(stk, Token);
+
+    return isCorrect;
 }
 
+//-----------------------------------------------------------
+//! Returns nullptr if the expression has a syntax error, the
+//! error is printed.
+//-----------------------------------------------------------
 Node *GetStarted(stack_id stk)
 {   
     int reader = 0;
 
     Node *node = GetSumSubExpression(stk, &reader);
+    if (node == nullptr) {return nullptr;}
+
     token Token = GetItem(stk, reader);
 
     if (Token.type != END_EXPRESSION)
     {
-        PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "'\\0'");
+        treeDtor(node);
+        return SyntaxError(stk, &reader, Token.init_symbol, "'\\0'");
     }
     return node;
 }
@@ -66,6 +89,7 @@ Node *GetStarted(stack_id stk)
 Node *GetSumSubExpression(stack_id stk, int *reader)
 {
     Node *node = GetMulDivExpression(stk, reader);
+    if (node == nullptr) {return nullptr;}
 
     token Token = GetItem(stk, *reader);
 
@@ -75,6 +99,11 @@ Node *GetSumSubExpression(stack_id stk, int *reader)
         (*reader)++;
 
         Node *second_node = GetMulDivExpression(stk, reader);
+        if (second_node == nullptr)
+        {
+            treeDtor(node);
+            return nullptr;
+        }
 
         if (op == ADD)
         {
@@ -94,6 +123,7 @@ Node *GetSumSubExpression(stack_id stk, int *reader)
 Node *GetMulDivExpression(stack_id stk, int *reader)
 {
     Node *node = GetUnary(stk, reader);
+    if (node == nullptr) {return nullptr;}
 
     token Token = GetItem(stk, *reader);
 
@@ -103,6 +133,11 @@ Node *GetMulDivExpression(stack_id stk, int *reader)
         (*reader)++;
         
         Node *second_node = GetUnary(stk, reader);
+        if (second_node == nullptr)
+        {
+            treeDtor(node);
+            return nullptr;
+        }
 
         if (op == MUL)
         {
@@ -133,6 +168,7 @@ Node *GetUnary(stack_id stk, int *reader)
     }
 
     Node *node = GetFunction(stk, reader);
+    if (node == nullptr) {return nullptr;}
 
     if (sign == -1) 
     {
@@ -160,16 +196,21 @@ Node *GetFunction(stack_id stk, int *reader) //TODO: Token status array
 
         if (!(Token.type == OP && Token.data.op == OPEN_BRACKET))
         {
-            PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "'(' before function argument");
+            return SyntaxError(stk, reader, Token.init_symbol, "'(' before function argument");
         }
-        node = CreateNode(OP, {.op = op}, nullptr, GetSumSubExpression(stk, reader));
+
+        Node *argument = GetSumSubExpression(stk, reader);
+        if (argument == nullptr) {return nullptr;}
+
+        node = CreateNode(OP, {.op = op}, nullptr, argument);
         
         Token = GetItem(stk, *reader);
         (*reader)++;
 
         if (!(Token.type == OP && Token.data.op == CLOSE_BRACKET))
         {
-            PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "')' after function argument");
+            treeDtor(node);
+            return SyntaxError(stk, reader, Token.init_symbol, "')' after function argument");
         }
     }
     else
@@ -183,6 +224,7 @@ Node *GetFunction(stack_id stk, int *reader) //TODO: Token status array
 Node *GetPow(stack_id stk, int *reader)
 {
     Node *node = GetBrackets(stk, reader);
+    if (node == nullptr) {return nullptr;}
 
     token Token = GetItem(stk, *reader);
     
@@ -191,6 +233,11 @@ Node *GetPow(stack_id stk, int *reader)
         (*reader)++;
 
         Node *second_node = GetUnary(stk, reader);
+        if (second_node == nullptr)
+        {
+            treeDtor(node);
+            return nullptr;
+        }
 
         node = Pow(node, second_node);
     }
@@ -210,13 +257,15 @@ Node *GetBrackets(stack_id stk, int *reader)
         (*reader)++;
 
         node = GetSumSubExpression(stk, reader);
+        if (node == nullptr) {return nullptr;}
 
         Token = GetItem(stk, *reader);
         (*reader)++;
         
         if (!(Token.type == OP && Token.data.op == CLOSE_BRACKET))
         {
-            PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "')'");
+            treeDtor(node);
+            return SyntaxError(stk, reader, Token.init_symbol, "')'");
         }
     }
     else if (Token.type == VAR)
@@ -238,7 +287,7 @@ Node *GetVariable(stack_id stk, int *reader)
 
     if (Token.type != VAR)
     {
-        PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "variable");
+        return SyntaxError(stk, reader, Token.init_symbol, "variable");
     }
 
     return CreateVar(Token.data.var);
@@ -251,7 +300,7 @@ Node *GetNumber(stack_id stk, int *reader)
 
     if (Token.type != NUM)
     {
-        PrintSyntaxError(GetItem(stk, 0).init_symbol, Token.init_symbol, "number");
+        return SyntaxError(stk, reader, Token.init_symbol, "number");
     }
 
     return CreateNum(Token.data.value);
@@ -333,7 +382,7 @@ static bool GetOperationToken(const char **str, token *Token)
 
 #undef CHECK_OP
 
-static void GetVariableToken(const char **str, token *Token)
+static bool GetVariableToken(const char **str, token *Token)
 {
     Token->init_symbol = *str;
     Token->type = VAR;
@@ -345,23 +394,33 @@ static void GetVariableToken(const char **str, token *Token)
         i++;
         (*str)++;
     }
+    bool isVariable = (i > 0);
+
     while (i < 8)
     {
         Token->data.var[i] = '\0';
         i++;
     }
+
+    return isVariable;
+}
+
+static Node *SyntaxError(stack_id stk, int *reader, const char *err_sym, const char *expected)
+{
+    PrintSyntaxError(GetItem(stk, 0).init_symbol, err_sym, expected);
+    *reader = SYNTAX_ERROR;
+
+    return nullptr;
 }
 
 static void PrintSyntaxError(const char *str, const char *err_sym, const char *expected)
 {
     assert(str && err_sym && expected);
 
-    printf("Syntax error in symbol %c. Expected %s.\n\n", *err_sym, expected);
+    fprintf(stderr, "Syntax error in symbol %c. Expected %s.\n\n", *err_sym, expected);
 
     int pos = err_sym - str;
-    printf("%s\n" "%*c^\n%*c|\n\n", str, pos, ' ', pos, ' ');
-    fflush(stdout);
-    abort();
+    fprintf(stderr, "%s\n" "%*c^\n%*c|\n\n", str, pos, ' ', pos, ' ');
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
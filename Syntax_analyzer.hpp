@@ -8,7 +8,7 @@
 
 //----------------------------------------------------------------------------------------------------------------
 
-void GetTokens(const char *str, stack_id stk);
+bool GetTokens(const char *str, stack_id stk);
 
 Node *GetStarted(stack_id stk);
 
@@ -1,13 +1,22 @@
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <csignal>
 #include <cstdlib>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <malloc.h>
+#include <poll.h>
 #include <random>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "CompactTree.hpp"
 #include "logs.hpp"
+#include "Metrics.hpp"
 #include "MyGeneralFunctions.hpp"
+#include "StringBuffer.hpp"
 #include "Tree.hpp"
 
 #define DEBUG
@@ -16,11 +25,36 @@
 //FOR GRAPH DUMP
 //--------------------------------------------------------------
 
-static int Dump_counter = 1;
+//Nodes in all threads, without the changes not yet published by NodeAllocator
+static std::atomic<long long> LiveNodes(0);
+
+//Freed nodes a thread keeps for reuse, the rest go back to free()
+static const size_t    NODE_ALLOCATOR_MAX_FREE = 4096;
+//Live node changes of a thread published at once
+static const long long LIVE_NODES_BATCH        = 1024;
+
+//-----------------------------------------------------------
+//! Node allocator of one thread: freed nodes are reused and
+//! the live node count is shared in batches, so threads that
+//! build trees at the same time (see ParallelDiff) do not
+//! contend on the heap lock and on one counter.
+//-----------------------------------------------------------
+struct NodeAllocator
+{
+    Node     *free_list    = nullptr;
+    size_t    free_count   = 0;
+    long long live_delta   = 0;
+    long long thread_nodes = 0;
+
+    ~NodeAllocator();
+};
+
+static thread_local NodeAllocator Allocator;
 
-static const int  MAX_PATH_LEN   = 30;
-static const char *DUMP_PATH     = "./DumpFiles/Dump%d.dot";
-static const char *SVG_DUMP_PATH = "./DumpFiles/Dump%d.svg";
+static const int  MAX_PATH_LEN   = MAX_OUTPUT_PATH_LEN + 30;
+static const int  MAX_CMD_LEN    = 3*MAX_PATH_LEN;
+static const char *DUMP_PATH     = "%s/Dump%d.dot";
+static const char *SVG_DUMP_PATH = "%s/Dump%d.svg";
 
 static const char *ADD_DUMP_TO_HTML_CODE =  "<details open>\n"
                                                 "\t<summary>Dump%d</summary>\n"
@@ -49,6 +83,7 @@ static const char *START_LATEX  =   "\\documentclass{article}\n"
                                     "\\usepackage[utf8]{inputenc}\n"
                                     "\\usepackage[russian, english]{babel}\n"
                                     "\\usepackage[pdftex]{graphicx}\n"
+                                    "\\usepackage{amsmath}\n"
                                     "\\usepackage[left=0.1 cm, right=0.1cm]{geometry}\n\n"
                                     "\\geometry{papersize={100 cm,50 cm}}\n\n"
                                     "\\begin{document}\n"
@@ -57,25 +92,59 @@ static const char *START_LATEX  =   "\\documentclass{article}\n"
 static const char *END_LATEX    =   "\\end{center}\n"
                                     "\\end{document}";
 
+//Digits of numbers, the same as "%lg" and "%.15g"
+static const int LATEX_NUMBER_PRECISION = 6;
+static const int INFIX_NUMBER_PRECISION = 15;
+
+//Repeated subtrees of at least this size are printed once as "where A = ..."
+static const size_t LATEX_ABBREV_MIN_NODES = 12;
+static const int    MAX_ABBREV_NAME_LEN    = 16;
+static const int    ABBREV_LETTERS         = 26;
+//Characters of LaTeX source after which a sum goes on a new line
+static const size_t LATEX_MAX_LINE_LEN     = 800;
+
 static const char *FUNC_PLOT_FILENAME_PNG = "Plot%d.png";
 static const int MAX_PLOT_FILENAME_LEN = 60;
-static const char *PLOTDATAFILENAME = "./TexFiles/plot%d.data";
-static int PlotDataCounter = 1;
-static const char *PLOTFILENAME = "./TexFiles/plot.gnu";
-static int PlotCounter = 1;
+static const char *TEX_FILENAME = "%s/Differentiator.tex";
+
+//Gnuplot prints the mark when the plot before it is written
+static const char *PLOT_DONE_MARK = "plot %d is done";
+//Gnuplot silent for longer is taken as hung and killed
+static const int GNUPLOT_REPLY_TIMEOUT_MS = 10000;
+
+//Used by the output functions called without a sink
+static OutputSink DefaultSink = {};
+
+//-----------------------------------------------------------
+//! Distinct subtrees of one formula in an open addressing
+//! table by hash. uses counts the distinct parents (and the
+//! edges from them), so a subtree repeated only because its
+//! parent is repeated has one use.
+//-----------------------------------------------------------
+struct LatexSubtree
+{
+    const Node *node = nullptr;
+    size_t      size = 0;
+    int         uses = 0;
+    int         name = -1;
+};
 
-#include "phrases.hpp"
+struct LatexAbbrevs
+{
+    LatexSubtree *table    = nullptr;
+    size_t        capacity = 0;
 
-//----------------------------------------------------------------------
+    const Node  **named    = nullptr;
+    int           count    = 0;
 
-struct operation
-{
-    const char *label       = nullptr;
-    const char *latex_label = nullptr;
-    const int   priority    = 0;
+    const Node   *defining = nullptr;
 };
 
-static const operation OPS[NUMBER_OF_OPERATIONS] = //TODO: add info about tokens
+#include "phrases.hpp"
+
+//----------------------------------------------------------------------
+
+const operation OPS[NUMBER_OF_OPERATIONS] = //TODO: add info about tokens
 {
     {"+"     , "+"        , 1},
     {"-"     , "-"        , 1},
@@ -100,23 +169,48 @@ static const operation OPS[NUMBER_OF_OPERATIONS] = //TODO: add info about tokens
 
 static Node *addNode              (Node *node, Type type, Data data, bool toLeft);
 static int  creatGraphvizTreeCode (const Node *node, int nodeNum, FILE *dump_file);
-static void get_dump_filenames    (char *dump_filename, char *svg_dump_filename);
-static void printNodeData         (FILE *stream, Type type, Data data);
+static void get_dump_filenames    (const OutputSink *sink, char *dump_filename, char *svg_dump_filename);
+static void printNodeData         (StringBuffer *buffer, Type type, Data data);
 static bool IsLeaf                (const Node *node);
-
-static double calculateValueForPlot (Node *node, const char *var, double value);
+static bool isCommutative         (const Node *node);
+static bool needInfixBrackets     (const Node *node, const Node *child, bool isRight);
+static unsigned long long MixHash (unsigned long long value);
+static void  SampleCompactTree    (void *context, const double *x, double *y, size_t count, MathAccuracy accuracy);
+static OutputSink *GetSink        (OutputSink *sink);
+static bool  StartGnuplot         (OutputSink *sink);
+static void  StopGnuplot          (OutputSink *sink, bool isRunning);
+static bool  WaitGnuplot          (OutputSink *sink, const char *mark, const char *script, size_t script_len);
+static void  GnuplotWriteBegin    (sigset_t *old_set);
+static bool  GnuplotWriteEnd      (OutputSink *sink, const sigset_t *old_set);
+static Node *NodeAlloc            ();
+static void  NodeFree             (Node *node);
+static void  PublishLiveNodes     (long long delta);
+
+static size_t        treeSize           (const Node *node);
+static bool          LatexAbbrevsCtor   (LatexAbbrevs *abbrevs, const Node *root);
+static void          LatexAbbrevsDtor   (LatexAbbrevs *abbrevs);
+static LatexSubtree *findSubtree        (LatexAbbrevs *abbrevs, const Node *node, bool onlyNamed);
+static LatexSubtree *collectSubtrees    (LatexAbbrevs *abbrevs, const Node *node);
+static void          nameSubtrees       (LatexAbbrevs *abbrevs, const Node *node, bool isDefinition);
+static void          getAbbrevName      (char *name, int index);
+static void          latexPrint         (StringBuffer *buffer, const Node *node, bool needBrackets, LatexAbbrevs *abbrevs);
+static bool          latexPrintLines    (StringBuffer *buffer, const Node *node, LatexAbbrevs *abbrevs, size_t *line_start);
+static void          latexFormula       (StringBuffer *buffer, const Node *node, LatexAbbrevs *abbrevs,
+                                         const char *prefix, const char *postfix);
 
 //--------------------------------------------------------------
 
 Node *treeCtor(Type type, Data data)
 {
-    Node *node = (Node *)calloc(1, sizeof(Node));
+    Node *node = NodeAlloc();
+    METRICS_NODE_CTOR();
     
     node->type   = type;
     node->data   = data;
     node->left   = nullptr;
     node->right  = nullptr;
     node->parent = nullptr;
+    node->hash   = nodeHash(node);
 
     return node;
 }
@@ -163,57 +257,120 @@ void nodeDtor(Node *node)
         node->left   = nullptr;
         node->right  = nullptr;
         node->parent = nullptr;
+        node->hash   = 0;
     #endif //DEBUG
 
     if (node != nullptr) 
     {
-        free(node);
+        METRICS_NODE_DTOR();
+        NodeFree(node);
     }
 }
 
-void treePrint(FILE *stream, const Node *node, bool needBrackets)
-{    
-    if (node != nullptr)
+size_t treeLiveNodes()
+{
+    return (size_t)(LiveNodes + Allocator.live_delta);
+}
+
+long long treeThreadNodes()
+{
+    return Allocator.thread_nodes;
+}
+
+void treeMoveThreadNodes(long long count)
+{
+    Allocator.thread_nodes += count;
+}
+
+unsigned long long nodeHash(const Node *node)
+{
+    assert(node);
+
+    unsigned long long payload = 0;
+
+    if (node->type == NUM)
     {
-        fprintf(stream, "%c", OPEN_NODE_SYM);
+        double value = (node->data.value == 0) ? 0 : node->data.value;
+        memcpy(&payload, &value, sizeof(payload));
+    }
+    else if (node->type == VAR)
+    {
+        memcpy(&payload, node->data.var, sizeof(payload));
+    }
+    else
+    {
+        payload = (unsigned long long)node->data.op;
+    }
 
-        if (needBrackets)
-        {
-            fprintf(stream, "%s", OPS[OPEN_BRACKET].latex_label);
-        }        
+    unsigned long long hash  = MixHash(MixHash((unsigned long long)node->type + 1) ^ payload);
+    unsigned long long left  = (node->left  != nullptr) ? node->left->hash  : 0;
+    unsigned long long right = (node->right != nullptr) ? node->right->hash : 0;
 
-        if (node->type == OP && node->data.op == DIV)
-        {
-            fprintf  (stream, "%s", OPS[DIV].latex_label);
-            treePrint(stream, node->left );
-            treePrint(stream, node->right);
-        }
-        else
-        { 
-            Node *left  = node->left;
-            Node *right = node->right;
+    if (isCommutative(node) && left > right)
+    {
+        unsigned long long tmp = left;
+        left  = right;
+        right = tmp;
+    }
 
-            bool  needLeftBrackets =  ((left != nullptr) &&  (left->type == OP) && (OPS[ left->data.op].priority < OPS[node->data.op].priority));
-            bool needRightBrackets = ((right != nullptr) && (right->type == OP) && (OPS[right->data.op].priority < OPS[node->data.op].priority));
+    return MixHash(hash ^ MixHash(left + 0x9E3779B97F4A7C15ULL) ^ (MixHash(right) << 1));
+}
 
-            needLeftBrackets  = needLeftBrackets  || (node->type == OP && node->data.op == MUL && left->type  == NUM && left->data.value  < 0);
-            needRightBrackets = needRightBrackets || (node->type == OP && node->data.op == MUL && right->type == NUM && right->data.value < 0);
+void nodeRehash(Node *node)
+{
+    if (node == nullptr) {return;}
 
-            treePrint(stream, node->left, needLeftBrackets);
+    node->hash = nodeHash(node);
+}
 
-            printNodeData(stream, node->type, node->data);
+void treeRehash(Node *node)
+{
+    if (node == nullptr) {return;}
 
-            treePrint(stream, node->right, needRightBrackets);
+    treeRehash(node->left );
+    treeRehash(node->right);
 
-        }
+    nodeRehash(node);
+}
 
-        if (needBrackets)
-        {
-            fprintf(stream, "%s", OPS[CLOSE_BRACKET].latex_label);
-        }  
+//-----------------------------------------------------------
+//! Different hashes mean different trees, so unequal trees
+//! are rejected in O(1). Equal hashes are confirmed by a full
+//! comparison that accepts swapped operands of ADD and MUL.
+//-----------------------------------------------------------
+bool isEqualTrees(const Node *first, const Node *second)
+{
+    if (first == second)                        {return true; }
+    if (first == nullptr || second == nullptr)  {return false;}
+    if (first->hash != second->hash)            {return false;}
+    if (first->type != second->type)            {return false;}
+
+    if (first->type == NUM) {return first->data.value == second->data.value;}
+    if (first->type == VAR) {return strncmp(first->data.var, second->data.var, MAX_VAR_NAME_LEN) == 0;}
+    if (first->data.op != second->data.op) {return false;}
 
-        fprintf(stream, "%c", CLOSE_NODE_SYM);
+    if (isEqualTrees(first->left, second->left) && isEqualTrees(first->right, second->right))
+    {
+        return true;
     }
+
+    return isCommutative(first) && isEqualTrees(first->left, second->right) && isEqualTrees(first->right, second->left);
+}
+
+void treePrint(StringBuffer *buffer, const Node *node, bool needBrackets)
+{
+    latexPrint(buffer, node, needBrackets, nullptr);
+}
+
+void treePrint(FILE *stream, const Node *node, bool needBrackets)
+{
+    StringBuffer buffer = {};
+    StringBufferCtor(&buffer);
+
+    treePrint(&buffer, node, needBrackets);
+    StringBufferWrite(&buffer, stream);
+
+    StringBufferDtor(&buffer);
 }
 
 void treePrint(const char *filename, const Node *node, bool needBrackets)
@@ -226,34 +383,130 @@ void treePrint(const char *filename, const Node *node, bool needBrackets)
     }
 
     treePrint(stream, node, needBrackets);
+    fclose(stream);
 }
 
+//-----------------------------------------------------------
+//! The formula is built in memory and written with one call.
+//! Repeated subtrees are named A, B, ... and defined after it,
+//! long sums are split into lines of an aligned block.
+//-----------------------------------------------------------
 void treeLatex(const Node *node, FILE *out, const char *prefix, bool withPhrases, const char *postfix)
 {
     assert(out);
 
+    StringBuffer buffer = {};
+    StringBufferCtor(&buffer);
+
     int phrase = rand() % number_of_phrases;
     if (withPhrases)
     {
-        fprintf(out, "\n%s", phrases[phrase]);
+        StringBufferAppendChar(&buffer, '\n');
+        StringBufferAppend(&buffer, phrases[phrase]);
+    }
+
+    LatexAbbrevs  abbrevs     = {};
+    LatexAbbrevs *abbrevs_ptr = (node != nullptr && LatexAbbrevsCtor(&abbrevs, node)) ? &abbrevs : nullptr;
+
+    latexFormula(&buffer, node, abbrevs_ptr, prefix, postfix);
+
+    if (abbrevs.count > 0)
+    {
+        StringBufferAppend(&buffer, "where\n");
+
+        char name  [MAX_ABBREV_NAME_LEN]     = "";
+        char prefix[MAX_ABBREV_NAME_LEN + 4] = "";
+        for (int i = 0; i < abbrevs.count; i++)
+        {
+            getAbbrevName(name, i);
+            snprintf(prefix, sizeof(prefix), "%s = ", name);
+
+            abbrevs.defining = abbrevs.named[i];
+            latexFormula(&buffer, abbrevs.named[i], &abbrevs, prefix, "");
+        }
+    }
+
+    LatexAbbrevsDtor(&abbrevs);
+
+    StringBufferWrite(&buffer, out);
+    StringBufferDtor(&buffer);
+}
+
+//-----------------------------------------------------------
+//! Plain text in the syntax of the input file, so the result
+//! can be parsed back. Negative numbers are put in brackets.
+//-----------------------------------------------------------
+void treePrintInfix(StringBuffer *buffer, const Node *node)
+{
+    assert(buffer);
+
+    if (node == nullptr) {return;}
+
+    if (node->type == NUM)
+    {
+        bool isNegative = node->data.value < 0;
+
+        if (isNegative) {StringBufferAppendChar(buffer, '(');}
+        StringBufferAppendNumber(buffer, node->data.value, INFIX_NUMBER_PRECISION);
+        if (isNegative) {StringBufferAppendChar(buffer, ')');}
+        return;
+    }
+    if (node->type == VAR)
+    {
+        StringBufferAppend(buffer, node->data.var, strnlen(node->data.var, MAX_VAR_NAME_LEN));
+        return;
+    }
+
+    if (node->left == nullptr)
+    {
+        StringBufferAppend(buffer, OPS[node->data.op].label);
+        StringBufferAppendChar(buffer, '(');
+        treePrintInfix(buffer, node->right);
+        StringBufferAppendChar(buffer, ')');
+        return;
     }
-    fprintf(out, "\n$$%s", prefix);
 
-    treePrint(out, node);
-    fprintf(out, "%s$$\n\n", postfix);
+    bool needLeftBrackets  = needInfixBrackets(node, node->left,  false);
+    bool needRightBrackets = needInfixBrackets(node, node->right, true );
+
+    if (needLeftBrackets) {StringBufferAppendChar(buffer, '(');}
+    treePrintInfix(buffer, node->left);
+    if (needLeftBrackets) {StringBufferAppendChar(buffer, ')');}
+
+    StringBufferAppend(buffer, (node->data.op == POW) ? "^" : OPS[node->data.op].label);
+
+    if (needRightBrackets) {StringBufferAppendChar(buffer, '(');}
+    treePrintInfix(buffer, node->right);
+    if (needRightBrackets) {StringBufferAppendChar(buffer, ')');}
 }
 
-void treeGraphDump(const Node *node)
+void treePrintInfix(FILE *stream, const Node *node)
 {
+    assert(stream);
+
+    StringBuffer buffer = {};
+    StringBufferCtor(&buffer);
+
+    treePrintInfix(&buffer, node);
+    StringBufferWrite(&buffer, stream);
+
+    StringBufferDtor(&buffer);
+}
+
+void treeGraphDump(const Node *node, OutputSink *sink)
+{
+    sink = GetSink(sink);
+    if (!sink->graph_dumps) {return;}
+
     char     dump_filename[MAX_PATH_LEN] = "";
     char svg_dump_filename[MAX_PATH_LEN] = "";
 
-    get_dump_filenames(dump_filename, svg_dump_filename);
+    get_dump_filenames(sink, dump_filename, svg_dump_filename);
 
     FILE *dump_file = fopen(dump_filename, "w");
     if (dump_file == nullptr)
     {
-        log("Error opening dump file: %s\n", dump_filename);
+        LOG_ERROR("Error opening dump file: %s</p>\n", dump_filename);
         return;
     }
 
@@ -264,17 +517,16 @@ void treeGraphDump(const Node *node)
     fprintf(dump_file, "}");
     if (fclose(dump_file) != 0)
     {
-        log("<p>Error closing dump_file</p>\n");
+        LOG_ERROR("Error closing dump_file</p>\n");
     }
 
-    const int MAX_CMD_LEN = 100;
     char CMD[MAX_CMD_LEN] = "";
-    sprintf(CMD, "dot %s -T svg -o %s", dump_filename, svg_dump_filename);
+    snprintf(CMD, MAX_CMD_LEN, "dot \"%s\" -T svg -o \"%s\"", dump_filename, svg_dump_filename);
     
     system(CMD);
 
-    log(ADD_DUMP_TO_HTML_CODE, Dump_counter, svg_dump_filename);
-    Dump_counter++;
+    LOG_INFO(ADD_DUMP_TO_HTML_CODE, sink->dump_counter, svg_dump_filename);
+    sink->dump_counter++;
 }
 
 FILE *initLatex(const char *filename)
@@ -297,15 +549,33 @@ FILE *initLatex(FILE *stream)
     return stream;
 }
 
-void closeLatex(FILE *stream)
+FILE *initLatex(OutputSink *sink)
 {
+    sink = GetSink(sink);
+
+    char filename[MAX_PATH_LEN] = "";
+    snprintf(filename, MAX_PATH_LEN, TEX_FILENAME, sink->tex_dir);
+
+    return initLatex(filename);
+}
+
+void closeLatex(FILE *stream, OutputSink *sink)
+{
+    METRICS_SCOPE("pdflatex");
+
+    sink = GetSink(sink);
+
     fprintf(stream, "%s", END_LATEX);
     fclose(stream);
 
-    const int MAX_CMD_LEN = 100;
-    char cmd[MAX_CMD_LEN] = "";
+    if (!sink->pdf) {return;}
 
-    sprintf(cmd, "pdflatex -output-directory=./TexFiles \"%s\" > TEXLOG.txt", OUT_TEX_FILE);
+    char filename[MAX_PATH_LEN] = "";
+    char cmd     [MAX_CMD_LEN]  = "";
+
+    snprintf(filename, MAX_PATH_LEN, TEX_FILENAME, sink->tex_dir);
+    snprintf(cmd, MAX_CMD_LEN, "pdflatex -output-directory=\"%s\" \"%s\" > \"%s/TEXLOG.txt\"",
+             sink->tex_dir, filename, sink->tex_dir);
     system(cmd);
 }
 
@@ -317,6 +587,7 @@ Node *copyNode(Node *node)
     
     newNode->left  = copyNode(node->left);
     newNode->right = copyNode(node->right);
+    newNode->hash  = node->hash;
 
     return newNode;
 }
@@ -370,74 +641,189 @@ void LatexPlot(Node *node, int width, int height, FILE *texfile, const char *fun
     // fprintf(texfile, "\n\\includegraphics{\"%s\"}\n\n", plotfilename_JPG);
 }
 
-FILE *OpenGnuPlotFile(int width, int height)
+FILE *OpenGnuPlotFile(int width, int height, OutputSink *sink)
 {
-    FILE *plotfile = fopen(PLOTFILENAME, "w");
+    sink = GetSink(sink);
+
+    if (sink->plot_backend == PLOT_GNUPLOT)
+    {
+        //Gnuplot may have stopped since the last plot
+        if (sink->gnuplot != nullptr && waitpid(sink->gnuplot_pid, nullptr, WNOHANG) != 0)
+        {
+            StopGnuplot(sink, false);
+        }
+        if (sink->gnuplot == nullptr && !StartGnuplot(sink))
+        {
+            sink->plot_backend = PLOT_NATIVE;
+        }
+    }
+
+    if (sink->plot_backend == PLOT_NATIVE)
+    {
+        PlotFigureDtor(&sink->figure);
+        sink->figure.x_min = -width;
+        sink->figure.x_max =  width;
+        sink->figure.y_min = -height;
+        sink->figure.y_max =  height;
+    }
+
+    FILE *plotfile = open_memstream(&sink->plot_script, &sink->plot_script_len);
     if (plotfile == nullptr)
     {
         printf("Error opening file for plot\n");
+        return nullptr;
     }
 
     char plotfilename_PNG[MAX_PLOT_FILENAME_LEN] = "";
-    sprintf(plotfilename_PNG, FUNC_PLOT_FILENAME_PNG, PlotCounter);
+    sprintf(plotfilename_PNG, FUNC_PLOT_FILENAME_PNG, sink->plot_counter);
 
     fprintf(plotfile,   "set xrange [%d:%d]\n"
                         "set yrange [%d:%d]\n"
-                        "set terminal png\n"
-                        "set output \"./TexFiles/%s\"\n"
+                        "set output \"%s/%s\"\n"
                         "set grid\n"
-                        "plot ", -width, width, -height, height, plotfilename_PNG);
+                        "plot ", -width, width, -height, height, sink->tex_dir, plotfilename_PNG);
 
     return plotfile;   
 }
 
-void AddToGnuplotFile(FILE *plotfile, Node *node, const char *mode, int width, const char *funcname)
+void AddToGnuplotFile(FILE *plotfile, Node *node, const char *mode, int width, const char *funcname, OutputSink *sink)
 {
-    assert(plotfile);
+    CompactTree compact = {};
+    CompactTreeCtor(&compact);
+    compactFromNode(&compact, node);
+
+    AddSamplesToGnuplotFile(plotfile, SampleCompactTree, &compact, mode, width, funcname, sink);
+
+    CompactTreeDtor(&compact);
+}
+
+void AddSamplesToGnuplotFile(FILE *plotfile, PlotSampler sample, void *context, const char *mode, int width, const char *funcname,
+                             OutputSink *sink)
+{
+    assert(plotfile && sample);
+
+    METRICS_SCOPE("plot sampling");
+
+    sink = GetSink(sink);
     
     const double accuracy = ((double)width)/10000;
 
-    const int max_filename_len = 100;
-    char plotDataFilename[max_filename_len] = "";
-    sprintf(plotDataFilename, PLOTDATAFILENAME, PlotDataCounter);
-    PlotDataCounter++;
+    size_t count = 0;
+    for (double x = -width; x < width; x += accuracy)
+    {
+        count++;
+    }
 
-    FILE *plotdatafile = fopen(plotDataFilename, "w");
-    if (plotdatafile == nullptr)
+    double *points = (double *)calloc(2*count + 1, sizeof(double));
+    if (points == nullptr)
     {
-        printf("Error opening file for plot data\n");
+        printf("Error allocating memory for plot data\n");
+        return;
     }
+    double *values = points + count;
 
+    count = 0;
     for (double x = -width; x < width; x += accuracy)
     {
-        fprintf(plotdatafile, "%lg, %lg\n", x, calculateValueForPlot(node, "x", x));
+        points[count++] = x;
     }
 
-    assert(!fclose(plotdatafile));
+    sample(context, points, values, count, sink->plot_accuracy);
+
+    if (sink->plot_backend == PLOT_NATIVE)
+    {
+        PlotFigureAdd(&sink->figure, points, count, mode, funcname);
+        sink->plot_data_counter++;
+        return;
+    }
+
+    if (sink->gnuplot != nullptr)
+    {
+        sigset_t old_set = {};
+        GnuplotWriteBegin(&old_set);
+
+        fprintf(sink->gnuplot, "$curve%d << EOD\n", sink->plot_data_counter);
+        for (size_t i = 0; i < count; i++)
+        {
+            fprintf(sink->gnuplot, "%lg %lg\n", points[i], values[i]);
+        }
+        fprintf(sink->gnuplot, "EOD\n");
+
+        if (!GnuplotWriteEnd(sink, &old_set))
+        {
+            printf("Error: gnuplot has stopped, the plot is not made.\n");
+            StopGnuplot(sink, false);
+            free(points);
+            return;
+        }
+
+        fprintf(plotfile, "$curve%d title \"%s\" with lines %s, ", sink->plot_data_counter, funcname, mode);
+    }
+    sink->plot_data_counter++;
 
-    fprintf(plotfile, "\"%s\" title \"%s\" with lines %s, ", plotDataFilename, funcname, mode);
+    free(points);
 }
 
-void CreatePlot(FILE *plotfile, FILE *texfile)
+void CreatePlot(FILE *plotfile, FILE *texfile, OutputSink *sink)
 {
-    fprintf(plotfile, "\nexit");
+    METRICS_SCOPE("plot");
+
+    sink = GetSink(sink);
+
     fclose(plotfile);
 
-    pid_t PID = fork();
-    if (PID == 0) 
+    char plotfilename_PNG[MAX_PLOT_FILENAME_LEN] = "";
+    sprintf(plotfilename_PNG, FUNC_PLOT_FILENAME_PNG, sink->plot_counter);
+
+    //The last curve leaves ", " after it
+    size_t script_len = sink->plot_script_len;
+    while (script_len > 0 && (sink->plot_script[script_len - 1] == ' ' || sink->plot_script[script_len - 1] == ','))
     {
-        execlp("gnuplot", "gnuplot", PLOTFILENAME, (char *)0);
-        perror("Error running gnuplot: ");
-        exit(1);
+        script_len--;
     }
 
-    char plotfilename_PNG[MAX_PLOT_FILENAME_LEN] = "";
-    sprintf(plotfilename_PNG, FUNC_PLOT_FILENAME_PNG, PlotCounter);
-    PlotCounter++;
+    char mark[MAX_PLOT_FILENAME_LEN] = "";
+    snprintf(mark, MAX_PLOT_FILENAME_LEN, PLOT_DONE_MARK, sink->plot_counter);
+
+    bool isDone = false;
+    if (sink->plot_backend == PLOT_NATIVE)
+    {
+        char filename[MAX_OUTPUT_PATH_LEN + MAX_PLOT_FILENAME_LEN] = "";
+        snprintf(filename, MAX_OUTPUT_PATH_LEN + MAX_PLOT_FILENAME_LEN, "%s/%s", sink->tex_dir, plotfilename_PNG);
+
+        isDone = PlotRender(&sink->figure, filename, sink->plot_pool);
+    }
+    else if (sink->gnuplot != nullptr)
+    {
+        isDone = WaitGnuplot(sink, mark, sink->plot_script, script_len);
+    }
+
+    free(sink->plot_script);
+    sink->plot_script     = nullptr;
+    sink->plot_script_len = 0;
 
-    fprintf(texfile, "\n\\includegraphics{\"%s\"}\n\n", plotfilename_PNG);
+    sink->plot_counter++;
 
-    PlotDataCounter = 1;
+    if (isDone)
+    {
+        fprintf(texfile, "\n\\includegraphics{\"%s\"}\n\n", plotfilename_PNG);
+        PlotLegendLatex(texfile, &sink->figure);
+    }
+    else
+    {
+        printf("Error: %s is not made.\n", plotfilename_PNG);
+    }
+
+    PlotFigureDtor(&sink->figure);
+    sink->plot_data_counter = 1;
+}
+
+void closePlots(OutputSink *sink)
+{
+    sink = GetSink(sink);
+
+    if (sink->gnuplot != nullptr) {StopGnuplot(sink, true);}
+    PlotFigureDtor(&sink->figure);
 }
 
 //--------------------------------------------------------------
@@ -450,6 +836,11 @@ static Node *addNode(Node *node, Type type, Data data, bool toLeft)
     if (toLeft) {node->left  = newNode;}
     else        {node->right = newNode;}
 
+    for (Node *ancestor = node; ancestor != nullptr; ancestor = ancestor->parent)
+    {
+        nodeRehash(ancestor);
+    }
+
     return newNode;
 }
 
@@ -504,25 +895,25 @@ static int creatGraphvizTreeCode(const Node *node, int nodeNum, FILE *dump_file)
     return number_of_nodes;
 }
 
-static void get_dump_filenames(char *dump_filename, char *svg_dump_filename)
+static void get_dump_filenames(const OutputSink *sink, char *dump_filename, char *svg_dump_filename)
 {
-    sprintf(    dump_filename,     DUMP_PATH, Dump_counter);
-    sprintf(svg_dump_filename, SVG_DUMP_PATH, Dump_counter);
+    snprintf(    dump_filename, MAX_PATH_LEN,     DUMP_PATH, sink->dump_dir, sink->dump_counter);
+    snprintf(svg_dump_filename, MAX_PATH_LEN, SVG_DUMP_PATH, sink->dump_dir, sink->dump_counter);
 }
 
-static void printNodeData(FILE *stream, Type type, Data data)
+static void printNodeData(StringBuffer *buffer, Type type, Data data)
 { 
     if (type == NUM)
     {
-        fprintf(stream, "%lg", data.value);
+        StringBufferAppendNumber(buffer, data.value, LATEX_NUMBER_PRECISION);
     }
     else if (type == VAR)
     {
-        fprintf(stream, "%s", data.var);
+        StringBufferAppend(buffer, data.var, strnlen(data.var, MAX_VAR_NAME_LEN));
     }
     else //if (Type == OP)
     { 
-        fprintf(stream, "%s", OPS[data.op].latex_label);
+        StringBufferAppend(buffer, OPS[data.op].latex_label);
     }
 }
 
@@ -531,66 +922,560 @@ static bool IsLeaf(const Node *node)
     return (node->left == nullptr && node->right == nullptr);
 }
 
-static double calculateValueForPlot(Node *node, const char *var, double value)
+static bool isCommutative(const Node *node)
+{
+    return node->type == OP && (node->data.op == ADD || node->data.op == MUL);
+}
+
+//-----------------------------------------------------------
+//! The base of a power is a number, a variable or brackets in
+//! the grammar, its exponent may be a function or a power.
+//-----------------------------------------------------------
+static bool needInfixBrackets(const Node *node, const Node *child, bool isRight)
+{
+    if (child->type != OP) {return false;}
+
+    Operations op       = node->data.op;
+    bool       isBinary = (child->left != nullptr);
+
+    if (op == POW) {return !isRight || (isBinary && child->data.op != POW);}
+    if (!isBinary) {return false;}
+
+    int priority       = OPS[op].priority;
+    int child_priority = OPS[child->data.op].priority;
+
+    return child_priority < priority || (isRight && child_priority == priority && (op == SUB || op == DIV));
+}
+
+static unsigned long long MixHash(unsigned long long value)
+{
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ULL;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBULL;
+    value ^= value >> 31;
+
+    return value;
+}
+
+static void SampleCompactTree(void *context, const double *x, double *y, size_t count, MathAccuracy accuracy)
+{
+    if (!compactEvaluateBatch((const CompactTree *)context, "x", x, y, count, accuracy))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            y[i] = compactEvaluate((CompactTree *)context, "x", x[i]);
+        }
+    }
+}
+
+static OutputSink *GetSink(OutputSink *sink)
+{
+    return (sink != nullptr) ? sink : &DefaultSink;
+}
+
+//-----------------------------------------------------------
+//! Gnuplot reads commands from a pipe and prints marks to
+//! another one. A failed exec is reported through a third
+//! pipe, which is closed by a successful one.
+//-----------------------------------------------------------
+static bool StartGnuplot(OutputSink *sink)
+{
+    METRICS_SCOPE("gnuplot start");
+
+    int input [2] = {-1, -1};
+    int reply [2] = {-1, -1};
+    int status[2] = {-1, -1};
+
+    pid_t pid = -1;
+    if (pipe2(input, O_CLOEXEC) == 0 && pipe2(reply, O_CLOEXEC) == 0 && pipe2(status, O_CLOEXEC) == 0)
+    {
+        pid = fork();
+    }
+
+    if (pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(reply[1], STDOUT_FILENO);
+
+        execlp("gnuplot", "gnuplot", (char *)0);
+
+        int error = errno;
+        write(status[1], &error, sizeof(error));
+        _exit(1);
+    }
+
+    int error = (pid > 0) ? 0 : errno;
+    if (pid > 0)
+    {
+        close(status[1]);
+        status[1] = -1;
+
+        if (read(status[0], &error, sizeof(error)) != sizeof(error)) {error = 0;}
+    }
+
+    int ends[] = {input[0], reply[1], status[0], status[1]};
+    for (int end : ends)
+    {
+        if (end >= 0) {close(end);}
+    }
+
+    if (pid <= 0 || error != 0)
+    {
+        printf("Error running gnuplot: %s. Plots are drawn by the built-in renderer.\n", strerror(error));
+
+        if (input[1] >= 0) {close(input[1]);}
+        if (reply[0] >= 0) {close(reply[0]);}
+        if (pid > 0)       {waitpid(pid, nullptr, 0);}
+
+        return false;
+    }
+
+    sink->gnuplot       = fdopen(input[1], "w");
+    sink->gnuplot_reply = fdopen(reply[0], "r");
+    sink->gnuplot_pid   = pid;
+
+    fprintf(sink->gnuplot, "set terminal png\n"
+                           "set print \"-\"\n");
+
+    return true;
+}
+
+static void StopGnuplot(OutputSink *sink, bool isRunning)
+{
+    sigset_t old_set = {};
+    GnuplotWriteBegin(&old_set);
+
+    if (isRunning) {fprintf(sink->gnuplot, "exit\n");}
+    fclose(sink->gnuplot);
+    sink->gnuplot = nullptr;
+
+    GnuplotWriteEnd(sink, &old_set);
+
+    fclose(sink->gnuplot_reply);
+    waitpid(sink->gnuplot_pid, nullptr, 0);
+
+    sink->gnuplot_reply = nullptr;
+    sink->gnuplot_pid   = 0;
+}
+
+//-----------------------------------------------------------
+//! Sends the script. Gnuplot runs commands in order, so the
+//! mark comes after the PNG of the script is closed. A
+//! gnuplot silent for GNUPLOT_REPLY_TIMEOUT_MS (for example,
+//! waiting on a prompt) is killed.
+//-----------------------------------------------------------
+static bool WaitGnuplot(OutputSink *sink, const char *mark, const char *script, size_t script_len)
+{
+    sigset_t old_set = {};
+    GnuplotWriteBegin(&old_set);
+
+    fprintf(sink->gnuplot, "%.*s\nunset output\n", (int)script_len, script);
+    fprintf(sink->gnuplot, "print \"%s\"\n", mark);
+
+    int  reply     = fileno(sink->gnuplot_reply);
+    bool isRunning = GnuplotWriteEnd(sink, &old_set);
+
+    char   line[MAX_PLOT_FILENAME_LEN] = "";
+    size_t len = 0;
+    while (isRunning)
+    {
+        struct pollfd ready = {reply, POLLIN, 0};
+        int events = poll(&ready, 1, GNUPLOT_REPLY_TIMEOUT_MS);
+        if (events < 0 && errno == EINTR) {continue;}
+        if (events == 0)
+        {
+            printf("Error: gnuplot has not answered for %d ms and is stopped.\n", GNUPLOT_REPLY_TIMEOUT_MS);
+            kill(sink->gnuplot_pid, SIGKILL);
+            break;
+        }
+
+        char symbol = '\0';
+        if (events < 0 || read(reply, &symbol, 1) != 1) {break;}
+
+        if (symbol != '\n')
+        {
+            if (len + 1 < MAX_PLOT_FILENAME_LEN) {line[len++] = symbol;}
+            continue;
+        }
+
+        line[len] = '\0';
+        len = 0;
+        if (strcmp(line, mark) == 0) {return true;}
+    }
+
+    StopGnuplot(sink, false);
+    return false;
+}
+
+//-----------------------------------------------------------
+//! Writes to gnuplot go between these two with SIGPIPE
+//! blocked in this thread, so a gnuplot that has exited
+//! fails the write instead of killing the program. End
+//! flushes the commands and takes off the SIGPIPE they
+//! raised before the mask is restored.
+//-----------------------------------------------------------
+static void GnuplotWriteBegin(sigset_t *old_set)
+{
+    sigset_t pipe_set = {};
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+
+    pthread_sigmask(SIG_BLOCK, &pipe_set, old_set);
+}
+
+static bool GnuplotWriteEnd(OutputSink *sink, const sigset_t *old_set)
+{
+    bool isWritten = sink->gnuplot == nullptr || (fflush(sink->gnuplot) == 0 && !ferror(sink->gnuplot));
+
+    sigset_t pending = {};
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE) && !sigismember(old_set, SIGPIPE))
+    {
+        sigset_t pipe_set = {};
+        sigemptyset(&pipe_set);
+        sigaddset(&pipe_set, SIGPIPE);
+
+        const struct timespec no_wait = {0, 0};
+        sigtimedwait(&pipe_set, nullptr, &no_wait);
+    }
+
+    pthread_sigmask(SIG_SETMASK, old_set, nullptr);
+    return isWritten;
+}
+
+static size_t treeSize(const Node *node)
 {
     if (node == nullptr) {return 0;}
 
-    double left  = calculateValueForPlot(node->left,  var, value);
-    double right = calculateValueForPlot(node->right, var, value);
+    return 1 + treeSize(node->left) + treeSize(node->right);
+}
+
+static bool LatexAbbrevsCtor(LatexAbbrevs *abbrevs, const Node *root)
+{
+    *abbrevs = {};
+
+    size_t size     = treeSize(root);
+    size_t capacity = 16;
+    while (capacity < 2*size) {capacity *= 2;}
+
+    abbrevs->table = (LatexSubtree *)calloc(capacity, sizeof(LatexSubtree));
+    abbrevs->named = (const Node  **)calloc(size,     sizeof(Node *));
+    if (abbrevs->table == nullptr || abbrevs->named == nullptr)
+    {
+        printf("Error allocating memory for LaTeX abbreviations.\n");
+        LatexAbbrevsDtor(abbrevs);
+        return false;
+    }
+    abbrevs->capacity = capacity;
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        abbrevs->table[i] = {};
+    }
+
+    collectSubtrees(abbrevs, root);
+    nameSubtrees   (abbrevs, root, true);
+
+    return true;
+}
+
+static void LatexAbbrevsDtor(LatexAbbrevs *abbrevs)
+{
+    free(abbrevs->table);
+    free(abbrevs->named);
+
+    *abbrevs = {};
+}
 
-    switch (node->type)
+//-----------------------------------------------------------
+//! Entry of the subtree equal to node or the empty slot where
+//! it goes. With onlyNamed unnamed entries are not compared.
+//-----------------------------------------------------------
+static LatexSubtree *findSubtree(LatexAbbrevs *abbrevs, const Node *node, bool onlyNamed)
+{
+    size_t mask  = abbrevs->capacity - 1;
+    size_t index = (size_t)node->hash & mask;
+
+    while (abbrevs->table[index].node != nullptr)
     {
-    case NUM:
-        return node->data.value;
-        break;
-    case VAR:
-        if (strcmp(node->data.var, var) == 0)
+        LatexSubtree *subtree = &abbrevs->table[index];
+
+        if (subtree->node->hash == node->hash && (!onlyNamed || subtree->name >= 0) &&
+            (subtree->node == node || isEqualTrees(subtree->node, node)))
         {
-            return value;
+            return subtree;
         }
-        else
+
+        index = (index + 1) & mask;
+    }
+
+    return &abbrevs->table[index];
+}
+
+//-----------------------------------------------------------
+//! Children are counted only when a subtree is met for the
+//! first time, so the table describes the tree as a DAG
+//-----------------------------------------------------------
+static LatexSubtree *collectSubtrees(LatexAbbrevs *abbrevs, const Node *node)
+{
+    LatexSubtree *subtree = findSubtree(abbrevs, node, false);
+    if (subtree->node != nullptr) {return subtree;}
+
+    size_t size = 1;
+
+    const Node *children[] = {node->left, node->right};
+    for (const Node *child : children)
+    {
+        if (child == nullptr) {continue;}
+
+        LatexSubtree *child_subtree = collectSubtrees(abbrevs, child);
+        child_subtree->uses++;
+        size += child_subtree->size;
+    }
+
+    //The slot may have been taken by a child
+    subtree = findSubtree(abbrevs, node, false);
+
+    subtree->node = node;
+    subtree->size = size;
+
+    return subtree;
+}
+
+//-----------------------------------------------------------
+//! Names are given in the order of printing. Only the printed
+//! part of the tree is visited: an abbreviated subtree is
+//! entered once, for its definition.
+//-----------------------------------------------------------
+static void nameSubtrees(LatexAbbrevs *abbrevs, const Node *node, bool isDefinition)
+{
+    if (node == nullptr) {return;}
+
+    if (!isDefinition)
+    {
+        LatexSubtree *subtree = findSubtree(abbrevs, node, false);
+        if (subtree->uses >= 2 && subtree->size >= LATEX_ABBREV_MIN_NODES)
         {
-            return 0;
+            if (subtree->name < 0)
+            {
+                subtree->name = abbrevs->count;
+                abbrevs->named[abbrevs->count++] = subtree->node;
+
+                nameSubtrees(abbrevs, subtree->node, true);
+            }
+            return;
         }
-        break;
-    case OP:
-        switch (node->data.op)
+    }
+
+    nameSubtrees(abbrevs, node->left,  false);
+    nameSubtrees(abbrevs, node->right, false);
+}
+
+//-----------------------------------------------------------
+//! A, B, ..., Z, A_{1}, B_{1}, ...
+//-----------------------------------------------------------
+static void getAbbrevName(char *name, int index)
+{
+    char letter = (char)('A' + index % ABBREV_LETTERS);
+
+    if (index < ABBREV_LETTERS)
+    {
+        snprintf(name, MAX_ABBREV_NAME_LEN, "%c", letter);
+    }
+    else
+    {
+        snprintf(name, MAX_ABBREV_NAME_LEN, "%c_{%d}", letter, index / ABBREV_LETTERS);
+    }
+}
+
+static void latexPrint(StringBuffer *buffer, const Node *node, bool needBrackets, LatexAbbrevs *abbrevs)
+{
+    if (node == nullptr) {return;}
+
+    if (abbrevs != nullptr && node != abbrevs->defining)
+    {
+        LatexSubtree *subtree = findSubtree(abbrevs, node, true);
+        if (subtree->node != nullptr)
         {
-        case ADD:
-            return left + right;
-        case SUB:
-            return left - right;
-        case MUL:
-            return left * right;
-        case DIV:
-            if (right == 0) {return 0;}
-            return left / right;
-        case SIN:
-            return sin(right);
-        case COS:
-            return cos(right);
-        case TAN:
-            return tan(right);
-        case COT:
-            return 1/tan(right);
-        case ARCSIN:
-            return asin(right);
-        case ARCCOS:
-            return acos(right);
-        case ARCTAN:
-            return atan(right);
-        case ARCCOT:
-            return M_PI_2 - atan(right);
-        case LN:
-            return log(right);
-        case SQRT:
-            return sqrt(right);
-        case POW:
-            return pow(left, right);
-        break;
+            char name[MAX_ABBREV_NAME_LEN] = "";
+            getAbbrevName(name, subtree->name);
+
+            StringBufferAppendChar(buffer, OPEN_NODE_SYM);
+            StringBufferAppend    (buffer, name);
+            StringBufferAppendChar(buffer, CLOSE_NODE_SYM);
+            return;
         }
     }
-    return 0;
+
+    StringBufferAppendChar(buffer, OPEN_NODE_SYM);
+
+    if (needBrackets)
+    {
+        StringBufferAppend(buffer, OPS[OPEN_BRACKET].latex_label);
+    }
+
+    if (node->type == OP && node->data.op == DIV)
+    {
+        StringBufferAppend(buffer, OPS[DIV].latex_label);
+        latexPrint(buffer, node->left,  false, abbrevs);
+        latexPrint(buffer, node->right, false, abbrevs);
+    }
+    else
+    {
+        const Node *left  = node->left;
+        const Node *right = node->right;
+
+        bool  needLeftBrackets =  ((left != nullptr) &&  (left->type == OP) && (OPS[ left->data.op].priority < OPS[node->data.op].priority));
+        bool needRightBrackets = ((right != nullptr) && (right->type == OP) && (OPS[right->data.op].priority < OPS[node->data.op].priority));
+
+        needLeftBrackets  = needLeftBrackets  || (node->type == OP && node->data.op == MUL && left->type  == NUM && left->data.value  < 0);
+        needRightBrackets = needRightBrackets || (node->type == OP && node->data.op == MUL && right->type == NUM && right->data.value < 0);
+
+        latexPrint(buffer, left, needLeftBrackets, abbrevs);
+
+        printNodeData(buffer, node->type, node->data);
+
+        latexPrint(buffer, right, needRightBrackets, abbrevs);
+    }
+
+    if (needBrackets)
+    {
+        StringBufferAppend(buffer, OPS[CLOSE_BRACKET].latex_label);
+    }
+
+    StringBufferAppendChar(buffer, CLOSE_NODE_SYM);
+}
+
+
+//-----------------------------------------------------------
+//! Terms of the sums at the top of the formula, a new line is
+//! started before a term when the current one is too long.
+//! Returns true if the formula was split.
+//-----------------------------------------------------------
+static bool latexPrintLines(StringBuffer *buffer, const Node *node, LatexAbbrevs *abbrevs, size_t *line_start)
+{
+    bool isSum = node != nullptr && node->type == OP && (node->data.op == ADD || node->data.op == SUB);
+
+    if (isSum && abbrevs != nullptr && node != abbrevs->defining)
+    {
+        isSum = findSubtree(abbrevs, node, true)->node == nullptr;
+    }
+
+    if (!isSum)
+    {
+        latexPrint(buffer, node, false, abbrevs);
+        return false;
+    }
+
+    bool isSplit = latexPrintLines(buffer, node->left, abbrevs, line_start);
+
+    if (buffer->size - *line_start > LATEX_MAX_LINE_LEN)
+    {
+        StringBufferAppend(buffer, "\\\\\n&");
+        *line_start = buffer->size;
+        isSplit     = true;
+    }
+
+    printNodeData(buffer, node->type, node->data);
+
+    if (node->data.op == ADD)
+    {
+        isSplit = latexPrintLines(buffer, node->right, abbrevs, line_start) || isSplit;
+    }
+    else
+    {
+        latexPrint(buffer, node->right, false, abbrevs);
+    }
+
+    return isSplit;
+}
+
+static void latexFormula(StringBuffer *buffer, const Node *node, LatexAbbrevs *abbrevs,
+                         const char *prefix, const char *postfix)
+{
+    StringBuffer body = {};
+    StringBufferCtor(&body);
+
+    latexPrint(&body, node, false, abbrevs);
+
+    bool isSplit = false;
+    if (body.size > LATEX_MAX_LINE_LEN)
+    {
+        StringBufferClear(&body);
+
+        size_t line_start = 0;
+        isSplit = latexPrintLines(&body, node, abbrevs, &line_start);
+    }
+
+    StringBufferAppend(buffer, isSplit ? "\n$$\\begin{aligned}" : "\n$$");
+    StringBufferAppend(buffer, prefix);
+    if (isSplit) {StringBufferAppendChar(buffer, '&');}
+
+    StringBufferAppend(buffer, body.data, body.size);
+
+    StringBufferAppend(buffer, postfix);
+    StringBufferAppend(buffer, isSplit ? "\\end{aligned}$$\n\n" : "$$\n\n");
+
+    StringBufferDtor(&body);
+}
+
+static Node *NodeAlloc()
+{
+    Node *node = Allocator.free_list;
+
+    if (node != nullptr)
+    {
+        Allocator.free_list = node->right;
+        Allocator.free_count--;
+        *node = {};
+    }
+    else
+    {
+        node = (Node *)calloc(1, sizeof(Node));
+    }
+
+    Allocator.thread_nodes++;
+    if (++Allocator.live_delta >= LIVE_NODES_BATCH) {PublishLiveNodes(Allocator.live_delta);}
+
+    return node;
 }
 
-//--------------------------------------------------------------
\ No newline at end of file
+static void NodeFree(Node *node)
+{
+    if (Allocator.free_count < NODE_ALLOCATOR_MAX_FREE)
+    {
+        node->right = Allocator.free_list;
+        Allocator.free_list = node;
+        Allocator.free_count++;
+    }
+    else
+    {
+        free(node);
+    }
+
+    Allocator.thread_nodes--;
+    if (--Allocator.live_delta <= -LIVE_NODES_BATCH) {PublishLiveNodes(Allocator.live_delta);}
+}
+
+static void PublishLiveNodes(long long delta)
+{
+    LiveNodes += delta;
+    Allocator.live_delta -= delta;
+}
+
+NodeAllocator::~NodeAllocator()
+{
+    while (free_list != nullptr)
+    {
+        Node *next = free_list->right;
+        free(free_list);
+        free_list = next;
+    }
+    free_count = 0;
+
+    LiveNodes += live_delta;
+    live_delta = 0;
+}
+
+//--------------------------------------------------------------
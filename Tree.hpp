@@ -2,6 +2,11 @@
 #define TREE_HPP
 
 #include <cstdio>
+#include <sys/types.h>
+
+#include "FastMath.hpp"
+#include "PlotRaster.hpp"
+#include "StringBuffer.hpp"
 
 //----------------------------------------------------------------------
 //CONSTANTS
@@ -15,6 +20,8 @@ static const int  MAX_VAR_NAME_LEN = 8;
 
 static const char *OUT_TEX_FILE = "./TexFiles/Differentiator.tex";
 
+static const int  MAX_OUTPUT_PATH_LEN = 256;
+
 //--------------------------------------------------------------
 
 enum Type
@@ -54,16 +61,79 @@ union Data
     char var[MAX_VAR_NAME_LEN];
 };
 
+struct operation
+{
+    const char *label       = nullptr;
+    const char *latex_label = nullptr;
+    const int   priority    = 0;
+};
+
+extern const operation OPS[NUMBER_OF_OPERATIONS];
+
+//-----------------------------------------------------------
+//! hash is a structural (Merkle) hash of the subtree. It does
+//! not depend on the operand order of ADD and MUL, so x*2 and
+//! 2*x have the same hash. Code that changes a node in place
+//! must call nodeRehash() for it.
+//-----------------------------------------------------------
 struct Node
 {
     Type type  = NUM;
     Data data  = {};
 
+    unsigned long long hash = 0;
+
     Node *parent = nullptr;
     Node *left   = nullptr;
     Node *right  = nullptr;
 };
 
+//-----------------------------------------------------------
+//! PLOT_NATIVE draws plots with PlotRender, no process and no
+//! files besides the PNG. PLOT_GNUPLOT falls back to it if
+//! gnuplot can not be started.
+//-----------------------------------------------------------
+enum PlotBackend
+{
+    PLOT_GNUPLOT,
+    PLOT_NATIVE,
+};
+
+//-----------------------------------------------------------
+//! Where graph dumps, plots and the LaTeX report of one
+//! analysis go. Output functions take an optional sink,
+//! nullptr means the default one (./DumpFiles, ./TexFiles).
+//! A sink must not be used by two threads at the same time.
+//! Plots are sampled with plot_accuracy (see FastMath). The
+//! sink keeps one gnuplot process for all its plots, it is
+//! stopped by closePlots.
+//-----------------------------------------------------------
+struct OutputSink
+{
+    char tex_dir [MAX_OUTPUT_PATH_LEN] = "./TexFiles";
+    char dump_dir[MAX_OUTPUT_PATH_LEN] = "./DumpFiles";
+
+    bool graph_dumps = true;
+    bool pdf         = true;
+
+    MathAccuracy plot_accuracy = MATH_EXACT;
+    PlotBackend  plot_backend  = PLOT_GNUPLOT;
+    DiffPool    *plot_pool     = nullptr;
+
+    int  dump_counter      = 1;
+    int  plot_counter      = 1;
+    int  plot_data_counter = 1;
+
+    FILE  *gnuplot         = nullptr;
+    FILE  *gnuplot_reply   = nullptr;
+    pid_t  gnuplot_pid     = 0;
+
+    char  *plot_script     = nullptr;
+    size_t plot_script_len = 0;
+
+    PlotFigure figure = {};
+};
+
 //----------------------------------------------------------------------
 
 Node *treeCtor   (Type type, Data data);
@@ -72,22 +142,58 @@ Node *addToRight (Node *node, Type type, Data data );
 void  treeDtor   (Node *node);
 void  nodeDtor   (Node *node);
 
+size_t treeLiveNodes ();
+
+//-----------------------------------------------------------
+//! Nodes made minus nodes freed by the calling thread. Work
+//! handed to another thread is moved back to the owner with
+//! treeMoveThreadNodes.
+//-----------------------------------------------------------
+long long treeThreadNodes     ();
+void      treeMoveThreadNodes (long long count);
+
+unsigned long long nodeHash (const Node *node);
+void nodeRehash   (Node *node);
+void treeRehash   (Node *node);
+bool isEqualTrees (const Node *first, const Node *second);
+
+void treePrint     (StringBuffer *buffer, const Node *node, bool needBrackets = false);
 void treePrint     (FILE *stream,         const Node *node, bool needBrackets = false);
 void treePrint     (const char *filename, const Node *node, bool needBrackets = false);
 void treeLatex     (const Node *node, FILE *out, const char *prefix = "f(x) = ", bool withPhrases = false, const char *postfix = "");
-void treeGraphDump (const Node *node);
+void treePrintInfix(StringBuffer *buffer, const Node *node);
+void treePrintInfix(FILE *stream,         const Node *node);
+void treeGraphDump (const Node *node, OutputSink *sink = nullptr);
 
 FILE *initLatex  (const char *filename = OUT_TEX_FILE);
 FILE *initLatex  (FILE *stream);
-void  closeLatex (FILE *stream);
+FILE *initLatex  (OutputSink *sink);
+void  closeLatex (FILE *stream, OutputSink *sink = nullptr);
 
 Node *copyNode (Node *node);
 
 void LatexPlot        (Node *node, int width, int height, FILE *texfile, const char *funcname);
 
-FILE *OpenGnuPlotFile (int width, int height);
-void AddToGnuplotFile (FILE *plotfile, Node *node, const char *mode, int width, const char *funcname);
-void CreatePlot       (FILE *plotfile, FILE *texfile);
+//-----------------------------------------------------------
+//! y[i] = f(x[i]) for all points of a plot at once. Samplers
+//! of functions without libm calls may ignore the accuracy.
+//-----------------------------------------------------------
+typedef void (*PlotSampler)(void *context, const double *x, double *y, size_t count, MathAccuracy accuracy);
+
+//-----------------------------------------------------------
+//! plotfile is the script of one figure in memory. Samples
+//! go straight to the gnuplot process of the sink as data
+//! blocks. CreatePlot runs the script and waits until the PNG
+//! is written, so LaTeX can include it. With PLOT_NATIVE the
+//! samples are kept in the figure of the sink and CreatePlot
+//! draws it.
+//-----------------------------------------------------------
+FILE *OpenGnuPlotFile        (int width, int height, OutputSink *sink = nullptr);
+void AddToGnuplotFile        (FILE *plotfile, Node *node, const char *mode, int width, const char *funcname, OutputSink *sink = nullptr);
+void AddSamplesToGnuplotFile (FILE *plotfile, PlotSampler sample, void *context, const char *mode, int width, const char *funcname,
+                              OutputSink *sink = nullptr);
+void CreatePlot       (FILE *plotfile, FILE *texfile, OutputSink *sink = nullptr);
+void closePlots       (OutputSink *sink = nullptr);
 
 //----------------------------------------------------------------------
 
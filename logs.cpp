@@ -1,5 +1,13 @@
+#include <atomic>
 #include <cstdarg>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "logs.hpp"
 
@@ -34,39 +42,419 @@ static FILE *Logfile = nullptr;
 //--------------------------------------------------------------
 
 #ifdef LOGS
+
+//-----------------------------------------------------------
+//! Producers format a message and put it into a slot of a
+//! bounded lock-free ring (Vyukov MPMC queue), the writer
+//! thread moves messages to a batch buffer and writes it with
+//! one write() per batch. Messages longer than a slot are kept
+//! on the heap and the slot holds the pointer.
+//-----------------------------------------------------------
+
+static const size_t LOG_RING_SIZE  = 1024;
+static const size_t LOG_SLOT_SIZE  = 256;
+static const size_t LOG_BATCH_SIZE = 1 << 16;
+
+static const char *LEVEL_PREFIXES[] = {"", "", "<p>Warning: ", "<p>Error: "};
+static const int   CRASH_SIGNALS[]  = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+struct LogSlot
+{
+    std::atomic<size_t> sequence;
+    size_t              length;
+    char               *heap_text;
+    char                text[LOG_SLOT_SIZE];
+};
+
+static LogSlot             Ring[LOG_RING_SIZE];
+static std::atomic<size_t> EnqueuePos(0);
+static std::atomic<size_t> DequeuePos(0);
+
+static char                Batch[LOG_BATCH_SIZE];
+static std::atomic<size_t> BatchUsed(0);
+static size_t              BatchMessages = 0;
+static std::atomic<size_t> WrittenPos(0);
+
+static int                 LogFd      = -1;
+static pid_t               LogPid     = 0;
+static pthread_t           Writer     = {};
+static std::atomic<bool>   isStopping(false);
+static std::atomic<bool>   isFlushing(false);
+static bool                isAtExitSet = false;
+
+//The idle writer waits on WakeCond, producers signal it only when isWriterIdle is set
+static pthread_mutex_t     WakeLock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      WakeCond     = PTHREAD_COND_INITIALIZER;
+static std::atomic<bool>   isWriterIdle(false);
+
+//--------------------------------------------------------------
+
+static int   vlogMessage   (int level, const char *format, va_list args);
+static void  PushMessage   (const char *text, size_t length, char *heap_text);
+static bool  PopMessage    (char *out, size_t capacity, size_t *length);
+static void  WriteAll      (const char *data, size_t size);
+static void *WriterThread  (void *);
+static void  DrainToBatch  ();
+static void  WriteBatch    ();
+static void  WaitMessages  ();
+static void  WakeWriter    ();
+static void  CrashHandler  (int signal_number);
+static void  AtExitFlush   ();
+
+//--------------------------------------------------------------
+
     void initLog()
     {
         Logfile = fopen(LOG_FILENAME, "w");
         if (!Logfile)
         {
-            printf("Error opening logfile");
+            fprintf(stderr, "Error opening logfile %s\n", LOG_FILENAME);
             return;
         }
 
-        setvbuf(Logfile, nullptr, _IONBF, 0);
-
         fprintf(Logfile, START_LOGFILE, BACKGROUND_IMG);
+        fflush(Logfile);
+
+        LogFd  = fileno(Logfile);
+        LogPid = getpid();
+
+        for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        {
+            Ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        EnqueuePos.store(0);
+        DequeuePos.store(0);
+        BatchUsed.store(0);
+        WrittenPos.store(0);
+        BatchMessages = 0;
+        isStopping.store(false);
+
+        if (pthread_create(&Writer, nullptr, WriterThread, nullptr) != 0)
+        {
+            fprintf(stderr, "Error starting log writer thread\n");
+            fclose(Logfile);
+            Logfile = nullptr;
+            return;
+        }
+
+        struct sigaction action = {};
+        action.sa_handler = CrashHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags   = SA_RESETHAND;
+
+        for (size_t i = 0; i < sizeof(CRASH_SIGNALS) / sizeof(int); i++)
+        {
+            sigaction(CRASH_SIGNALS[i], &action, nullptr);
+        }
+
+        if (!isAtExitSet)
+        {
+            atexit(AtExitFlush);
+            isAtExitSet = true;
+        }
     }
 
     int log(const char *format, ...)
     {
-        if (Logfile == nullptr) {return -1;}
+        va_list args = {};
+        va_start(args, format);
+
+        int result = vlogMessage(LOG_LEVEL_INFO, format, args);
+
+        va_end(args);
+        return result;
+    }
 
-        va_list ptr = {};
-        va_start(ptr, format);
+    int logMessage(int level, const char *format, ...)
+    {
+        va_list args = {};
+        va_start(args, format);
 
-        int result = vfprintf(Logfile, format, ptr);
+        int result = vlogMessage(level, format, args);
 
-        va_end(ptr);
+        va_end(args);
         return result;
     }
 
+    //-----------------------------------------------------------
+    //! Wait until everything logged before the call is written
+    //-----------------------------------------------------------
+    void flushLog()
+    {
+        if (Logfile == nullptr) {return;}
+
+        size_t target = EnqueuePos.load(std::memory_order_acquire);
+
+        while (WrittenPos.load(std::memory_order_acquire) < target)
+        {
+            sched_yield();
+        }
+    }
+
     void closeLog()
+    {
+        if (Logfile == nullptr) {return;}
+
+        isStopping.store(true, std::memory_order_release);
+        WakeWriter();
+        pthread_join(Writer, nullptr);
+
+        fclose(Logfile);
+        Logfile = nullptr;
+        LogFd   = -1;
+    }
+
+//--------------------------------------------------------------
+
+static int vlogMessage(int level, const char *format, va_list args)
+{
+    if (Logfile == nullptr) {return -1;}
+
+    if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_ERROR) {level = LOG_LEVEL_ERROR;}
+
+    char   text[LOG_SLOT_SIZE] = "";
+    size_t prefix = strlen(LEVEL_PREFIXES[level]);
+    memcpy(text, LEVEL_PREFIXES[level], prefix);
+
+    va_list copy = {};
+    va_copy(copy, args);
+    int length = vsnprintf(text + prefix, LOG_SLOT_SIZE - prefix, format, args);
+
+    if (length < 0)
+    {
+        va_end(copy);
+        return length;
+    }
+
+    size_t total     = prefix + (size_t)length;
+    char  *heap_text = nullptr;
+
+    if (total >= LOG_SLOT_SIZE)
+    {
+        heap_text = (char *)calloc(total + 1, sizeof(char));
+        if (heap_text != nullptr)
+        {
+            memcpy(heap_text, LEVEL_PREFIXES[level], prefix);
+            vsnprintf(heap_text + prefix, (size_t)length + 1, format, copy);
+        }
+        else
+        {
+            total = LOG_SLOT_SIZE - 1;
+        }
+    }
+    va_end(copy);
+
+    PushMessage(text, total, heap_text);
+
+    return length;
+}
+
+static void PushMessage(const char *text, size_t length, char *heap_text)
+{
+    size_t   pos  = EnqueuePos.load(std::memory_order_relaxed);
+    LogSlot *slot = nullptr;
+
+    while (true)
+    {
+        slot = &Ring[pos % LOG_RING_SIZE];
+
+        size_t    sequence   = slot->sequence.load(std::memory_order_acquire);
+        ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        if (difference == 0)
+        {
+            if (EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {break;}
+        }
+        else if (difference < 0)
+        {
+            sched_yield();
+            pos = EnqueuePos.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            pos = EnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->length    = length;
+    slot->heap_text = heap_text;
+    if (heap_text == nullptr)
+    {
+        memcpy(slot->text, text, length);
+    }
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    //Both this and WaitMessages are seq_cst: either the writer sees the message or it is woken
+    if (isWriterIdle.load(std::memory_order_seq_cst)) {WakeWriter();}
+}
+
+//-----------------------------------------------------------
+//! Copy the oldest message to 'out'. Returns false if the
+//! ring is empty or the message does not fit.
+//-----------------------------------------------------------
+static bool PopMessage(char *out, size_t capacity, size_t *length)
+{
+    size_t   pos  = DequeuePos.load(std::memory_order_relaxed);
+    LogSlot *slot = nullptr;
+
+    while (true)
+    {
+        slot = &Ring[pos % LOG_RING_SIZE];
+
+        size_t    sequence   = slot->sequence.load(std::memory_order_acquire);
+        ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+
+        if (difference < 0) {return false;}
+
+        if (difference == 0)
+        {
+            if (slot->length > capacity && capacity < LOG_BATCH_SIZE) {return false;}
+
+            if (DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {break;}
+        }
+        else
+        {
+            pos = DequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    const char *text = (slot->heap_text != nullptr) ? slot->heap_text : slot->text;
+
+    *length = (slot->length < capacity) ? slot->length : capacity;
+    memcpy(out, text, *length);
+
+    free(slot->heap_text);
+    slot->heap_text = nullptr;
+
+    slot->sequence.store(pos + LOG_RING_SIZE, std::memory_order_release);
+    return true;
+}
+
+static void WriteAll(const char *data, size_t size)
+{
+    while (size > 0 && LogFd >= 0)
+    {
+        ssize_t written = write(LogFd, data, size);
+        if (written <= 0) {return;}
+
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+static void *WriterThread(void *)
 {
-    fclose(Logfile);
+    while (true)
+    {
+        bool wasStopping = isStopping.load(std::memory_order_acquire);
+
+        DrainToBatch();
+        WriteBatch();
+
+        if (DequeuePos.load() != EnqueuePos.load()) {continue;}
+        if (wasStopping) {break;}
+
+        WaitMessages();
+    }
+
+    return nullptr;
 }
+
+//-----------------------------------------------------------
+//! Parks the writer until a message is pushed or the log is
+//! closed, so an idle log does not wake the thread
+//-----------------------------------------------------------
+static void WaitMessages()
+{
+    pthread_mutex_lock(&WakeLock);
+
+    isWriterIdle.store(true, std::memory_order_seq_cst);
+
+    while (DequeuePos.load() == EnqueuePos.load() && !isStopping.load(std::memory_order_acquire))
+    {
+        pthread_cond_wait(&WakeCond, &WakeLock);
+    }
+
+    isWriterIdle.store(false, std::memory_order_relaxed);
+
+    pthread_mutex_unlock(&WakeLock);
+}
+
+static void WakeWriter()
+{
+    pthread_mutex_lock(&WakeLock);
+    pthread_cond_signal(&WakeCond);
+    pthread_mutex_unlock(&WakeLock);
+}
+
+static void DrainToBatch()
+{
+    size_t used   = BatchUsed.load(std::memory_order_relaxed);
+    size_t length = 0;
+
+    while (PopMessage(Batch + used, LOG_BATCH_SIZE - used, &length))
+    {
+        used += length;
+        BatchUsed.store(used, std::memory_order_release);
+        BatchMessages++;
+
+        if (used == LOG_BATCH_SIZE) {break;}
+    }
+}
+
+static void WriteBatch()
+{
+    size_t used = BatchUsed.load(std::memory_order_acquire);
+    if (used == 0) {return;}
+
+    WriteAll(Batch, used);
+    BatchUsed.store(0, std::memory_order_release);
+
+    WrittenPos.fetch_add(BatchMessages, std::memory_order_release);
+    BatchMessages = 0;
+}
+
+//-----------------------------------------------------------
+//! Write what is still in memory and let the signal kill the
+//! process. Only write() is called: the messages are written
+//! from their slots and nothing is dequeued or freed, malloc
+//! may be the place of the crash. The writer thread may be in
+//! the middle of a batch, so the last lines of the log can be
+//! repeated.
+//-----------------------------------------------------------
+static void CrashHandler(int signal_number)
+{
+    if (!isFlushing.exchange(true))
+    {
+        WriteAll(Batch, BatchUsed.load());
+
+        size_t end = EnqueuePos.load(std::memory_order_acquire);
+        for (size_t pos = DequeuePos.load(std::memory_order_acquire); pos < end; pos++)
+        {
+            const LogSlot *slot = &Ring[pos % LOG_RING_SIZE];
+
+            //The producer of this slot has not finished it
+            if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {break;}
+
+            WriteAll((slot->heap_text != nullptr) ? slot->heap_text : slot->text, slot->length);
+        }
+    }
+
+    raise(signal_number);
+}
+
+static void AtExitFlush()
+{
+    if (getpid() != LogPid) {return;}
+
+    closeLog();
+}
+
 #else
     void initLog(){}
     int log(const char *format, ...){return 0;}
+    int logMessage(int level, const char *format, ...){return 0;}
+    void flushLog(){}
     void closeLog(){}
-#endif //LOGS
\ No newline at end of file
+#endif //LOGS
@@ -5,10 +5,54 @@
 
 //----------------------------------------------------------------------------------------------------------------
 
-void initLog  ();
-int  log      (const char *format, ...);
-void closeLog ();
+#define LOG_LEVEL_DEBUG   0
+#define LOG_LEVEL_INFO    1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR   3
+
+//-----------------------------------------------------------
+//! Messages below the threshold are removed at compile time
+//! (their arguments are not evaluated). Override with
+//! -DLOG_THRESHOLD=LOG_LEVEL_DEBUG etc.
+//-----------------------------------------------------------
+#ifndef LOG_THRESHOLD
+    #define LOG_THRESHOLD LOG_LEVEL_INFO
+#endif
+
+//----------------------------------------------------------------------------------------------------------------
+
+void initLog    ();
+int  log        (const char *format, ...);
+int  logMessage (int level, const char *format, ...);
+void flushLog   ();
+void closeLog   ();
+
+//----------------------------------------------------------------------------------------------------------------
+
+#if LOG_THRESHOLD <= LOG_LEVEL_DEBUG
+    #define LOG_DEBUG(...)   logMessage(LOG_LEVEL_DEBUG,   __VA_ARGS__)
+#else
+    #define LOG_DEBUG(...)   ((void)0)
+#endif
+
+#if LOG_THRESHOLD <= LOG_LEVEL_INFO
+    #define LOG_INFO(...)    logMessage(LOG_LEVEL_INFO,    __VA_ARGS__)
+#else
+    #define LOG_INFO(...)    ((void)0)
+#endif
+
+#if LOG_THRESHOLD <= LOG_LEVEL_WARNING
+    #define LOG_WARNING(...) logMessage(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+    #define LOG_WARNING(...) ((void)0)
+#endif
+
+#if LOG_THRESHOLD <= LOG_LEVEL_ERROR
+    #define LOG_ERROR(...)   logMessage(LOG_LEVEL_ERROR,   __VA_ARGS__)
+#else
+    #define LOG_ERROR(...)   ((void)0)
+#endif
 
 //----------------------------------------------------------------------------------------------------------------
 
-#endif //LOGS_HPP
\ No newline at end of file
+#endif //LOGS_HPP
@@ -1,20 +1,86 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
 
+#include "DiffContext.hpp"
 #include "Differentiator.hpp"
 #include "logs.hpp"
+#include "Metrics.hpp"
 #include "MyGeneralFunctions.hpp"
+#include "Server.hpp"
 #include "Syntax_analyzer.hpp"
 
 int main(const int argc, const char *argv[])
 {
+    //In JSON mode stdout carries only JSON: it gets a stream of its own and the diagnostics go to stderr
+    FILE *json_output = stdout;
+    if (argc >= 2 && strcmp(argv[1], "--json") == 0)
+    {
+        int json_fd = dup(STDOUT_FILENO);
+        if (json_fd >= 0 && (json_output = fdopen(json_fd, "w")) != nullptr)
+        {
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+        else
+        {
+            if (json_fd >= 0) {close(json_fd);}
+            json_output = stdout;
+        }
+    }
+
     initLog();
+    METRICS_INIT();
+
+    if (argc >= 2 && strcmp(argv[1], "--server") == 0)
+    {
+        const char *socket_path = (argc >= 3) ? argv[2] : SERVER_STD_SOCKET;
+        int         workers     = (argc >= 4) ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        DiffSettings settings = {};
+        settings.graph_dumps  = false;
+        settings.pdf          = false;
+        settings.print_stats  = false;
+
+        ServerRun(socket_path, workers, &settings);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "--client") == 0)
+    {
+        ClientRun((argc >= 3) ? argv[2] : SERVER_STD_SOCKET, stdin, stdout);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "--json") == 0)
+    {
+        const char *filename = (argc >= 3) ? argv[2] : "./funcfile";
+        int         samples  = (argc >= 4) ? atoi(argv[3]) : 0;
 
-    const char *filename = (argc == 2) ? argv[1] : "./funcfile";
-    FILE *input_file = fopen(filename, "r");
+        DiffSettings settings = {};
+        settings.graph_dumps  = false;
+        settings.pdf          = false;
+        settings.print_stats  = false;
 
-    FILE *texfile = fopen(OUT_TEX_FILE, "w");
+        DiffContext context = {};
+        if (DiffContextCtor(&context, &settings))
+        {
+            FILE *input_file = fopen(filename, "r");
 
-    AnalyseFunction(input_file);
+            DiffContextAnalyseJson(&context, input_file, json_output, samples);
 
+            if (input_file != nullptr) {fclose(input_file);}
+        }
+        DiffContextDtor(&context);
+    }
+    else
+    {
+        const char *filename = (argc == 2) ? argv[1] : "./funcfile";
+        FILE *input_file = fopen(filename, "r");
+
+        FILE *texfile = fopen(OUT_TEX_FILE, "w");
+
+        AnalyseFunction(input_file);
+    }
+
+    METRICS_REPORT();
     closeLog();
-}
\ No newline at end of file
+
+    if (json_output != stdout) {fclose(json_output);}
+}